@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+
+#
+# Compares sending messages to a running instance of yabai one process at a
+# time against sending the same messages through a single 'yabai -m --batch'
+# session. The default message is a read-only query, so the benchmark does not
+# change any window or space.
+#
+# usage: bench_batch.sh [-y yabai] [-n count] [message ...]
+#
+
+yabai=yabai
+count=1000
+
+while getopts "y:n:" opt; do
+    case "$opt" in
+        y) yabai="$OPTARG" ;;
+        n) count="$OPTARG" ;;
+        *) echo "usage: $0 [-y yabai] [-n count] [message ...]" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -gt 0 ]; then
+    message=("$@")
+else
+    message=(query --spaces --space)
+fi
+
+now_ms()
+{
+    perl -MTime::HiRes=time -e 'printf("%.3f\n", time * 1000)'
+}
+
+report()
+{
+    awk -v name="$1" -v start="$2" -v end="$3" -v count="$count" \
+        'BEGIN { printf("bench_batch: %-10s %6d messages %10.1f ms %8.3f ms/message\n", name, count, end - start, (end - start) / count) }'
+}
+
+if ! "$yabai" -m "${message[@]}" > /dev/null; then
+    echo "bench_batch: '$yabai -m ${message[*]}' failed; is yabai running?" >&2
+    exit 1
+fi
+
+start=$(now_ms)
+for ((i = 0; i < count; ++i)); do
+    "$yabai" -m "${message[@]}" > /dev/null || exit 1
+done
+end=$(now_ms)
+report "processes" "$start" "$end"
+
+line=$(printf "%q " "${message[@]}")
+batch=$(mktemp)
+trap 'rm -f "$batch"' EXIT
+for ((i = 0; i < count; ++i)); do
+    echo "$line"
+done > "$batch"
+
+start=$(now_ms)
+"$yabai" -m --batch < "$batch" > /dev/null || exit 1
+end=$(now_ms)
+report "batch" "$start" "$end"
@@ -1,6 +1,7 @@
 #include "application.h"
 
 extern struct event_loop g_event_loop;
+extern struct window_manager g_window_manager;
 
 static OBSERVER_CALLBACK(application_notification_handler)
 {
@@ -30,14 +31,14 @@ static OBSERVER_CALLBACK(application_notification_handler)
         if (!window_id) return;
 
         struct event *event;
-        event_create(event, WINDOW_MOVED, (void *)(intptr_t) window_id);
+        event_create_p2(event, WINDOW_MOVED, (void *)(intptr_t) window_id, g_window_manager.frame_generation, NULL);
         event_loop_post(&g_event_loop, event);
     } else if (CFEqual(notification, kAXWindowResizedNotification)) {
         uint32_t window_id = ax_window_id(element);
         if (!window_id) return;
 
         struct event *event;
-        event_create(event, WINDOW_RESIZED, (void *)(intptr_t) window_id);
+        event_create_p2(event, WINDOW_RESIZED, (void *)(intptr_t) window_id, g_window_manager.frame_generation, NULL);
         event_loop_post(&g_event_loop, event);
     } else if (CFEqual(notification, kAXWindowMiniaturizedNotification)) {
         struct event *event;
@@ -112,6 +113,120 @@ void application_unobserve(struct application *application)
     }
 }
 
+static int compare_latency(const void *a, const void *b)
+{
+    float lhs = *(float *) a;
+    float rhs = *(float *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+//
+// Reads and writes are tracked separately; setting a frame makes the application lay out
+// its contents before it replies and is routinely an order of magnitude slower than reading
+// an attribute, so a shared distribution would either starve writes or make reads wait for
+// far too long before a hung application is noticed.
+//
+
+static float ax_timeout_min[AX_ACCESS_COUNT] =
+{
+    [AX_ACCESS_READ]  = AX_READ_TIMEOUT_MIN,
+    [AX_ACCESS_WRITE] = AX_WRITE_TIMEOUT_MIN
+};
+
+static void application_ax_update_timeout(struct ax_latency *latency, enum ax_access access)
+{
+    if (latency->count < AX_LATENCY_MIN_SAMPLES) return;
+
+    float sample[AX_LATENCY_SAMPLES];
+    memcpy(sample, latency->sample, latency->count * sizeof(float));
+    qsort(sample, latency->count, sizeof(float), compare_latency);
+
+    float p99 = sample[(int)(0.99f * (latency->count - 1))];
+    latency->timeout = min(max(p99 * AX_TIMEOUT_P99_FACTOR, ax_timeout_min[access]), AX_TIMEOUT_MAX);
+}
+
+//
+// The probe runs off the event-loop thread so that an application that is still hung only
+// stalls the probe itself. The result is handed back to the event-loop through an event,
+// because the application may have terminated in the meantime. It talks to the
+// application through an element of its own, so that the messaging timeout it sets never
+// races with the timeouts the event-loop sets on application->ref.
+//
+
+static void application_ax_schedule_probe(struct application *application)
+{
+    pid_t pid = application->pid;
+    float backoff = application->ax.backoff;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, backoff * NSEC_PER_SEC), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        CFTypeRef value = NULL;
+        AXUIElementRef element = AXUIElementCreateApplication(pid);
+        AXUIElementSetMessagingTimeout(element, AX_TIMEOUT_MAX);
+        AXError error = AXUIElementCopyAttributeValue(element, kAXRoleAttribute, &value);
+        if (value) CFRelease(value);
+        CFRelease(element);
+
+        struct event *event;
+        event_create_p2(event, APPLICATION_AX_PROBED, (void *)(intptr_t) pid, error != kAXErrorCannotComplete, NULL);
+        event_loop_post(&g_event_loop, event);
+    });
+}
+
+static void application_ax_open_breaker(struct application *application)
+{
+    struct ax_health *ax = &application->ax;
+    ax->state = AX_BREAKER_OPEN;
+    ax->backoff = ax->backoff ? min(ax->backoff * 2.0f, AX_BREAKER_BACKOFF_MAX) : AX_BREAKER_BACKOFF_MIN;
+
+    debug("%s: %s is not responding, retrying in %.0fs\n", __FUNCTION__, application->name, ax->backoff);
+    application_ax_schedule_probe(application);
+}
+
+bool application_ax_begin(struct application *application, AXUIElementRef element, enum ax_access access, CFAbsoluteTime *start)
+{
+    if (application->ax.state == AX_BREAKER_OPEN) return false;
+
+    float timeout = application->ax.latency[access].timeout;
+    AXUIElementSetMessagingTimeout(element, timeout ? timeout : AX_TIMEOUT_MAX);
+    *start = CFAbsoluteTimeGetCurrent();
+    return true;
+}
+
+void application_ax_end(struct application *application, enum ax_access access, CFAbsoluteTime start, AXError error)
+{
+    struct ax_health *ax = &application->ax;
+    struct ax_latency *latency = &ax->latency[access];
+    float elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+    if (error == kAXErrorCannotComplete) {
+        if (++ax->failures >= AX_BREAKER_THRESHOLD) {
+            application_ax_open_breaker(application);
+        }
+        return;
+    }
+
+    ax->failures = 0;
+    latency->sample[latency->index] = elapsed;
+    latency->index = (latency->index + 1) % AX_LATENCY_SAMPLES;
+    if (latency->count < AX_LATENCY_SAMPLES) ++latency->count;
+
+    application_ax_update_timeout(latency, access);
+}
+
+void application_ax_probe_result(struct application *application, bool responsive)
+{
+    if (application->ax.state != AX_BREAKER_OPEN) return;
+
+    if (responsive) {
+        debug("%s: %s is responding again\n", __FUNCTION__, application->name);
+        application->ax.state = AX_BREAKER_CLOSED;
+        application->ax.failures = 0;
+        application->ax.backoff = 0;
+    } else {
+        application_ax_open_breaker(application);
+    }
+}
+
 uint32_t application_main_window(struct application *application)
 {
     CFTypeRef window_ref;
@@ -126,8 +241,11 @@ uint32_t application_main_window(struct application *application)
 
 uint32_t application_focused_window(struct application *application)
 {
+    CFAbsoluteTime start;
+    if (!application_ax_begin(application, application->ref, AX_ACCESS_READ, &start)) return 0;
+
     CFTypeRef window_ref = NULL;
-    AXUIElementCopyAttributeValue(application->ref, kAXFocusedWindowAttribute, &window_ref);
+    application_ax_end(application, AX_ACCESS_READ, start, AXUIElementCopyAttributeValue(application->ref, kAXFocusedWindowAttribute, &window_ref));
     if (!window_ref) return 0;
 
     uint32_t window_id = ax_window_id(window_ref);
@@ -151,10 +269,19 @@ bool application_is_hidden(struct application *application)
 }
 #pragma clang diagnostic pop
 
-struct window **application_window_list(struct application *application, int *window_count)
+CFArrayRef application_window_ref_list(struct application *application)
 {
+    CFAbsoluteTime start;
+    if (!application_ax_begin(application, application->ref, AX_ACCESS_READ, &start)) return NULL;
+
     CFTypeRef window_list_ref = NULL;
-    AXUIElementCopyAttributeValue(application->ref, kAXWindowsAttribute, &window_list_ref);
+    application_ax_end(application, AX_ACCESS_READ, start, AXUIElementCopyAttributeValue(application->ref, kAXWindowsAttribute, &window_list_ref));
+    return window_list_ref;
+}
+
+struct window **application_window_list(struct application *application, int *window_count)
+{
+    CFArrayRef window_list_ref = application_window_ref_list(application);
     if (!window_list_ref) return NULL;
 
     *window_count = CFArrayGetCount(window_list_ref);
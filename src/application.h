@@ -34,6 +34,52 @@ static CFStringRef ax_application_notification[] =
     [AX_APPLICATION_WINDOW_MENU_OPENED_INDEX]   = kAXMenuOpenedNotification
 };
 
+#define AX_LATENCY_SAMPLES       64
+#define AX_LATENCY_MIN_SAMPLES   16
+#define AX_READ_TIMEOUT_MIN      0.25f
+#define AX_WRITE_TIMEOUT_MIN     0.50f
+#define AX_TIMEOUT_MAX           2.00f
+#define AX_TIMEOUT_P99_FACTOR    4.00f
+#define AX_BREAKER_THRESHOLD     3
+#define AX_BREAKER_BACKOFF_MIN   2.00f
+#define AX_BREAKER_BACKOFF_MAX  60.00f
+
+enum ax_breaker_state
+{
+    AX_BREAKER_CLOSED,
+    AX_BREAKER_OPEN
+};
+
+static const char *ax_breaker_state_str[] =
+{
+    "closed",
+    "open"
+};
+
+enum ax_access
+{
+    AX_ACCESS_READ,
+    AX_ACCESS_WRITE,
+
+    AX_ACCESS_COUNT
+};
+
+struct ax_latency
+{
+    float sample[AX_LATENCY_SAMPLES];
+    int count;
+    int index;
+    float timeout;
+};
+
+struct ax_health
+{
+    struct ax_latency latency[AX_ACCESS_COUNT];
+    float backoff;
+    int failures;
+    enum ax_breaker_state state;
+};
+
 struct application
 {
     AXUIElementRef ref;
@@ -45,12 +91,17 @@ struct application
     bool is_observing;
     bool is_hidden;
     bool retry;
+    struct ax_health ax;
 };
 
+bool application_ax_begin(struct application *application, AXUIElementRef element, enum ax_access access, CFAbsoluteTime *start);
+void application_ax_end(struct application *application, enum ax_access access, CFAbsoluteTime start, AXError error);
+void application_ax_probe_result(struct application *application, bool responsive);
 bool application_is_frontmost(struct application *application);
 bool application_is_hidden(struct application *application);
 uint32_t application_main_window(struct application *application);
 uint32_t application_focused_window(struct application *application);
+CFArrayRef application_window_ref_list(struct application *application);
 struct window **application_window_list(struct application *application, int *window_count);
 bool application_observe(struct application *application);
 void application_unobserve(struct application *application);
@@ -110,6 +110,13 @@ static inline float border_radius_clamp(CGRect frame, float radius, int width)
 }
 
 void border_window_refresh(struct window *window)
+{
+    if (!window->border.id) return;
+    if (!window->border.enabled) return;
+    border_window_refresh_frame(window, window_ax_frame(window));
+}
+
+void border_window_refresh_frame(struct window *window, CGRect region)
 {
     if (!window->border.id) return;
     if (!window->border.enabled) return;
@@ -119,7 +126,6 @@ void border_window_refresh(struct window *window)
     CFTypeRef region_ref;
     CGRect border_frame;
 
-    CGRect region = window_ax_frame(window);
     region.origin.x -= border->width;
     region.origin.y -= border->width;
     region.size.width  += (2*border->width);
@@ -52,6 +52,7 @@ struct border
 struct window;
 
 void border_window_refresh(struct window *window);
+void border_window_refresh_frame(struct window *window, CGRect region);
 void border_window_activate(struct window *window);
 void border_window_deactivate(struct window *window);
 void border_window_show(struct window *window);
@@ -2,6 +2,7 @@
 
 extern struct event_loop g_event_loop;
 extern struct bar g_bar;
+extern struct space_manager g_space_manager;
 extern int g_connection;
 
 static DISPLAY_EVENT_HANDLER(display_handler)
@@ -114,93 +115,42 @@ CGRect display_bounds_constrained(uint32_t did)
 
 uint64_t display_space_id(uint32_t did)
 {
+    uint64_t sid = 0;
+    if (event_memo_find(&g_event_loop.memo, EVENT_MEMO_DISPLAY_SPACE, did, &sid)) return sid;
+
     CFStringRef uuid = display_uuid(did);
     if (!uuid) return 0;
 
-    uint64_t sid = SLSManagedDisplayGetCurrentSpace(g_connection, uuid);
+    sid = SLSManagedDisplayGetCurrentSpace(g_connection, uuid);
     CFRelease(uuid);
+
+    event_memo_store(&g_event_loop.memo, EVENT_MEMO_DISPLAY_SPACE, did, sid);
     return sid;
 }
 
 int display_space_count(uint32_t did)
 {
-    CFStringRef uuid = display_uuid(did);
-    if (!uuid) return 0;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    if (!display_spaces_ref) return 0;
-
-    int space_count = 0;
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFStringRef identifier = CFDictionaryGetValue(display_ref, CFSTR("Display Identifier"));
-        if (!CFEqual(uuid, identifier)) continue;
-
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        space_count = CFArrayGetCount(spaces_ref);
-        break;
-    }
-
-    CFRelease(display_spaces_ref);
-    CFRelease(uuid);
-    return space_count;
+    struct topology_display *display = topology_find_display(&g_space_manager.topology, did);
+    return display ? display->space_count : 0;
 }
 
 uint64_t *display_space_list(uint32_t did, int *count)
 {
-    CFStringRef uuid = display_uuid(did);
-    if (!uuid) return NULL;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    if (!display_spaces_ref) return NULL;
-
-    uint64_t *space_list = NULL;
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFStringRef identifier = CFDictionaryGetValue(display_ref, CFSTR("Display Identifier"));
-        if (!CFEqual(uuid, identifier)) continue;
+    struct topology_display *display = topology_find_display(&g_space_manager.topology, did);
+    if (!display || !display->space_count) return NULL;
 
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        int spaces_count = CFArrayGetCount(spaces_ref);
+    uint64_t *space_list = malloc(sizeof(uint64_t) * display->space_count);
+    *count = display->space_count;
 
-        space_list = malloc(sizeof(uint64_t) * spaces_count);
-        *count = spaces_count;
-
-        for (int j = 0; j < spaces_count; ++j) {
-            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
-            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &space_list[j]);
-        }
+    for (int i = 0; i < display->space_count; ++i) {
+        space_list[i] = g_space_manager.topology.spaces[display->first_space + i].sid;
     }
 
-    CFRelease(display_spaces_ref);
-    CFRelease(uuid);
-
     return space_list;
 }
 
 int display_arrangement(uint32_t did)
 {
-    CFStringRef uuid = display_uuid(did);
-    if (!uuid) return 0;
-
-    CFArrayRef displays = SLSCopyManagedDisplays(g_connection);
-    if (!displays) return 0;
-
-    int result = 0;
-    int displays_count = CFArrayGetCount(displays);
-
-    for (int i = 0; i < displays_count; ++i) {
-        if (CFEqual(CFArrayGetValueAtIndex(displays, i), uuid)) {
-            result = i + 1;
-            break;
-        }
-    }
-
-    CFRelease(displays);
-    CFRelease(uuid);
-    return result;
+    struct topology_display *display = topology_find_display(&g_space_manager.topology, did);
+    return display ? display->arrangement : 0;
 }
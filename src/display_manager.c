@@ -1,6 +1,7 @@
 #include "display_manager.h"
 
 extern struct window_manager g_window_manager;
+extern struct space_manager g_space_manager;
 extern int g_connection;
 
 bool display_manager_query_displays(FILE *rsp)
@@ -71,7 +71,8 @@ static void event_signal_populate_args(void *context, enum event_type type, stru
     case APPLICATION_ACTIVATED:
     case APPLICATION_DEACTIVATED:
     case APPLICATION_VISIBLE:
-    case APPLICATION_HIDDEN: {
+    case APPLICATION_HIDDEN:
+    case APPLICATION_AX_PROBED: {
         pid_t pid = (pid_t)(uintptr_t) context;
         snprintf(args->name[0], sizeof(args->name[0]), "%s", "YABAI_PROCESS_ID");
         snprintf(args->value[0], sizeof(args->value[0]), "%d", pid);
@@ -273,6 +274,8 @@ end:
 
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_TERMINATED)
 {
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     struct process *process = context;
     struct application *application = window_manager_find_application(&g_window_manager, process->pid);
 
@@ -392,7 +395,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_DEACTIVATED)
         border_window_deactivate(focused_window);
         window_manager_set_window_opacity(&g_window_manager, focused_window, g_window_manager.normal_window_opacity);
 
-        if (!window_level_is_standard(focused_window) || !window_is_standard(focused_window)) {
+        if (!focused_window->has_standard_level || !window_is_standard(focused_window)) {
             struct window *main_window = window_manager_find_window(&g_window_manager, application_main_window(application));
             if (main_window && main_window != focused_window) {
                 border_window_deactivate(main_window);
@@ -406,6 +409,9 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_DEACTIVATED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_VISIBLE)
 {
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     struct application *application = window_manager_find_application(&g_window_manager, (pid_t)(intptr_t) context);
     if (!application) return EVENT_FAILURE;
 
@@ -440,6 +446,9 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_VISIBLE)
 
 static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_HIDDEN)
 {
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     struct application *application = window_manager_find_application(&g_window_manager, (pid_t)(intptr_t) context);
     if (!application) return EVENT_FAILURE;
 
@@ -470,6 +479,8 @@ static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_HIDDEN)
 
 static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
 {
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t window_id = ax_window_id(context);
     if (!window_id) return EVENT_FAILURE;
 
@@ -503,9 +514,9 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
         if ((!application->is_hidden) && (!window->is_minimized) && (!window->is_fullscreen) && (!window->rule_manage)) {
             if (window->rule_fullscreen) {
                 window->rule_fullscreen = false;
-            } else if ((!window_level_is_standard(window)) ||
+            } else if ((!window->has_standard_level) ||
                        (!window_is_standard(window)) ||
-                       (!window_can_move(window)) ||
+                       (!window->can_move) ||
                        (window_is_sticky(window)) ||
                        (window_is_undersized(window))) {
                 window_manager_make_children_floating(&g_window_manager, window, true);
@@ -539,6 +550,8 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_CREATED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DESTROYED)
 {
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t window_id = (uint32_t)(uintptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
@@ -597,7 +610,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_FOCUSED)
     window_manager_set_window_opacity(&g_window_manager, window, g_window_manager.active_window_opacity);
     bar_refresh(&g_bar);
 
-    if (window_level_is_standard(window) && window_is_standard(window)) {
+    if (window->has_standard_level && window_is_standard(window)) {
         if (g_window_manager.focused_window_id != window->id) {
             if (g_mouse_state.ffm_window_id != window->id) {
                 window_manager_center_mouse(&g_window_manager, window);
@@ -620,6 +633,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MOVED)
     uint32_t window_id = (uint32_t)(intptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
+    window_invalidate_properties(window, WINDOW_PROPERTY_FRAME);
 
     if (!__sync_bool_compare_and_swap(window->id_ptr, &window->id, &window->id)) {
         debug("%s: %d has been marked invalid by the system, ignoring event..\n", __FUNCTION__, window_id);
@@ -628,7 +642,17 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MOVED)
 
     if (window->application->is_hidden) return EVENT_SUCCESS;
 
+    CGRect frame;
+    enum frame_event frame_event = window_manager_correlate_frame_event(&g_window_manager, window, (uint32_t) param1, &frame);
+    spatial_index_update_window(&g_window_manager.spatial_index, window->id, frame);
+    if (frame_event == FRAME_EVENT_EXPECTED || frame_event == FRAME_EVENT_SUPERSEDED) {
+        debug("%s: %s %d (frame #%d, %d suppressed)\n", __FUNCTION__, window->application->name, window->id, (uint32_t) param1, window->suppressed_frame_events);
+        border_window_refresh_frame(window, frame);
+        return EVENT_SUCCESS;
+    }
+
     debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
+    window_manager_invalidate_window_frame(&g_window_manager, window);
 
     border_window_refresh(window);
 
@@ -640,6 +664,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
     uint32_t window_id = (uint32_t)(intptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
+    window_invalidate_properties(window, WINDOW_PROPERTY_FRAME | WINDOW_PROPERTY_FULLSCREEN);
 
     if (!__sync_bool_compare_and_swap(window->id_ptr, &window->id, &window->id)) {
         debug("%s: %d has been marked invalid by the system, ignoring event..\n", __FUNCTION__, window_id);
@@ -648,7 +673,18 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
 
     if (window->application->is_hidden) return EVENT_SUCCESS;
 
+    CGRect frame;
+    enum frame_event frame_event = window_manager_correlate_frame_event(&g_window_manager, window, (uint32_t) param1, &frame);
+    spatial_index_update_window(&g_window_manager.spatial_index, window->id, frame);
+    if (frame_event == FRAME_EVENT_EXPECTED || frame_event == FRAME_EVENT_SUPERSEDED) {
+        if (frame_event == FRAME_EVENT_EXPECTED) window_manager_update_window_constraints(window, frame, false);
+        debug("%s: %s %d (frame #%d, %d suppressed)\n", __FUNCTION__, window->application->name, window->id, (uint32_t) param1, window->suppressed_frame_events);
+        border_window_refresh_frame(window, frame);
+        return EVENT_SUCCESS;
+    }
+
     debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
+    window_manager_invalidate_window_frame(&g_window_manager, window);
 
     if (g_mouse_state.current_action == MOUSE_MODE_MOVE && g_mouse_state.window == window) {
         g_mouse_state.window_frame.size = window_ax_frame(g_mouse_state.window).size;
@@ -683,6 +719,14 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
     window->is_fullscreen = is_fullscreen;
 
     if (!window->is_fullscreen) {
+        if (window_manager_update_window_constraints(window, frame, frame_event == FRAME_EVENT_REFUSED)) {
+            struct view *view = window_manager_find_managed_window(&g_window_manager, window);
+            if (view) {
+                view_update(view);
+                view_flush(view);
+            }
+        }
+
         border_window_refresh(window);
     }
 
@@ -691,9 +735,12 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_RESIZED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MINIMIZED)
 {
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t window_id = (uint32_t)(intptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
+    window_invalidate_properties(window, WINDOW_PROPERTY_FRAME | WINDOW_PROPERTY_FULLSCREEN);
 
     if (!__sync_bool_compare_and_swap(window->id_ptr, &window->id, &window->id)) {
         debug("%s: %d has been marked invalid by the system, ignoring event..\n", __FUNCTION__, window_id);
@@ -703,6 +750,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MINIMIZED)
     debug("%s: %s %d\n", __FUNCTION__, window->application->name, window->id);
     window->is_minimized = true;
     border_window_hide(window);
+    space_membership_remove_window(&g_space_manager.membership, window->id);
 
     if (window->id == g_window_manager.last_window_id) {
         g_window_manager.last_window_id = g_window_manager.focused_window_id;
@@ -720,9 +768,12 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_MINIMIZED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DEMINIMIZED)
 {
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t window_id = (uint32_t)(intptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
+    window_invalidate_properties(window, WINDOW_PROPERTY_FRAME | WINDOW_PROPERTY_FULLSCREEN);
 
     if (!__sync_bool_compare_and_swap(window->id_ptr, &window->id, &window->id)) {
         debug("%s: %d has been marked invalid by the system, ignoring event..\n", __FUNCTION__, window_id);
@@ -732,6 +783,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_DEMINIMIZED)
 
     window->is_minimized = false;
     border_window_show(window);
+    space_membership_add_window(&g_space_manager.membership, window_space(window), window->id);
 
     if (space_manager_is_window_on_active_space(window)) {
         debug("%s: window %s %d is deminimized on active space\n", __FUNCTION__, window->application->name, window->id);
@@ -760,6 +812,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_TITLE_CHANGED)
     uint32_t window_id = (uint32_t)(intptr_t) context;
     struct window *window = window_manager_find_window(&g_window_manager, window_id);
     if (!window) return EVENT_FAILURE;
+    window_invalidate_properties(window, WINDOW_PROPERTY_TITLE);
 
     if (!__sync_bool_compare_and_swap(window->id_ptr, &window->id, &window->id)) {
         debug("%s: %d has been marked invalid by the system, ignoring event..\n", __FUNCTION__, window_id);
@@ -774,8 +827,18 @@ static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_TITLE_CHANGED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_SPACE_CHANGED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
+    uint64_t sid = space_manager_active_space();
+    if (space_manager_coalesce_space_change(&g_space_manager, sid)) {
+        debug("%s: %lld (coalesced)\n", __FUNCTION__, sid);
+        return EVENT_FAILURE;
+    }
+
     g_space_manager.last_space_id = g_space_manager.current_space_id;
-    g_space_manager.current_space_id = space_manager_active_space();
+    g_space_manager.current_space_id = sid;
 
     debug("%s: %lld\n", __FUNCTION__, g_space_manager.current_space_id);
     struct view *view = space_manager_find_view(&g_space_manager, g_space_manager.current_space_id);
@@ -796,8 +859,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_SPACE_CHANGED)
         if (view_is_invalid(view)) view_update(view);
         if (view_is_dirty(view))   view_flush(view);
 
-        window_manager_validate_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
-        window_manager_check_for_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
+        window_manager_reconcile_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
     }
 
     return EVENT_SUCCESS;
@@ -805,6 +867,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_SPACE_CHANGED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_CHANGED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     g_display_manager.last_display_id = g_display_manager.current_display_id;
     g_display_manager.current_display_id = display_manager_active_display_id();
 
@@ -841,8 +907,7 @@ static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_CHANGED)
         if (view_is_invalid(view)) view_update(view);
         if (view_is_dirty(view))   view_flush(view);
 
-        window_manager_validate_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
-        window_manager_check_for_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
+        window_manager_reconcile_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
     }
 
     return EVENT_SUCCESS;
@@ -850,6 +915,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_CHANGED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_ADDED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t display_id = (uint32_t)(intptr_t) context;
     uint32_t sid = display_space_id(display_id);
     debug("%s: %d\n", __FUNCTION__, display_id);
@@ -860,6 +929,11 @@ static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_ADDED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_REMOVED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    space_membership_remove_stale_spaces(&g_space_manager.membership, &g_space_manager.topology);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t display_id = display_manager_main_display_id();
     uint32_t sid = display_space_id(display_id);
     debug("%s: %d\n", __FUNCTION__, display_id);
@@ -870,6 +944,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_REMOVED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_MOVED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t display_id = (uint32_t)(intptr_t) context;
     debug("%s: %d\n", __FUNCTION__, display_id);
     space_manager_mark_spaces_invalid(&g_space_manager);
@@ -879,6 +957,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_MOVED)
 
 static EVENT_CALLBACK(EVENT_HANDLER_DISPLAY_RESIZED)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     uint32_t display_id = (uint32_t)(intptr_t) context;
     debug("%s: %d\n", __FUNCTION__, display_id);
     space_manager_mark_spaces_invalid_for_display(&g_space_manager, display_id);
@@ -1172,9 +1254,21 @@ static EVENT_CALLBACK(EVENT_HANDLER_MOUSE_MOVED)
     if (g_window_manager.ffm_mode == FFM_DISABLED) return EVENT_SUCCESS;
 
     CGPoint point = CGEventGetLocation(context);
+
+    //
+    // The cursor is still above the focused window and no other window we know of. Whatever
+    // the window server would answer, it is either that window or one we do not track, and
+    // there is nothing to do in both cases.
+    //
+
+    uint32_t window_id;
+    if (spatial_index_query_point(&g_window_manager.spatial_index, point, 0, &window_id) == 1 && window_id == g_window_manager.focused_window_id) {
+        return EVENT_SUCCESS;
+    }
+
     struct window *window = window_manager_find_window_at_point(&g_window_manager, point);
     if (!window || window->id == g_window_manager.focused_window_id)      return EVENT_SUCCESS;
-    if (!window_level_is_standard(window) || !window_is_standard(window)) return EVENT_SUCCESS;
+    if (!window->has_standard_level || !window_is_standard(window)) return EVENT_SUCCESS;
 
     g_mouse_state.ffm_window_id = window->id;
 
@@ -1256,6 +1350,11 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_CHECK_FOR_EXIT)
 
 static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_EXIT)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+    space_membership_remove_stale_spaces(&g_space_manager.membership, &g_space_manager.topology);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+
     debug("%s:\n", __FUNCTION__);
     g_mission_control_active = false;
 
@@ -1276,15 +1375,18 @@ static EVENT_CALLBACK(EVENT_HANDLER_MISSION_CONTROL_EXIT)
     }
 
     space_manager_mark_spaces_invalid(&g_space_manager);
-    window_manager_validate_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
-    window_manager_check_for_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
+    window_manager_reconcile_windows_on_space(&g_space_manager, &g_window_manager, g_space_manager.current_space_id);
 
     return EVENT_SUCCESS;
 }
 
 static EVENT_CALLBACK(EVENT_HANDLER_DOCK_DID_RESTART)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+
     debug("%s:\n", __FUNCTION__);
+    scripting_addition_disconnect();
 
     if (scripting_addition_is_installed()) {
         scripting_addition_load();
@@ -1328,6 +1430,9 @@ static EVENT_CALLBACK(EVENT_HANDLER_DOCK_DID_CHANGE_PREF)
 
 static EVENT_CALLBACK(EVENT_HANDLER_SYSTEM_WOKE)
 {
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_mark_dirty(&g_space_manager.membership);
+
     debug("%s:\n", __FUNCTION__);
     struct window *focused_window = window_manager_find_window(&g_window_manager, g_window_manager.focused_window_id);
     if (focused_window) {
@@ -1339,12 +1444,53 @@ static EVENT_CALLBACK(EVENT_HANDLER_SYSTEM_WOKE)
     return EVENT_SUCCESS;
 }
 
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_AX_PROBED)
+{
+    struct application *application = window_manager_find_application(&g_window_manager, (pid_t)(intptr_t) context);
+    if (!application) return EVENT_FAILURE;
+
+    debug("%s: %s %d\n", __FUNCTION__, application->name, param1);
+    application_ax_probe_result(application, param1);
+    if (application->ax.state == AX_BREAKER_OPEN) return EVENT_SUCCESS;
+
+    //
+    // Frame updates were skipped while the application was not responding,
+    // so flush the views that contain its windows now that it is talking to us again.
+    //
+
+    int window_count = 0;
+    struct window **window_list = window_manager_find_application_windows(&g_window_manager, application, &window_count);
+    if (!window_list) return EVENT_SUCCESS;
+
+    for (int i = 0; i < window_count; ++i) {
+        if (!window_list[i]) continue;
+
+        struct view *view = window_manager_find_managed_window(&g_window_manager, window_list[i]);
+        if (view) view_flush(view);
+    }
+
+    free(window_list);
+    return EVENT_SUCCESS;
+}
+
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATIONS_DISCOVERED)
+{
+    window_manager_add_discovered_applications(&g_space_manager, &g_window_manager, context);
+    return EVENT_SUCCESS;
+}
+
 static EVENT_CALLBACK(EVENT_HANDLER_BAR_REFRESH)
 {
     bar_refresh(&g_bar);
     return EVENT_SUCCESS;
 }
 
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_OPACITY_TICK)
+{
+    window_manager_animate_window_opacity(&g_window_manager);
+    return EVENT_SUCCESS;
+}
+
 static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE)
 {
     debug("%s: msg '", __FUNCTION__);
@@ -37,7 +37,10 @@ static EVENT_CALLBACK(EVENT_HANDLER_MENU_OPENED);
 static EVENT_CALLBACK(EVENT_HANDLER_MENU_BAR_HIDDEN_CHANGED);
 static EVENT_CALLBACK(EVENT_HANDLER_DOCK_DID_CHANGE_PREF);
 static EVENT_CALLBACK(EVENT_HANDLER_SYSTEM_WOKE);
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATION_AX_PROBED);
+static EVENT_CALLBACK(EVENT_HANDLER_APPLICATIONS_DISCOVERED);
 static EVENT_CALLBACK(EVENT_HANDLER_BAR_REFRESH);
+static EVENT_CALLBACK(EVENT_HANDLER_WINDOW_OPACITY_TICK);
 static EVENT_CALLBACK(EVENT_HANDLER_DAEMON_MESSAGE);
 
 #define EVENT_IGNORED   -1
@@ -85,7 +88,10 @@ enum event_type
     MENU_BAR_HIDDEN_CHANGED,
     DOCK_DID_CHANGE_PREF,
     SYSTEM_WOKE,
+    APPLICATION_AX_PROBED,
+    APPLICATIONS_DISCOVERED,
     BAR_REFRESH,
+    WINDOW_OPACITY_TICK,
     DAEMON_MESSAGE,
 
     EVENT_TYPE_COUNT
@@ -128,7 +134,10 @@ static const char *event_type_str[] =
     [MENU_BAR_HIDDEN_CHANGED]        = "menu_bar_hidden_changed",
     [DOCK_DID_CHANGE_PREF]           = "dock_did_change_pref",
     [SYSTEM_WOKE]                    = "system_woke",
+    [APPLICATION_AX_PROBED]          = "application_ax_probed",
+    [APPLICATIONS_DISCOVERED]        = "applications_discovered",
     [BAR_REFRESH]                    = "bar_refresh",
+    [WINDOW_OPACITY_TICK]            = "window_opacity_tick",
     [DAEMON_MESSAGE]                 = "daemon_message",
 
     [EVENT_TYPE_COUNT]               = "event_type_count"
@@ -169,7 +178,10 @@ static event_callback *event_handler[] =
     [MENU_BAR_HIDDEN_CHANGED]        = EVENT_HANDLER_MENU_BAR_HIDDEN_CHANGED,
     [DOCK_DID_CHANGE_PREF]           = EVENT_HANDLER_DOCK_DID_CHANGE_PREF,
     [SYSTEM_WOKE]                    = EVENT_HANDLER_SYSTEM_WOKE,
+    [APPLICATION_AX_PROBED]          = EVENT_HANDLER_APPLICATION_AX_PROBED,
+    [APPLICATIONS_DISCOVERED]        = EVENT_HANDLER_APPLICATIONS_DISCOVERED,
     [BAR_REFRESH]                    = EVENT_HANDLER_BAR_REFRESH,
+    [WINDOW_OPACITY_TICK]            = EVENT_HANDLER_WINDOW_OPACITY_TICK,
     [DAEMON_MESSAGE]                 = EVENT_HANDLER_DAEMON_MESSAGE,
 };
 
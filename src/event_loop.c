@@ -57,7 +57,11 @@ event_loop_run(void *context)
     while (event_loop->is_running) {
         struct event *event = queue_pop(queue);
         if (event) {
+            event_memo_begin(&event_loop->memo, event->type);
+            scripting_addition_batch_begin();
             int result = event_handler[event->type](event->context, event->param1, event->param2);
+            scripting_addition_batch_end();
+            event_memo_end(&event_loop->memo);
             if (result == EVENT_SUCCESS) event_signal_transmit(event->context, event->type);
 
             if (event->result) *event->result = result;
@@ -97,6 +101,7 @@ bool event_loop_init(struct event_loop *event_loop)
 {
     queue_init(&event_loop->queue);
     event_loop->is_running = 0;
+    memset(&event_loop->memo, 0, sizeof(struct event_memo));
     event_loop->semaphore = sem_open("yabai_event_loop_semaphore", O_CREAT, 0600, 0);
     sem_unlink("yabai_event_loop_semaphore");
     return event_loop->semaphore != SEM_FAILED;
@@ -19,6 +19,7 @@ struct event_loop
     pthread_t thread;
     sem_t *semaphore;
     struct queue queue;
+    struct event_memo memo;
 };
 
 bool event_loop_init(struct event_loop *event_loop);
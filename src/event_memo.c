@@ -0,0 +1,92 @@
+#include "event_memo.h"
+
+//
+// Results are only reused by the event-loop thread while it is dispatching an
+// event. Queries made from any other thread (bar, signal handlers) always go to
+// the system, and anything we do that changes the answer must call
+// event_memo_clear.
+//
+
+static inline bool event_memo_is_usable(struct event_memo *memo)
+{
+    return memo->is_active && pthread_equal(memo->thread, pthread_self());
+}
+
+bool event_memo_find(struct event_memo *memo, enum event_memo_kind kind, uint64_t key, uint64_t *value)
+{
+    if (!event_memo_is_usable(memo)) return false;
+
+    ++memo->lookup_count[memo->event_type];
+
+    for (int i = 0; i < memo->count; ++i) {
+        struct event_memo_entry *entry = &memo->entries[i];
+        if (entry->kind == kind && entry->key == key) {
+            ++memo->hit_count[memo->event_type];
+            *value = entry->value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void event_memo_store(struct event_memo *memo, enum event_memo_kind kind, uint64_t key, uint64_t value)
+{
+    if (!event_memo_is_usable(memo)) return;
+    if (memo->count == EVENT_MEMO_CAPACITY) return;
+
+    memo->entries[memo->count++] = (struct event_memo_entry) { kind, key, value };
+}
+
+void event_memo_clear(struct event_memo *memo)
+{
+    if (!event_memo_is_usable(memo)) return;
+    memo->count = 0;
+}
+
+void event_memo_begin(struct event_memo *memo, int event_type)
+{
+    memo->count = 0;
+    memo->event_type = event_type;
+    memo->thread = pthread_self();
+    memo->is_active = true;
+}
+
+void event_memo_end(struct event_memo *memo)
+{
+    memo->is_active = false;
+    memo->count = 0;
+}
+
+//
+// The counters are only touched by the event-loop thread, which is also the
+// thread that handles queries, so they can be read here without a lock. event
+// types that never looked anything up are left out.
+//
+
+void event_memo_serialize(FILE *rsp, struct event_memo *memo)
+{
+    bool first = true;
+
+    fprintf(rsp, "[");
+    for (int i = 0; i < EVENT_TYPE_COUNT; ++i) {
+        uint64_t lookups = memo->lookup_count[i];
+        if (!lookups) continue;
+
+        uint64_t hits = memo->hit_count[i];
+        fprintf(rsp,
+                "%s{\n"
+                "\t\"event\":\"%s\",\n"
+                "\t\"lookups\":%lld,\n"
+                "\t\"hits\":%lld,\n"
+                "\t\"hit-ratio\":%.4f\n"
+                "}",
+                first ? "" : ",",
+                event_type_str[i],
+                lookups,
+                hits,
+                (double) hits / lookups);
+        first = false;
+    }
+    fprintf(rsp, "]\n");
+}
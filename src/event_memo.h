@@ -0,0 +1,38 @@
+#ifndef EVENT_MEMO_H
+#define EVENT_MEMO_H
+
+#define EVENT_MEMO_CAPACITY 64
+
+enum event_memo_kind
+{
+    EVENT_MEMO_DISPLAY_SPACE,
+    EVENT_MEMO_WINDOW_DISPLAY,
+    EVENT_MEMO_FOCUSED_WINDOW,
+};
+
+struct event_memo_entry
+{
+    enum event_memo_kind kind;
+    uint64_t key;
+    uint64_t value;
+};
+
+struct event_memo
+{
+    bool is_active;
+    pthread_t thread;
+    int event_type;
+    int count;
+    struct event_memo_entry entries[EVENT_MEMO_CAPACITY];
+    uint64_t lookup_count[EVENT_TYPE_COUNT];
+    uint64_t hit_count[EVENT_TYPE_COUNT];
+};
+
+bool event_memo_find(struct event_memo *memo, enum event_memo_kind kind, uint64_t key, uint64_t *value);
+void event_memo_store(struct event_memo *memo, enum event_memo_kind kind, uint64_t key, uint64_t value);
+void event_memo_clear(struct event_memo *memo);
+void event_memo_begin(struct event_memo *memo, int event_type);
+void event_memo_end(struct event_memo *memo);
+void event_memo_serialize(FILE *rsp, struct event_memo *memo);
+
+#endif
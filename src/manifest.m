@@ -38,6 +38,7 @@
 #include "osax/sa.m"
 
 #include "event.h"
+#include "event_memo.h"
 #include "event_loop.h"
 #include "event_tap.h"
 #include "process.h"
@@ -47,9 +48,12 @@
 #include "message.h"
 #include "display.h"
 #include "space.h"
+#include "topology.h"
+#include "space_membership.h"
 #include "view.h"
 #include "border.h"
 #include "window.h"
+#include "spatial_index.h"
 #include "application.h"
 #include "process_manager.h"
 #include "display_manager.h"
@@ -58,6 +62,7 @@
 #include "bar.h"
 
 #include "event.c"
+#include "event_memo.c"
 #include "event_loop.c"
 #include "event_tap.c"
 #include "process.c"
@@ -66,9 +71,12 @@
 #include "message.c"
 #include "display.c"
 #include "space.c"
+#include "topology.c"
+#include "space_membership.c"
 #include "view.c"
 #include "border.c"
 #include "window.c"
+#include "spatial_index.c"
 #include "application.c"
 #include "process_manager.c"
 #include "display_manager.c"
@@ -42,6 +42,7 @@ extern struct bar g_bar;
 #define COMMAND_CONFIG_WINDOW_GAP            "window_gap"
 #define COMMAND_CONFIG_SPLIT_RATIO           "split_ratio"
 #define COMMAND_CONFIG_AUTO_BALANCE          "auto_balance"
+#define COMMAND_CONFIG_PIXEL_SNAP            "pixel_snap"
 #define COMMAND_CONFIG_MOUSE_MOD             "mouse_modifier"
 #define COMMAND_CONFIG_MOUSE_ACTION1         "mouse_action1"
 #define COMMAND_CONFIG_MOUSE_ACTION2         "mouse_action2"
@@ -94,6 +95,7 @@ extern struct bar g_bar;
 #define COMMAND_SPACE_TOGGLE  "--toggle"
 #define COMMAND_SPACE_LAYOUT  "--layout"
 #define COMMAND_SPACE_LABEL   "--label"
+#define COMMAND_SPACE_BATCH   "--batch"
 
 #define ARGUMENT_SPACE_MIRROR_X     "x-axis"
 #define ARGUMENT_SPACE_MIRROR_Y     "y-axis"
@@ -149,10 +151,12 @@ extern struct bar g_bar;
 #define COMMAND_QUERY_DISPLAYS "--displays"
 #define COMMAND_QUERY_SPACES   "--spaces"
 #define COMMAND_QUERY_WINDOWS  "--windows"
+#define COMMAND_QUERY_MEMO     "--memo"
 
 #define ARGUMENT_QUERY_DISPLAY "--display"
 #define ARGUMENT_QUERY_SPACE   "--space"
 #define ARGUMENT_QUERY_WINDOW  "--window"
+#define ARGUMENT_QUERY_FRESH   "--fresh"
 /* ----------------------------------------------------------------------------- */
 
 /* --------------------------------DOMAIN RULE---------------------------------- */
@@ -683,6 +687,17 @@ static void handle_domain_config(FILE *rsp, struct token domain, char *message)
         } else {
             daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
         }
+    } else if (token_equals(command, COMMAND_CONFIG_PIXEL_SNAP)) {
+        struct token value = get_token(&message);
+        if (!token_is_valid(value)) {
+            fprintf(rsp, "%s\n", bool_str[g_space_manager.pixel_snap]);
+        } else if (token_equals(value, ARGUMENT_COMMON_VAL_OFF)) {
+            space_manager_set_pixel_snap_for_all_spaces(&g_space_manager, false);
+        } else if (token_equals(value, ARGUMENT_COMMON_VAL_ON)) {
+            space_manager_set_pixel_snap_for_all_spaces(&g_space_manager, true);
+        } else {
+            daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
+        }
     } else if (token_equals(command, COMMAND_CONFIG_MOUSE_MOD)) {
         struct token value = get_token(&message);
         if (!token_is_valid(value)) {
@@ -1236,6 +1251,135 @@ static void handle_domain_display(FILE *rsp, struct token domain, char *message)
     }
 }
 
+static bool handle_domain_space_batch_command(FILE *rsp, struct token domain, struct token command, char **message, uint64_t acting_sid, struct space_transaction *transaction)
+{
+    enum space_op_error result = SPACE_OP_ERROR_SUCCESS;
+
+    if (token_equals(command, COMMAND_SPACE_FOCUS)) {
+        struct selector selector = parse_space_selector(rsp, message, acting_sid);
+        if (!selector.did_parse || !selector.sid) return false;
+
+        result = space_manager_transaction_focus_space(transaction, selector.sid);
+    } else if (token_equals(command, COMMAND_SPACE_MOVE)) {
+        struct token value = get_token(message);
+        if (token_equals(value, ARGUMENT_COMMON_SEL_PREV)) {
+            uint64_t pre_sid = space_manager_transaction_prev_space(transaction, acting_sid);
+            if (!pre_sid) {
+                daemon_fail(rsp, "could not swap places with the previous space.\n");
+                return false;
+            }
+
+            result = space_manager_transaction_move_space_after_space(transaction, pre_sid, acting_sid, false);
+        } else if (token_equals(value, ARGUMENT_COMMON_SEL_NEXT)) {
+            uint64_t dst_sid = space_manager_transaction_next_space(transaction, acting_sid);
+            if (!dst_sid) {
+                daemon_fail(rsp, "could not swap places with the next space.\n");
+                return false;
+            }
+
+            result = space_manager_transaction_move_space_after_space(transaction, acting_sid, dst_sid, acting_sid == space_manager_active_space());
+        } else {
+            daemon_fail(rsp, "unknown value '%.*s' given to command '%.*s' for domain '%.*s'\n", value.length, value.text, command.length, command.text, domain.length, domain.text);
+            return false;
+        }
+
+        if (result == SPACE_OP_ERROR_INVALID_SRC) {
+            daemon_fail(rsp, "acting space is the last user-space on the source display and cannot be moved.\n");
+            return false;
+        }
+    } else if (token_equals(command, COMMAND_SPACE_DISPLAY)) {
+        struct selector selector = parse_display_selector(rsp, message, display_manager_active_display_id());
+        if (!selector.did_parse || !selector.did) return false;
+
+        result = space_manager_transaction_move_space_to_display(transaction, acting_sid, selector.did);
+        if (result == SPACE_OP_ERROR_MISSING_DST) {
+            daemon_fail(rsp, "could not locate the active space of the given display.\n");
+            return false;
+        } else if (result == SPACE_OP_ERROR_INVALID_SRC) {
+            daemon_fail(rsp, "acting space is the last user-space on the source display and cannot be moved.\n");
+            return false;
+        } else if (result == SPACE_OP_ERROR_INVALID_DST) {
+            daemon_fail(rsp, "acting space is already located on the given display.\n");
+            return false;
+        }
+    } else if (token_equals(command, COMMAND_SPACE_CREATE)) {
+        result = space_manager_transaction_add_space(transaction, acting_sid);
+    } else if (token_equals(command, COMMAND_SPACE_DESTROY)) {
+        result = space_manager_transaction_destroy_space(transaction, acting_sid);
+        if (result == SPACE_OP_ERROR_INVALID_SRC) {
+            daemon_fail(rsp, "acting space is the last user-space on the source display and cannot be destroyed.\n");
+            return false;
+        } else if (result == SPACE_OP_ERROR_INVALID_TYPE) {
+            daemon_fail(rsp, "cannot destroy a macOS fullscreen space.\n");
+            return false;
+        }
+    } else if (token_equals(command, COMMAND_SPACE_LABEL)) {
+        char *label = parse_label(rsp, message, LABEL_SPACE);
+        if (!label) return false;
+
+        result = space_manager_transaction_label_space(transaction, acting_sid, label);
+    } else {
+        daemon_fail(rsp, "unknown command '%.*s' given to '%s' for domain '%.*s'\n", command.length, command.text, COMMAND_SPACE_BATCH, domain.length, domain.text);
+        return false;
+    }
+
+    //
+    // Spaces are looked up in the topology as it will be once the commands
+    // before this one have been applied, so a space that one of them has
+    // destroyed can not be located anymore.
+    //
+
+    if (result == SPACE_OP_ERROR_MISSING_SRC) {
+        daemon_fail(rsp, "could not locate the space to act on.\n");
+        return false;
+    }
+
+    return result == SPACE_OP_ERROR_SUCCESS;
+}
+
+static void handle_domain_space_batch(FILE *rsp, struct token domain, char *message, uint64_t batch_sid)
+{
+    struct space_transaction transaction;
+    space_manager_transaction_begin(&transaction);
+
+    //
+    // Every command is parsed and validated before any of them is
+    // sent; if one of them fails, none of them are applied.
+    //
+
+    for (;;) {
+        struct token command;
+        uint64_t acting_sid;
+        struct selector selector = parse_space_selector(NULL, &message, batch_sid);
+
+        if (selector.did_parse) {
+            acting_sid = selector.sid;
+            command = get_token(&message);
+        } else {
+            acting_sid = batch_sid;
+            command = selector.token;
+        }
+
+        if (!token_is_valid(command)) break;
+
+        if (!acting_sid) {
+            daemon_fail(rsp, "could not locate the space to act on!\n");
+            goto out;
+        }
+
+        if (!handle_domain_space_batch_command(rsp, domain, command, &message, acting_sid, &transaction)) {
+            goto out;
+        }
+    }
+
+    if (!space_manager_commit_transaction(&g_space_manager, &transaction)) {
+        daemon_fail(rsp, "could not apply the given space operations.\n");
+    }
+
+out:
+    space_manager_transaction_end(&transaction);
+}
+
 static void handle_domain_space(FILE *rsp, struct token domain, char *message)
 {
     struct token command;
@@ -1379,6 +1523,8 @@ static void handle_domain_space(FILE *rsp, struct token domain, char *message)
         if (label) {
             space_manager_set_label_for_space(&g_space_manager, acting_sid, label);
         }
+    } else if (token_equals(command, COMMAND_SPACE_BATCH)) {
+        handle_domain_space_batch(rsp, domain, message, acting_sid);
     } else {
         daemon_fail(rsp, "unknown command '%.*s' for domain '%.*s'\n", command.length, command.text, domain.length, domain.text);
     }
@@ -1621,6 +1767,11 @@ static void handle_domain_query(FILE *rsp, struct token domain, char *message)
         }
     } else if (token_equals(command, COMMAND_QUERY_WINDOWS)) {
         struct token option = get_token(&message);
+        if (token_equals(option, ARGUMENT_QUERY_FRESH)) {
+            window_manager_invalidate_window_properties(&g_window_manager);
+            option = get_token(&message);
+        }
+
         if (token_equals(option, ARGUMENT_QUERY_DISPLAY)) {
             uint32_t acting_did = display_manager_active_display_id();
             struct selector selector = parse_display_selector(NULL, &message, acting_did);
@@ -1668,6 +1819,8 @@ static void handle_domain_query(FILE *rsp, struct token domain, char *message)
         } else {
             window_manager_query_windows_for_displays(rsp);
         }
+    } else if (token_equals(command, COMMAND_QUERY_MEMO)) {
+        event_memo_serialize(rsp, &g_event_loop.memo);
     } else {
         daemon_fail(rsp, "unknown command '%.*s' for domain '%.*s'\n", command.length, command.text, domain.length, domain.text);
     }
@@ -1863,9 +2016,6 @@ static SOCKET_DAEMON_HANDLER(message_handler)
     struct event *event;
     volatile int status = EVENT_QUEUED;
 
-    FILE *rsp = fdopen(sockfd, "w");
-    if (!rsp) goto fderr;
-
     event_create_p2(event, DAEMON_MESSAGE, message, length, rsp);
     event->status = &status;
     event_loop_post(&g_event_loop, event);
@@ -1875,11 +2025,4 @@ static SOCKET_DAEMON_HANDLER(message_handler)
         debug("yabai: event_loop is not running! ignoring event..\n");
         daemon_fail(rsp, "event_loop is not running! ignoring event..\n");
     }
-
-    fflush(rsp);
-    fclose(rsp);
-
-fderr:
-    socket_close(sockfd);
-    free(message);
 }
@@ -79,6 +79,120 @@ void socket_close(int sockfd)
     close(sockfd);
 }
 
+static bool socket_read_exact(int sockfd, void *bytes, size_t length)
+{
+    char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = recv(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+static bool socket_write_exact(int sockfd, const void *bytes, size_t length)
+{
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = send(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+bool socket_session_write(int sockfd, char *message, uint32_t length)
+{
+    return socket_write_exact(sockfd, &length, sizeof(length)) &&
+           socket_write_exact(sockfd, message, length);
+}
+
+char *socket_session_read(int sockfd, uint32_t *length, uint32_t max_length)
+{
+    if (!socket_read_exact(sockfd, length, sizeof(*length))) return NULL;
+    if (*length > max_length) return NULL;
+
+    //
+    // The message is followed by two NUL bytes, so that a request can be
+    // tokenized exactly like a message read by socket_read.
+    //
+
+    char *result = malloc((size_t) *length + 2);
+    if (!result) return NULL;
+
+    if (!socket_read_exact(sockfd, result, *length)) {
+        free(result);
+        return NULL;
+    }
+
+    result[*length+0] = '\0';
+    result[*length+1] = '\0';
+    return result;
+}
+
+struct socket_session
+{
+    struct daemon *daemon;
+    int sockfd;
+};
+
+static void *socket_session_handler(void *context)
+{
+    struct socket_session *session = context;
+    struct daemon *daemon = session->daemon;
+    int sockfd = session->sockfd;
+    free(session);
+
+    uint32_t length;
+    char *message;
+
+    while ((message = socket_session_read(sockfd, &length, SESSION_REQUEST_MAX))) {
+        char *rsp_bytes = NULL;
+        size_t rsp_length = 0;
+
+        FILE *rsp = open_memstream(&rsp_bytes, &rsp_length);
+        if (!rsp) {
+            free(message);
+            break;
+        }
+
+        daemon->handler(message, length, rsp);
+        fclose(rsp);
+        free(message);
+
+        bool did_write = socket_session_write(sockfd, rsp_bytes, rsp_length);
+        free(rsp_bytes);
+
+        if (!did_write) break;
+    }
+
+    socket_close(sockfd);
+    return NULL;
+}
+
+static void socket_session_begin(struct daemon *daemon, int sockfd)
+{
+    char marker;
+    if (recv(sockfd, &marker, 1, 0) != 1) {
+        socket_close(sockfd);
+        return;
+    }
+
+    struct socket_session *session = malloc(sizeof(struct socket_session));
+    session->daemon = daemon;
+    session->sockfd = sockfd;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &socket_session_handler, session) == 0) {
+        pthread_detach(thread);
+    } else {
+        socket_close(sockfd);
+        free(session);
+    }
+}
+
 static void *socket_connection_handler(void *context)
 {
     struct daemon *daemon = context;
@@ -87,13 +201,39 @@ static void *socket_connection_handler(void *context)
         int sockfd = accept(daemon->sockfd, NULL, 0);
         if (sockfd == -1) continue;
 
+        //
+        // A client that goes away before its reply has been written must not
+        // take the daemon down with it.
+        //
+
+        int set = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+
+        //
+        // Sessions are served from their own thread, as a client may keep one
+        // open indefinitely. a plain connection carries a single message and
+        // is still handled right here.
+        //
+
+        char marker;
+        if (recv(sockfd, &marker, 1, MSG_PEEK) == 1 && marker == SESSION_MESSAGE[0]) {
+            socket_session_begin(daemon, sockfd);
+            continue;
+        }
+
         int length;
         char *message = socket_read(sockfd, &length);
         if (message) {
-            daemon->handler(message, length, sockfd);
-        } else {
-            socket_close(sockfd);
+            FILE *rsp = fdopen(sockfd, "w");
+            if (rsp) {
+                daemon->handler(message, length, rsp);
+                fflush(rsp);
+                fclose(rsp);
+            }
+            free(message);
         }
+
+        socket_close(sockfd);
     }
 
     return NULL;
@@ -1,11 +1,24 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
-#define SOCKET_DAEMON_HANDLER(name) void name(char *message, int length, int sockfd)
+#define SOCKET_DAEMON_HANDLER(name) void name(char *message, int length, FILE *rsp)
 typedef SOCKET_DAEMON_HANDLER(socket_daemon_handler);
 
 #define FAILURE_MESSAGE "\x07"
 
+//
+// A connection that starts with SESSION_MESSAGE stays open and carries any
+// number of requests, each answered by a reply in the order they were sent.
+// both are framed as a native uint32_t length followed by that many bytes. a
+// request holds the same NUL-separated arguments as a plain connection; a
+// reply holds the same text a plain connection gets. the daemon drops a
+// session whose request is longer than SESSION_REQUEST_MAX; replies are not
+// limited, as a query can return any number of windows.
+//
+
+#define SESSION_MESSAGE "\x1e"
+#define SESSION_REQUEST_MAX 0x10000
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -32,6 +45,8 @@ bool socket_connect_in(int *sockfd, int port);
 bool socket_connect_un(int *sockfd, char *socket_path);
 void socket_wait(int sockfd);
 void socket_close(int sockfd);
+bool socket_session_write(int sockfd, char *message, uint32_t length);
+char *socket_session_read(int sockfd, uint32_t *length, uint32_t max_length);
 bool socket_daemon_begin_in(struct daemon *daemon, int port, socket_daemon_handler *handler);
 bool socket_daemon_begin_un(struct daemon *daemon, char *socket_path, socket_daemon_handler *handler);
 void socket_daemon_end(struct daemon *daemon);
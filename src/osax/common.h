@@ -1,7 +1,11 @@
 #ifndef SA_COMMON_H
 #define SA_COMMON_H
 
-#define OSAX_VERSION                "1.0.6"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define OSAX_VERSION                "1.2.0"
 
 #define OSAX_PAYLOAD_SUCCESS        0
 #define OSAX_PAYLOAD_NOT_FOUND      1
@@ -23,4 +27,421 @@
                                      OSAX_ATTRIB_MOV_SPACE | \
                                      OSAX_ATTRIB_SET_WINDOW)
 
+//
+// A connection that starts with OSAX_STREAM_MAGIC stays open and carries a
+// sequence of frames in both directions. every request is answered by
+// exactly one reply carrying the same id, in request order. an empty reply
+// acknowledges that the request has been handled. any other connection is
+// treated as a single legacy text message (handshake).
+//
+
+#define OSAX_STREAM_MAGIC           "YBSA"
+#define OSAX_STREAM_MAGIC_LENGTH    4
+#define OSAX_FRAME_MAX              0x1000
+#define OSAX_FRAME_HEADER_SIZE      8
+
+//
+// The frame header is two little-endian uint32 values, the length of the payload that
+// follows and the id of the request. It is always encoded and decoded through the
+// helpers below, never copied to or from the wire as a struct.
+//
+
+struct osax_frame_header
+{
+    uint32_t length;
+    uint32_t id;
+};
+
+//
+// Every frame payload is a binary message; one byte with the protocol
+// version, one byte opcode, followed by the packed little-endian fields of
+// that opcode. a batch message carries the opcode and count of its records,
+// followed by the fields of each record back to back. a transaction carries
+// the count of its records, each being an opcode and its fields; the payload
+// rejects the whole transaction if any record is malformed, and otherwise
+// applies the records in order without interleaving other frames.
+//
+// the handshake request carries the capabilities of yabai, and the reply
+// carries the protocol version, the capabilities supported by both sides,
+// the attrib bits and the version string of the payload.
+//
+
+#define OSAX_PROTOCOL_VERSION       2
+
+#define OSAX_CAPABILITY_BATCH       0x01
+#define OSAX_CAPABILITY_ALPHA_LIST  0x02
+#define OSAX_CAPABILITY_TRANSACTION 0x04
+
+#define OSAX_CAPABILITY_ALL         (OSAX_CAPABILITY_BATCH | \
+                                     OSAX_CAPABILITY_ALPHA_LIST | \
+                                     OSAX_CAPABILITY_TRANSACTION)
+
+enum osax_opcode
+{
+    OSAX_OP_HANDSHAKE                   = 0x01,
+    OSAX_OP_SPACE_FOCUS                 = 0x02,
+    OSAX_OP_SPACE_CREATE                = 0x03,
+    OSAX_OP_SPACE_DESTROY               = 0x04,
+    OSAX_OP_SPACE_MOVE                  = 0x05,
+    OSAX_OP_WINDOW_MOVE                 = 0x06,
+    OSAX_OP_WINDOW_ALPHA                = 0x07,
+    OSAX_OP_WINDOW_ALPHA_FADE           = 0x08,
+    OSAX_OP_WINDOW_LEVEL                = 0x09,
+    OSAX_OP_WINDOW_STICKY               = 0x0A,
+    OSAX_OP_WINDOW_FOCUS                = 0x0B,
+    OSAX_OP_WINDOW_SHADOW               = 0x0C,
+    OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE  = 0x0D,
+    OSAX_OP_BATCH                       = 0x0E,
+    OSAX_OP_TRANSACTION                 = 0x0F,
+};
+
+#define OSAX_TRANSACTION_OP_MAX     (OSAX_FRAME_MAX / 9)
+
+struct osax_op
+{
+    uint8_t opcode;
+    union {
+        struct { uint32_t capabilities; } handshake;
+        struct { uint64_t sid; } space;
+        struct { uint64_t src_sid; uint64_t dst_sid; uint8_t focus; } space_move;
+        struct { uint32_t wid; int32_t x; int32_t y; } window_move;
+        struct { uint32_t wid; float alpha; float duration; } window_alpha;
+        struct { uint32_t wid; int32_t value; } window;
+    };
+};
+
+struct osax_writer
+{
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t length;
+    bool overflow;
+};
+
+struct osax_reader
+{
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t cursor;
+    bool error;
+};
+
+static inline void osax_store_u32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) bytes[i] = (value >> (i * 8)) & 0xFF;
+}
+
+static inline uint32_t osax_load_u32(const uint8_t *bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= (uint32_t) bytes[i] << (i * 8);
+    return value;
+}
+
+static inline void osax_encode_frame_header(uint8_t *bytes, uint32_t length, uint32_t id)
+{
+    osax_store_u32(bytes + 0, length);
+    osax_store_u32(bytes + 4, id);
+}
+
+static inline struct osax_frame_header osax_decode_frame_header(const uint8_t *bytes)
+{
+    return (struct osax_frame_header) { osax_load_u32(bytes + 0), osax_load_u32(bytes + 4) };
+}
+
+static inline void osax_writer_init(struct osax_writer *writer, void *data, uint32_t capacity)
+{
+    writer->data = data;
+    writer->capacity = capacity;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+static inline void osax_reader_init(struct osax_reader *reader, const void *data, uint32_t length)
+{
+    reader->data = data;
+    reader->length = length;
+    reader->cursor = 0;
+    reader->error = false;
+}
+
+static inline bool osax_reader_done(struct osax_reader *reader)
+{
+    return reader->error || reader->cursor >= reader->length;
+}
+
+static inline void osax_write_bytes(struct osax_writer *writer, const void *bytes, uint32_t length)
+{
+    if (writer->overflow || writer->capacity - writer->length < length) {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static inline void osax_write_u8(struct osax_writer *writer, uint8_t value)
+{
+    osax_write_bytes(writer, &value, 1);
+}
+
+static inline void osax_write_u16(struct osax_writer *writer, uint16_t value)
+{
+    uint8_t bytes[2] = { value & 0xFF, (value >> 8) & 0xFF };
+    osax_write_bytes(writer, bytes, sizeof(bytes));
+}
+
+static inline void osax_write_u32(struct osax_writer *writer, uint32_t value)
+{
+    uint8_t bytes[4];
+    osax_store_u32(bytes, value);
+    osax_write_bytes(writer, bytes, sizeof(bytes));
+}
+
+static inline void osax_write_u64(struct osax_writer *writer, uint64_t value)
+{
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = (value >> (i * 8)) & 0xFF;
+    osax_write_bytes(writer, bytes, sizeof(bytes));
+}
+
+static inline void osax_write_f32(struct osax_writer *writer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    osax_write_u32(writer, bits);
+}
+
+static inline bool osax_read_bytes(struct osax_reader *reader, void *bytes, uint32_t length)
+{
+    if (reader->error || reader->length - reader->cursor < length) {
+        reader->error = true;
+        memset(bytes, 0, length);
+        return false;
+    }
+
+    memcpy(bytes, reader->data + reader->cursor, length);
+    reader->cursor += length;
+    return true;
+}
+
+static inline uint8_t osax_read_u8(struct osax_reader *reader)
+{
+    uint8_t value;
+    osax_read_bytes(reader, &value, 1);
+    return value;
+}
+
+static inline uint16_t osax_read_u16(struct osax_reader *reader)
+{
+    uint8_t bytes[2];
+    osax_read_bytes(reader, bytes, sizeof(bytes));
+    return (uint16_t) bytes[0] | ((uint16_t) bytes[1] << 8);
+}
+
+static inline uint32_t osax_read_u32(struct osax_reader *reader)
+{
+    uint8_t bytes[4];
+    osax_read_bytes(reader, bytes, sizeof(bytes));
+    return osax_load_u32(bytes);
+}
+
+static inline uint64_t osax_read_u64(struct osax_reader *reader)
+{
+    uint8_t bytes[8];
+    uint64_t value = 0;
+    osax_read_bytes(reader, bytes, sizeof(bytes));
+    for (int i = 0; i < 8; ++i) value |= (uint64_t) bytes[i] << (i * 8);
+    return value;
+}
+
+static inline float osax_read_f32(struct osax_reader *reader)
+{
+    float value;
+    uint32_t bits = osax_read_u32(reader);
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint32_t osax_op_fields_size(uint8_t opcode)
+{
+    switch (opcode) {
+    case OSAX_OP_HANDSHAKE:                  return 4;
+    case OSAX_OP_SPACE_FOCUS:                return 8;
+    case OSAX_OP_SPACE_CREATE:               return 8;
+    case OSAX_OP_SPACE_DESTROY:              return 8;
+    case OSAX_OP_SPACE_MOVE:                 return 8 + 8 + 1;
+    case OSAX_OP_WINDOW_MOVE:                return 4 + 4 + 4;
+    case OSAX_OP_WINDOW_ALPHA:               return 4 + 4;
+    case OSAX_OP_WINDOW_ALPHA_FADE:          return 4 + 4 + 4;
+    case OSAX_OP_WINDOW_LEVEL:               return 4 + 4;
+    case OSAX_OP_WINDOW_STICKY:              return 4 + 1;
+    case OSAX_OP_WINDOW_FOCUS:               return 4;
+    case OSAX_OP_WINDOW_SHADOW:              return 4 + 1;
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: return 4;
+    }
+
+    return 0;
+}
+
+static inline bool osax_op_is_batchable(uint8_t opcode)
+{
+    return opcode >= OSAX_OP_WINDOW_MOVE &&
+           opcode <= OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE &&
+           opcode != OSAX_OP_WINDOW_FOCUS;
+}
+
+static inline bool osax_op_is_transactable(uint8_t opcode)
+{
+    return opcode >= OSAX_OP_SPACE_FOCUS &&
+           opcode <= OSAX_OP_SPACE_MOVE;
+}
+
+static inline void osax_encode_op_fields(struct osax_writer *writer, struct osax_op *op)
+{
+    switch (op->opcode) {
+    case OSAX_OP_HANDSHAKE: {
+        osax_write_u32(writer, op->handshake.capabilities);
+    } break;
+    case OSAX_OP_SPACE_FOCUS:
+    case OSAX_OP_SPACE_CREATE:
+    case OSAX_OP_SPACE_DESTROY: {
+        osax_write_u64(writer, op->space.sid);
+    } break;
+    case OSAX_OP_SPACE_MOVE: {
+        osax_write_u64(writer, op->space_move.src_sid);
+        osax_write_u64(writer, op->space_move.dst_sid);
+        osax_write_u8(writer, op->space_move.focus);
+    } break;
+    case OSAX_OP_WINDOW_MOVE: {
+        osax_write_u32(writer, op->window_move.wid);
+        osax_write_u32(writer, op->window_move.x);
+        osax_write_u32(writer, op->window_move.y);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA: {
+        osax_write_u32(writer, op->window_alpha.wid);
+        osax_write_f32(writer, op->window_alpha.alpha);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA_FADE: {
+        osax_write_u32(writer, op->window_alpha.wid);
+        osax_write_f32(writer, op->window_alpha.alpha);
+        osax_write_f32(writer, op->window_alpha.duration);
+    } break;
+    case OSAX_OP_WINDOW_LEVEL: {
+        osax_write_u32(writer, op->window.wid);
+        osax_write_u32(writer, op->window.value);
+    } break;
+    case OSAX_OP_WINDOW_STICKY:
+    case OSAX_OP_WINDOW_SHADOW: {
+        osax_write_u32(writer, op->window.wid);
+        osax_write_u8(writer, op->window.value);
+    } break;
+    case OSAX_OP_WINDOW_FOCUS:
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: {
+        osax_write_u32(writer, op->window.wid);
+    } break;
+    }
+}
+
+static inline bool osax_decode_op_fields(struct osax_reader *reader, uint8_t opcode, struct osax_op *op)
+{
+    memset(op, 0, sizeof(*op));
+    op->opcode = opcode;
+
+    switch (opcode) {
+    case OSAX_OP_HANDSHAKE: {
+        op->handshake.capabilities = osax_read_u32(reader);
+    } break;
+    case OSAX_OP_SPACE_FOCUS:
+    case OSAX_OP_SPACE_CREATE:
+    case OSAX_OP_SPACE_DESTROY: {
+        op->space.sid = osax_read_u64(reader);
+    } break;
+    case OSAX_OP_SPACE_MOVE: {
+        op->space_move.src_sid = osax_read_u64(reader);
+        op->space_move.dst_sid = osax_read_u64(reader);
+        op->space_move.focus = osax_read_u8(reader);
+    } break;
+    case OSAX_OP_WINDOW_MOVE: {
+        op->window_move.wid = osax_read_u32(reader);
+        op->window_move.x = osax_read_u32(reader);
+        op->window_move.y = osax_read_u32(reader);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA: {
+        op->window_alpha.wid = osax_read_u32(reader);
+        op->window_alpha.alpha = osax_read_f32(reader);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA_FADE: {
+        op->window_alpha.wid = osax_read_u32(reader);
+        op->window_alpha.alpha = osax_read_f32(reader);
+        op->window_alpha.duration = osax_read_f32(reader);
+    } break;
+    case OSAX_OP_WINDOW_LEVEL: {
+        op->window.wid = osax_read_u32(reader);
+        op->window.value = osax_read_u32(reader);
+    } break;
+    case OSAX_OP_WINDOW_STICKY:
+    case OSAX_OP_WINDOW_SHADOW: {
+        op->window.wid = osax_read_u32(reader);
+        op->window.value = osax_read_u8(reader);
+    } break;
+    case OSAX_OP_WINDOW_FOCUS:
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: {
+        op->window.wid = osax_read_u32(reader);
+    } break;
+    default: {
+        reader->error = true;
+    } break;
+    }
+
+    return !reader->error;
+}
+
+//
+// Decodes every record of a transaction, after the opcode byte, into ops. Returns the
+// number of records, or -1 if any of them is malformed or is not a space operation.
+//
+
+static inline int osax_decode_transaction(struct osax_reader *reader, struct osax_op *ops, int capacity)
+{
+    int count = osax_read_u16(reader);
+    if (reader->error || count > capacity) return -1;
+
+    for (int i = 0; i < count; ++i) {
+        uint8_t opcode = osax_read_u8(reader);
+        if (reader->error || !osax_op_is_transactable(opcode)) return -1;
+        if (!osax_decode_op_fields(reader, opcode, &ops[i])) return -1;
+    }
+
+    return count;
+}
+
+static inline void osax_encode_op(struct osax_writer *writer, struct osax_op *op)
+{
+    osax_write_u8(writer, OSAX_PROTOCOL_VERSION);
+    osax_write_u8(writer, op->opcode);
+    osax_encode_op_fields(writer, op);
+}
+
+static inline void osax_encode_batch_header(struct osax_writer *writer, uint8_t opcode, uint16_t count)
+{
+    osax_write_u8(writer, OSAX_PROTOCOL_VERSION);
+    osax_write_u8(writer, OSAX_OP_BATCH);
+    osax_write_u8(writer, opcode);
+    osax_write_u16(writer, count);
+}
+
+static inline void osax_encode_transaction(struct osax_writer *writer, struct osax_op *ops, uint16_t count)
+{
+    osax_write_u8(writer, OSAX_PROTOCOL_VERSION);
+    osax_write_u8(writer, OSAX_OP_TRANSACTION);
+    osax_write_u16(writer, count);
+
+    for (int i = 0; i < count; ++i) {
+        osax_write_u8(writer, ops[i].opcode);
+        osax_encode_op_fields(writer, &ops[i]);
+    }
+}
+
 #endif
@@ -0,0 +1,115 @@
+#ifndef SA_HEX_PATTERN_H
+#define SA_HEX_PATTERN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//
+// Patterns are written as space separated hex bytes, where ?? matches any
+// byte. instead of comparing the pattern at every position, we let memchr
+// look for its least common literal byte (the anchor) and only compare the
+// full pattern where that byte occurs. candidates are visited in increasing
+// address order, so hex_pattern_find returns the first match in the range,
+// the same one the byte-by-byte scan it replaced would return.
+//
+
+#define HEX_PATTERN_MAX 512
+#define HEX_FIND_SEQ_RANGE 0x286a0
+
+struct hex_pattern
+{
+    int length;
+    int anchor;
+    uint8_t bytes[HEX_PATTERN_MAX];
+    bool is_wildcard[HEX_PATTERN_MAX];
+};
+
+static inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline int hex_byte_rank(uint8_t byte)
+{
+    switch (byte) {
+    case 0x00: case 0xFF: return 3;
+    case 0x0F: case 0x24: case 0x41: case 0x45: case 0x48:
+    case 0x49: case 0x4C: case 0x4D: case 0x53: case 0x54:
+    case 0x55: case 0x56: case 0x57: case 0x5D: case 0x83:
+    case 0x85: case 0x89: case 0x8B: case 0x8D: case 0xC3:
+    case 0xC7: case 0xE5: case 0xE8: case 0xEC: return 2;
+    }
+    return 1;
+}
+
+static bool hex_pattern_compile(const char *c_pattern, struct hex_pattern *pattern)
+{
+    pattern->length = 0;
+    pattern->anchor = -1;
+
+    for (const char *cursor = c_pattern; *cursor;) {
+        if (*cursor == ' ') {
+            ++cursor;
+            continue;
+        }
+
+        if (pattern->length == HEX_PATTERN_MAX || !cursor[1]) return false;
+
+        int index = pattern->length++;
+        if (cursor[0] == '?' && cursor[1] == '?') {
+            pattern->bytes[index] = 0;
+            pattern->is_wildcard[index] = true;
+        } else {
+            int hi = hex_digit(cursor[0]);
+            int lo = hex_digit(cursor[1]);
+            if (hi == -1 || lo == -1) return false;
+
+            pattern->bytes[index] = (hi << 4) | lo;
+            pattern->is_wildcard[index] = false;
+
+            if (pattern->anchor == -1 || hex_byte_rank(pattern->bytes[index]) < hex_byte_rank(pattern->bytes[pattern->anchor])) {
+                pattern->anchor = index;
+            }
+        }
+
+        cursor += 2;
+    }
+
+    return pattern->length > 0;
+}
+
+static inline bool hex_pattern_matches(const struct hex_pattern *pattern, const uint8_t *addr)
+{
+    for (int i = 0; i < pattern->length; ++i) {
+        if (!pattern->is_wildcard[i] && addr[i] != pattern->bytes[i]) return false;
+    }
+    return true;
+}
+
+static uint64_t hex_pattern_find(const struct hex_pattern *pattern, uint64_t baddr)
+{
+    if (pattern->anchor == -1) return baddr;
+
+    const uint8_t *start = (const uint8_t *) baddr;
+    const uint8_t *cursor = start + pattern->anchor;
+    const uint8_t *end = cursor + HEX_FIND_SEQ_RANGE;
+    uint8_t anchor = pattern->bytes[pattern->anchor];
+
+    while (cursor < end) {
+        const uint8_t *hit = memchr(cursor, anchor, end - cursor);
+        if (!hit) break;
+
+        const uint8_t *candidate = hit - pattern->anchor;
+        if (hex_pattern_matches(pattern, candidate)) return (uint64_t) candidate;
+
+        cursor = hit + 1;
+    }
+
+    return 0;
+}
+
+#endif
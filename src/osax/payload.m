@@ -12,20 +12,25 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
+#include <sys/event.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <dlfcn.h>
 
 #include <pthread.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 #include "common.h"
+#include "hex_pattern.h"
 
 #define SOCKET_PATH_FMT "/tmp/yabai-sa_%s.socket"
 
 #define BUF_SIZE 256
+#define BATCH_WID_MAX (OSAX_FRAME_MAX / 8)
 #define kCGSOnAllWorkspacesTagBit (1 << 11)
 #define kCGSNoShadowTagBit (1 << 3)
 
@@ -61,6 +66,8 @@ static Class managed_space;
 static socklen_t sin_size = sizeof(struct sockaddr);
 static pthread_t daemon_thread;
 static int daemon_sockfd;
+static int daemon_kq;
+static dispatch_queue_t message_queue;
 
 static void dump_class_info(Class c)
 {
@@ -126,44 +133,122 @@ static uint64_t image_slide(void)
     return 0;
 }
 
-static uint64_t hex_find_seq(uint64_t baddr, const char *c_pattern)
+static const struct mach_header_64 *executable_header(void)
 {
-    if (!baddr || !c_pattern) return 0;
+    char path[1024];
+    uint32_t size = sizeof(path);
 
-    uint64_t addr = baddr;
-    uint64_t pattern_length = (strlen(c_pattern) + 1) / 3;
-    char buffer_a[pattern_length];
-    char buffer_b[pattern_length];
-    memset(buffer_a, 0, sizeof(buffer_a));
-    memset(buffer_b, 0, sizeof(buffer_b));
+    if (_NSGetExecutablePath(path, &size) != 0) {
+        return NULL;
+    }
 
-    char *pattern = (char *) c_pattern + 1;
-    for (int i = 0; i < pattern_length; ++i) {
-        char c = pattern[-1];
-        if (c == '?') {
-            buffer_b[i] = 1;
-        } else {
-            int temp = c <= '9' ? 0 : 9;
-            temp = (temp + c) << 0x4;
-            c = pattern[0];
-            int temp2 = c <= '9' ? 0xd0 : 0xc9;
-            buffer_a[i] = temp2 + c + temp;
+    for (uint32_t i = 0; i < _dyld_image_count(); i++) {
+        if (strcmp(_dyld_get_image_name(i), path) == 0) {
+            return (const struct mach_header_64 *) _dyld_get_image_header(i);
         }
-        pattern += 3;
     }
 
-loop:
-    for (int counter = 0; counter < pattern_length; ++counter) {
-        if ((buffer_b[counter] == 0) && (((char *)addr)[counter] != buffer_a[counter])) {
-            addr = (uint64_t)((char *)addr + 1);
-            if (addr - baddr < 0x286a0) {
-                goto loop;
-            } else {
-                return 0;
-            }
+    return NULL;
+}
+
+static bool executable_uuid(uint8_t uuid[16])
+{
+    const struct mach_header_64 *header = executable_header();
+    if (!header || header->magic != MH_MAGIC_64) return false;
+
+    const uint8_t *cursor = (const uint8_t *)(header + 1);
+    for (uint32_t i = 0; i < header->ncmds; ++i) {
+        const struct load_command *command = (const struct load_command *) cursor;
+        if (command->cmd == LC_UUID) {
+            memcpy(uuid, ((const struct uuid_command *) command)->uuid, 16);
+            return true;
         }
+        cursor += command->cmdsize;
+    }
+
+    return false;
+}
+
+//
+// The locations found by hex_pattern_find are cached on disk, keyed by the
+// uuid of the Dock executable, so that the scan is skipped when the Dock is
+// restarted. a cached location is only a hint; it must lie within the range
+// that would have been scanned, and the pattern must still match there, before
+// it is used. only the first match is ever stored, and the bytes of an
+// executable with the same uuid are the same, so a cached location that passes
+// these checks is the first match a fresh scan would return.
+//
+
+#define OFFSET_CACHE_PATH_FMT "/tmp/yabai-sa_%s.offsets"
+#define OFFSET_CACHE_MAGIC 0x43424f59
+
+enum dock_offset
+{
+    DOCK_OFFSET_SPACES,
+    DOCK_OFFSET_DPPM,
+    DOCK_OFFSET_ADD_SPACE,
+    DOCK_OFFSET_REMOVE_SPACE,
+    DOCK_OFFSET_MOVE_SPACE,
+    DOCK_OFFSET_SET_FRONT_WINDOW,
+    DOCK_OFFSET_COUNT
+};
+
+struct offset_cache
+{
+    uint32_t magic;
+    uint8_t uuid[16];
+    uint64_t offset[DOCK_OFFSET_COUNT];
+};
+
+static bool offset_cache_load(const char *path, struct offset_cache *cache)
+{
+    struct offset_cache disk_cache;
+    struct stat buffer;
+    bool result = false;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd == -1) return false;
+
+    if (fstat(fd, &buffer) != 0)                                         goto end;
+    if (buffer.st_uid != getuid())                                       goto end;
+    if (read(fd, &disk_cache, sizeof(disk_cache)) != sizeof(disk_cache)) goto out;
+    if (disk_cache.magic != OFFSET_CACHE_MAGIC)                          goto end;
+    if (memcmp(disk_cache.uuid, cache->uuid, sizeof(cache->uuid)) != 0) goto out;
+
+    memcpy(cache->offset, disk_cache.offset, sizeof(cache->offset));
+    result = true;
+
+end:
+    close(fd);
+    return result;
+}
+
+static void offset_cache_save(const char *path, struct offset_cache *cache)
+{
+    unlink(path);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd == -1) return;
+
+    cache->magic = OFFSET_CACHE_MAGIC;
+    write(fd, cache, sizeof(*cache));
+    close(fd);
+}
+
+static uint64_t find_dock_address(struct offset_cache *cache, enum dock_offset type, uint64_t baseaddr, uint64_t offset, const char *c_pattern)
+{
+    if (!baseaddr || !c_pattern) return 0;
+
+    struct hex_pattern pattern;
+    if (!hex_pattern_compile(c_pattern, &pattern)) return 0;
+
+    uint64_t cached = cache->offset[type];
+    if (cached >= offset && cached < offset + HEX_FIND_SEQ_RANGE && hex_pattern_matches(&pattern, (const uint8_t *)(baseaddr + cached))) {
+        return baseaddr + cached;
     }
 
+    uint64_t addr = hex_pattern_find(&pattern, baseaddr + offset);
+    cache->offset[type] = addr ? addr - baseaddr : 0;
     return addr;
 }
 
@@ -332,7 +417,7 @@ const char *get_set_front_window_pattern(NSOperatingSystemVersion os_version) {
     return NULL;
 }
 
-static void init_instances()
+static void init_instances(const char *cache_file)
 {
     // TODO(koekeishiya): Do proper version checks with minor and patch version..
     NSOperatingSystemVersion os_version = [[NSProcessInfo processInfo] operatingSystemVersion];
@@ -341,8 +426,14 @@ static void init_instances()
         return;
     }
 
+    struct offset_cache cache = {};
+    bool has_uuid = executable_uuid(cache.uuid);
+    if (has_uuid && cache_file && offset_cache_load(cache_file, &cache)) {
+        NSLog(@"[yabai-sa] loaded cached offsets from %s", cache_file);
+    }
+
     uint64_t baseaddr = static_base_address() + image_slide();
-    uint64_t dock_spaces_addr = hex_find_seq(baseaddr + get_dock_spaces_offset(os_version), get_dock_spaces_pattern(os_version));
+    uint64_t dock_spaces_addr = find_dock_address(&cache, DOCK_OFFSET_SPACES, baseaddr, get_dock_spaces_offset(os_version), get_dock_spaces_pattern(os_version));
     if (dock_spaces_addr == 0) {
         NSLog(@"[yabai-sa] could not locate pointer to dock.spaces! spaces functionality will not work!");
         return;
@@ -352,7 +443,7 @@ static void init_instances()
     NSLog(@"[yabai-sa] (0x%llx) dock.spaces found at address 0x%llX (0x%llx)", baseaddr, dock_spaces_addr, dock_spaces_addr - baseaddr);
     dock_spaces = [(*(id *)(dock_spaces_addr + dock_spaces_offset + 0x4)) retain];
 
-    uint64_t dppm_addr = hex_find_seq(baseaddr + get_dppm_offset(os_version), get_dppm_pattern(os_version));
+    uint64_t dppm_addr = find_dock_address(&cache, DOCK_OFFSET_DPPM, baseaddr, get_dppm_offset(os_version), get_dppm_pattern(os_version));
     if (dppm_addr == 0) {
         dp_desktop_picture_manager = nil;
         NSLog(@"[yabai-sa] could not locate pointer to dppm! moving spaces will not work!");
@@ -362,7 +453,7 @@ static void init_instances()
         dp_desktop_picture_manager = [(*(id *)(dppm_addr + dppm_offset + 0x4)) retain];
     }
 
-    uint64_t add_space_addr = hex_find_seq(baseaddr + get_add_space_offset(os_version), get_add_space_pattern(os_version));
+    uint64_t add_space_addr = find_dock_address(&cache, DOCK_OFFSET_ADD_SPACE, baseaddr, get_add_space_offset(os_version), get_add_space_pattern(os_version));
     if (add_space_addr == 0x0) {
         NSLog(@"[yabai-sa] failed to get pointer to addSpace function..");
         add_space_fp = 0;
@@ -371,7 +462,7 @@ static void init_instances()
         add_space_fp = add_space_addr;
     }
 
-    uint64_t remove_space_addr = hex_find_seq(baseaddr + get_remove_space_offset(os_version), get_remove_space_pattern(os_version));
+    uint64_t remove_space_addr = find_dock_address(&cache, DOCK_OFFSET_REMOVE_SPACE, baseaddr, get_remove_space_offset(os_version), get_remove_space_pattern(os_version));
     if (remove_space_addr == 0x0) {
         NSLog(@"[yabai-sa] failed to get pointer to removeSpace function..");
         remove_space_fp = 0;
@@ -380,7 +471,7 @@ static void init_instances()
         remove_space_fp = remove_space_addr;
     }
 
-    uint64_t move_space_addr = hex_find_seq(baseaddr + get_move_space_offset(os_version), get_move_space_pattern(os_version));
+    uint64_t move_space_addr = find_dock_address(&cache, DOCK_OFFSET_MOVE_SPACE, baseaddr, get_move_space_offset(os_version), get_move_space_pattern(os_version));
     if (move_space_addr == 0x0) {
         NSLog(@"[yabai-sa] failed to get pointer to moveSpace function..");
         move_space_fp = 0;
@@ -389,7 +480,7 @@ static void init_instances()
         move_space_fp = move_space_addr;
     }
 
-    uint64_t set_front_window_addr = hex_find_seq(baseaddr + get_set_front_window_offset(os_version), get_set_front_window_pattern(os_version));
+    uint64_t set_front_window_addr = find_dock_address(&cache, DOCK_OFFSET_SET_FRONT_WINDOW, baseaddr, get_set_front_window_offset(os_version), get_set_front_window_pattern(os_version));
     if (set_front_window_addr == 0x0) {
         NSLog(@"[yabai-sa] failed to get pointer to setFrontWindow function..");
         set_front_window_fp = 0;
@@ -398,86 +489,12 @@ static void init_instances()
         set_front_window_fp = set_front_window_addr;
     }
 
+    if (has_uuid && cache_file) offset_cache_save(cache_file, &cache);
+
     managed_space = objc_getClass("Dock.ManagedSpace");
     _connection = CGSMainConnectionID();
 }
 
-typedef struct
-{
-    const char *text;
-    unsigned int length;
-} Token;
-
-static bool token_equals(Token token, const char *match)
-{
-    const char *at = match;
-    for (int i = 0; i < token.length; ++i, ++at) {
-        if ((*at == 0) || (token.text[i] != *at)) {
-            return false;
-        }
-    }
-    return *at == 0;
-}
-
-static uint64_t token_to_uint64t(Token token)
-{
-    uint64_t result = 0;
-    char buffer[token.length + 1];
-    memcpy(buffer, token.text, token.length);
-    buffer[token.length] = '\0';
-    sscanf(buffer, "%lld", &result);
-    return result;
-}
-
-static uint32_t token_to_uint32t(Token token)
-{
-    uint32_t result = 0;
-    char buffer[token.length + 1];
-    memcpy(buffer, token.text, token.length);
-    buffer[token.length] = '\0';
-    sscanf(buffer, "%d", &result);
-    return result;
-}
-
-static int token_to_int(Token token)
-{
-    int result = 0;
-    char buffer[token.length + 1];
-    memcpy(buffer, token.text, token.length);
-    buffer[token.length] = '\0';
-    sscanf(buffer, "%d", &result);
-    return result;
-}
-
-static float token_to_float(Token token)
-{
-    float result = 0.0f;
-    char buffer[token.length + 1];
-    memcpy(buffer, token.text, token.length);
-    buffer[token.length] = '\0';
-    sscanf(buffer, "%f", &result);
-    return result;
-}
-
-static Token get_token(const char **message)
-{
-    Token token;
-
-    token.text = *message;
-    while (**message && !isspace(**message)) {
-        ++(*message);
-    }
-    token.length = *message - token.text;
-
-    if (isspace(**message)) {
-        ++(*message);
-    } else {
-        // NOTE(koekeishiya): don't go past the null-terminator
-    }
-
-    return token;
-}
-
 static inline id get_ivar_value(id instance, const char *name)
 {
     id result = nil;
@@ -544,17 +561,8 @@ static inline id display_space_for_space_with_id(uint64_t space_id)
 
 #define asm__call_move_space(v0,v1,v2,v3,func) \
         __asm__("movq %0, %%rdi;""movq %1, %%rsi;""movq %2, %%rdx;""movq %3, %%r13;""callq *%4;" : :"r"(v0), "r"(v1), "r"(v2), "r"(v3), "r"(func) :"%rdi", "%rsi", "%rdx", "%r13");
-static void do_space_move(const char *message)
+static void do_space_move(uint64_t source_space_id, uint64_t dest_space_id, bool focus_dest_space)
 {
-    Token source_token = get_token(&message);
-    uint64_t source_space_id = token_to_uint64t(source_token);
-
-    Token dest_token = get_token(&message);
-    uint64_t dest_space_id = token_to_uint64t(dest_token);
-
-    Token focus_token = get_token(&message);
-    bool focus_dest_space = token_to_int(focus_token);
-
     CFStringRef source_display_uuid = CGSCopyManagedDisplayForSpace(_connection, source_space_id);
     id source_space = space_for_display_with_id(source_display_uuid, source_space_id);
     id source_display_space = display_space_for_display_uuid(source_display_uuid);
@@ -566,9 +574,7 @@ static void do_space_move(const char *message)
 
     asm__call_move_space(source_space, dest_space, dest_display_uuid, dock_spaces, move_space_fp);
 
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        objc_msgSend(dp_desktop_picture_manager, @selector(moveSpace:toDisplay:displayUUID:), source_space, dest_display_id, dest_display_uuid);
-    });
+    objc_msgSend(dp_desktop_picture_manager, @selector(moveSpace:toDisplay:displayUUID:), source_space, dest_display_id, dest_display_uuid);
 
     if (focus_dest_space) {
         uint64_t new_source_space_id = CGSManagedDisplayGetCurrentSpace(_connection, source_display_uuid);
@@ -587,19 +593,15 @@ static void do_space_move(const char *message)
 }
 
 typedef void (*remove_space_call)(id space, id display_space, id dock_spaces, uint64_t space_id1, uint64_t space_id2);
-static void do_space_destroy(const char *message)
+static void do_space_destroy(uint64_t space_id)
 {
-    Token space_id_token = get_token(&message);
-    uint64_t space_id = token_to_uint64t(space_id_token);
     CFStringRef display_uuid = CGSCopyManagedDisplayForSpace(_connection, space_id);
     uint64_t active_space_id = CGSManagedDisplayGetCurrentSpace(_connection, display_uuid);
 
     id space = space_for_display_with_id(display_uuid, space_id);
     id display_space = display_space_for_display_uuid(display_uuid);
 
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        ((remove_space_call) remove_space_fp)(space, display_space, dock_spaces, space_id, space_id);
-    });
+    ((remove_space_call) remove_space_fp)(space, display_space, dock_spaces, space_id, space_id);
 
     if (active_space_id == space_id) {
         uint64_t dest_space_id = CGSManagedDisplayGetCurrentSpace(_connection, display_uuid);
@@ -612,23 +614,17 @@ static void do_space_destroy(const char *message)
 
 #define asm__call_add_space(v0,v1,func) \
         __asm__("movq %0, %%rdi;""movq %1, %%r13;""callq *%2;" : :"r"(v0), "r"(v1), "r"(func) :"%rdi", "%r13");
-static void do_space_create(const char *message)
-{
-    Token space_id_token = get_token(&message);
-    uint64_t space_id = token_to_uint64t(space_id_token);
-    CFStringRef __block display_uuid = CGSCopyManagedDisplayForSpace(_connection, space_id);
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        id new_space = [[managed_space alloc] init];
-        id display_space = display_space_for_display_uuid(display_uuid);
-        asm__call_add_space(new_space, display_space, add_space_fp);
-        CFRelease(display_uuid);
-    });
+static void do_space_create(uint64_t space_id)
+{
+    CFStringRef display_uuid = CGSCopyManagedDisplayForSpace(_connection, space_id);
+    id new_space = [[managed_space alloc] init];
+    id display_space = display_space_for_display_uuid(display_uuid);
+    asm__call_add_space(new_space, display_space, add_space_fp);
+    CFRelease(display_uuid);
 }
 
-static void do_space_change(const char *message)
+static void do_space_change(uint64_t dest_space_id)
 {
-    Token token = get_token(&message);
-    uint64_t dest_space_id = token_to_uint64t(token);
     if (dest_space_id) {
         CFStringRef dest_display = CGSCopyManagedDisplayForSpace(_connection, dest_space_id);
         id source_space = objc_msgSend(dock_spaces, @selector(currentSpaceforDisplayUUID:), dest_display);
@@ -654,63 +650,39 @@ static void do_space_change(const char *message)
     }
 }
 
-static void do_window_move(const char *message)
+static void do_window_move(uint32_t wid, int x, int y)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token x_token = get_token(&message);
-    int x = token_to_int(x_token);
-    Token y_token = get_token(&message);
-    int y = token_to_int(y_token);
     CGPoint point = CGPointMake(x, y);
     CGSMoveWindow(_connection, wid, &point);
 }
 
-static void do_window_alpha(const char *message)
+static void do_window_alpha(uint32_t wid, float alpha)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token alpha_token = get_token(&message);
-    float alpha = token_to_float(alpha_token);
     CGSSetWindowAlpha(_connection, wid, alpha);
 }
 
-static void do_window_alpha_fade(const char *message)
+static void do_window_alpha_fade(uint32_t wid, float alpha, float duration)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token alpha_token = get_token(&message);
-    float alpha = token_to_float(alpha_token);
-    Token duration_token = get_token(&message);
-    float duration = token_to_float(duration_token);
     CGSSetWindowListAlpha(_connection, &wid, 1, alpha, duration);
 }
 
-static void do_window_level(const char *message)
+static void do_window_level(uint32_t wid, int key)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token key_token = get_token(&message);
-    int key = token_to_int(key_token);
     CGSSetWindowLevel(_connection, wid, CGWindowLevelForKey(key));
 }
 
-static void do_window_sticky(const char *message)
+static void do_window_sticky(uint32_t wid, int value)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token value_token = get_token(&message);
-    int value = token_to_int(value_token);
     int tags[2] = { kCGSOnAllWorkspacesTagBit, 0 };
     if (value == 1) {
         CGSSetWindowTags(_connection, wid, tags, 32);
@@ -720,28 +692,21 @@ static void do_window_sticky(const char *message)
 }
 
 typedef void (*focus_window_call)(ProcessSerialNumber psn, uint32_t wid);
-static void do_window_focus(const char *message)
+static void do_window_focus(uint32_t window_id)
 {
     int window_connection;
     ProcessSerialNumber window_psn;
 
-    Token wid_token = get_token(&message);
-    uint32_t window_id = token_to_uint32t(wid_token);
-
     CGSGetWindowOwner(_connection, window_id, &window_connection);
     CGSGetConnectionPSN(window_connection, &window_psn);
 
     ((focus_window_call) set_front_window_fp)(window_psn, window_id);
 }
 
-static void do_window_shadow(const char *message)
+static void do_window_shadow(uint32_t wid, int value)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
-    Token value_token = get_token(&message);
-    int value = token_to_int(value_token);
     int tags[2] = { kCGSNoShadowTagBit,  0};
     if (value == 1) {
         CGSClearWindowTags(_connection, wid, tags, 32);
@@ -751,10 +716,8 @@ static void do_window_shadow(const char *message)
     CGSInvalidateWindowShadow(_connection, wid);
 }
 
-static void do_window_shadow_irreversible(const char *message)
+static void do_window_shadow_irreversible(uint32_t wid)
 {
-    Token wid_token = get_token(&message);
-    uint32_t wid = token_to_uint32t(wid_token);
     if (!wid) return;
 
     CGSSetWindowShadowParameters(_connection, wid, 0, 0, 0, 0);
@@ -785,7 +748,8 @@ static inline bool can_focus_window()
     return set_front_window_fp != 0;
 }
 
-static void do_handshake(int sockfd)
+
+static uint32_t handshake_attrib(void)
 {
     uint32_t attrib = 0;
 
@@ -796,20 +760,39 @@ static void do_handshake(int sockfd)
     if (can_move_space())                  attrib |= OSAX_ATTRIB_MOV_SPACE;
     if (can_focus_window())                attrib |= OSAX_ATTRIB_SET_WINDOW;
 
-    char bytes[BUFSIZ] = {};
+    return attrib;
+}
+
+static void do_handshake(struct osax_op *op, struct osax_writer *rsp)
+{
+    osax_write_u8(rsp, OSAX_PROTOCOL_VERSION);
+    osax_write_u32(rsp, op->handshake.capabilities & OSAX_CAPABILITY_ALL);
+    osax_write_u32(rsp, handshake_attrib());
+    osax_write_bytes(rsp, OSAX_VERSION, strlen(OSAX_VERSION));
+}
+
+//
+// yabai falls back to this reply when the binary handshake fails, so that
+// it can still tell which version of the payload is loaded. the format
+// must never change.
+//
+
+static void do_legacy_handshake(char *rsp, int *rsp_length)
+{
+    uint32_t attrib = handshake_attrib();
     int version_length = strlen(OSAX_VERSION);
     int attrib_length = sizeof(uint32_t);
     int bytes_length = version_length + 1 + attrib_length;
 
-    memcpy(bytes, OSAX_VERSION, version_length);
-    memcpy(bytes + version_length + 1, &attrib, attrib_length);
-    bytes[version_length] = '\0';
-    bytes[bytes_length] = '\n';
+    memcpy(rsp, OSAX_VERSION, version_length);
+    memcpy(rsp + version_length + 1, &attrib, attrib_length);
+    rsp[version_length] = '\0';
+    rsp[bytes_length] = '\n';
 
-    send(sockfd, bytes, bytes_length+1, 0);
+    *rsp_length = bytes_length + 1;
 }
 
-static void handle_message(int sockfd, const char *message)
+static void handle_op(struct osax_op *op)
 {
     /*
      * NOTE(koekeishiya): interaction is supposed to happen through an
@@ -817,64 +800,425 @@ static void handle_message(int sockfd, const char *message)
      * validation, as the program in question should do this.
      */
 
-    Token token = get_token(&message);
-    if (token_equals(token, "handshake")) {
-        do_handshake(sockfd);
-    } else if (token_equals(token, "space")) {
-        if (!can_focus_space()) return;
-        do_space_change(message);
-    } else if (token_equals(token, "space_create")) {
-        if (!can_create_space()) return;
-        do_space_create(message);
-    } else if (token_equals(token, "space_destroy")) {
-        if (!can_destroy_space()) return;
-        do_space_destroy(message);
-    } else if (token_equals(token, "space_move")) {
-        if (!can_move_space()) return;
-        do_space_move(message);
-    } else if (token_equals(token, "window_move")) {
-        do_window_move(message);
-    } else if (token_equals(token, "window_alpha")) {
-        do_window_alpha(message);
-    } else if (token_equals(token, "window_alpha_fade")) {
-        do_window_alpha_fade(message);
-    } else if (token_equals(token, "window_level")) {
-        do_window_level(message);
-    } else if (token_equals(token, "window_sticky")) {
-        do_window_sticky(message);
-    } else if (token_equals(token, "window_focus")) {
-        if (!can_focus_window()) return;
-        do_window_focus(message);
-    } else if (token_equals(token, "window_shadow")) {
-        do_window_shadow(message);
-    } else if (token_equals(token, "window_shadow_irreversible")) {
-        do_window_shadow_irreversible(message);
-    }
-}
-
-static bool recv_socket(int sockfd, char *message, size_t message_size)
-{
-    int len = recv(sockfd, message, message_size, 0);
-    if (len > 0) {
-        message[len] = '\0';
-        return true;
+    //
+    // Frames from different connections may be handled at the same time.
+    // operations that rearrange the spaces of the Dock are run on its main
+    // queue, where the Dock itself makes those changes; we wait for them so
+    // that the reply is only sent once the change has been made.
+    //
+
+    switch (op->opcode) {
+    case OSAX_OP_SPACE_FOCUS: {
+        if (can_focus_space()) do_space_change(op->space.sid);
+    } break;
+    case OSAX_OP_SPACE_CREATE: {
+        if (can_create_space()) dispatch_sync(dispatch_get_main_queue(), ^{ do_space_create(op->space.sid); });
+    } break;
+    case OSAX_OP_SPACE_DESTROY: {
+        if (can_destroy_space()) dispatch_sync(dispatch_get_main_queue(), ^{ do_space_destroy(op->space.sid); });
+    } break;
+    case OSAX_OP_SPACE_MOVE: {
+        if (can_move_space()) dispatch_sync(dispatch_get_main_queue(), ^{ do_space_move(op->space_move.src_sid, op->space_move.dst_sid, op->space_move.focus); });
+    } break;
+    case OSAX_OP_WINDOW_MOVE: {
+        do_window_move(op->window_move.wid, op->window_move.x, op->window_move.y);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA: {
+        do_window_alpha(op->window_alpha.wid, op->window_alpha.alpha);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA_FADE: {
+        do_window_alpha_fade(op->window_alpha.wid, op->window_alpha.alpha, op->window_alpha.duration);
+    } break;
+    case OSAX_OP_WINDOW_LEVEL: {
+        do_window_level(op->window.wid, op->window.value);
+    } break;
+    case OSAX_OP_WINDOW_STICKY: {
+        do_window_sticky(op->window.wid, op->window.value);
+    } break;
+    case OSAX_OP_WINDOW_FOCUS: {
+        if (can_focus_window()) do_window_focus(op->window.wid);
+    } break;
+    case OSAX_OP_WINDOW_SHADOW: {
+        do_window_shadow(op->window.wid, op->window.value);
+    } break;
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: {
+        do_window_shadow_irreversible(op->window.wid);
+    } break;
+    }
+}
+
+static void do_window_alpha_fade_batch(struct osax_reader *reader, int count)
+{
+    uint32_t wid_list[BATCH_WID_MAX];
+    int wid_count = 0;
+    float alpha = 0.0f;
+    float duration = 0.0f;
+    struct osax_op op;
+
+    //
+    // Consecutive records that fade to the same alpha over the same
+    // duration are applied through a single window list call.
+    //
+
+    for (int i = 0; i < count; ++i) {
+        if (!osax_decode_op_fields(reader, OSAX_OP_WINDOW_ALPHA_FADE, &op)) break;
+
+        if (wid_count > 0 && (op.window_alpha.alpha != alpha || op.window_alpha.duration != duration || wid_count == BATCH_WID_MAX)) {
+            CGSSetWindowListAlpha(_connection, wid_list, wid_count, alpha, duration);
+            wid_count = 0;
+        }
+
+        alpha = op.window_alpha.alpha;
+        duration = op.window_alpha.duration;
+        if (op.window_alpha.wid) wid_list[wid_count++] = op.window_alpha.wid;
+    }
+
+    if (wid_count > 0) CGSSetWindowListAlpha(_connection, wid_list, wid_count, alpha, duration);
+}
+
+static void do_batch(struct osax_reader *reader)
+{
+    uint8_t opcode = osax_read_u8(reader);
+    int count = osax_read_u16(reader);
+    if (reader->error || !osax_op_is_batchable(opcode)) return;
+
+    if (opcode == OSAX_OP_WINDOW_ALPHA_FADE) {
+        do_window_alpha_fade_batch(reader, count);
+        return;
+    }
+
+    struct osax_op op;
+    for (int i = 0; i < count; ++i) {
+        if (!osax_decode_op_fields(reader, opcode, &op)) break;
+        handle_op(&op);
+    }
+}
+
+static void do_transaction(struct osax_reader *reader)
+{
+    struct osax_op op_list[OSAX_TRANSACTION_OP_MAX];
+
+    //
+    // The transaction is decoded in full before any of its records are applied,
+    // so that a malformed frame leaves the Dock untouched. we are running on
+    // the serial queue of the connection; no other frame from this connection
+    // is handled until the last record has been applied.
+    //
+    // There is no rollback. if the Dock rejects a record halfway through, for
+    // example because a space went away after yabai validated the transaction,
+    // the records before it stay applied and the ones after it still run.
+    //
+
+    int count = osax_decode_transaction(reader, op_list, OSAX_TRANSACTION_OP_MAX);
+
+    for (int i = 0; i < count; ++i) {
+        handle_op(&op_list[i]);
+    }
+}
+
+static void handle_message(const uint8_t *bytes, uint32_t length, struct osax_writer *rsp)
+{
+    struct osax_reader reader;
+    osax_reader_init(&reader, bytes, length);
+
+    uint8_t version = osax_read_u8(&reader);
+    uint8_t opcode = osax_read_u8(&reader);
+    if (reader.error || version != OSAX_PROTOCOL_VERSION) return;
+
+    if (opcode == OSAX_OP_BATCH) {
+        do_batch(&reader);
+        return;
+    }
+
+    if (opcode == OSAX_OP_TRANSACTION) {
+        do_transaction(&reader);
+        return;
+    }
+
+    struct osax_op op;
+    if (!osax_decode_op_fields(&reader, opcode, &op)) return;
+
+    if (opcode == OSAX_OP_HANDSHAKE) {
+        do_handshake(&op, rsp);
+    } else {
+        handle_op(&op);
+    }
+}
+
+//
+// A single thread waits on the listening socket and every client connection
+// through kqueue. it reads and splits frames, and writes replies; it never
+// blocks, as every client socket is non-blocking. each connection hands its
+// frames to its own serial queue, which targets a shared concurrent queue.
+// frames from one connection are applied one at a time, in the order they
+// arrived, while a slow operation on one connection does not hold up another.
+//
+// The reply to a frame is appended to the write buffer of its connection, and
+// EVFILT_WRITE is enabled until the kqueue thread has written all of it. a
+// client that stops reading therefore never blocks a queue; once it has left
+// CONNECTION_WRITE_MAX bytes unread, the connection is shut down.
+//
+
+#define CONNECTION_BUFFER_SIZE (2 * (OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX))
+#define CONNECTION_WRITE_MAX (64 * (OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX))
+#define DAEMON_EVENT_COUNT 32
+
+struct connection
+{
+    int sockfd;
+    bool is_stream;
+    bool is_closed;
+    dispatch_queue_t queue;
+    pthread_mutex_t write_lock;
+    uint8_t *write_buffer;
+    uint32_t write_length;
+    uint32_t write_capacity;
+    uint32_t length;
+    uint8_t buffer[CONNECTION_BUFFER_SIZE];
+};
+
+static void connection_write(struct connection *connection, const void *bytes, uint32_t length)
+{
+    pthread_mutex_lock(&connection->write_lock);
+
+    if (connection->write_length + length > CONNECTION_WRITE_MAX) {
+        shutdown(connection->sockfd, SHUT_RDWR);
+        goto end;
+    }
+
+    if (connection->write_length + length > connection->write_capacity) {
+        connection->write_capacity = connection->write_length + length + OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX;
+        connection->write_buffer = realloc(connection->write_buffer, connection->write_capacity);
+    }
+
+    memcpy(connection->write_buffer + connection->write_length, bytes, length);
+    connection->write_length += length;
+
+    if (!connection->is_closed && connection->write_length == length) {
+        struct kevent event;
+        EV_SET(&event, connection->sockfd, EVFILT_WRITE, EV_ENABLE, 0, 0, connection);
+        kevent(daemon_kq, &event, 1, NULL, 0, NULL);
+    }
+
+end:
+    pthread_mutex_unlock(&connection->write_lock);
+}
+
+static bool connection_flush(struct connection *connection)
+{
+    bool result = true;
+    uint32_t offset = 0;
+
+    pthread_mutex_lock(&connection->write_lock);
+
+    while (offset < connection->write_length) {
+        ssize_t len = send(connection->sockfd, connection->write_buffer + offset, connection->write_length - offset, 0);
+        if (len > 0) {
+            offset += len;
+        } else {
+            result = len == -1 && errno == EAGAIN;
+            break;
+        }
+    }
+
+    connection->write_length -= offset;
+    memmove(connection->write_buffer, connection->write_buffer + offset, connection->write_length);
+
+    if (!connection->is_closed && connection->write_length == 0) {
+        struct kevent event;
+        EV_SET(&event, connection->sockfd, EVFILT_WRITE, EV_DISABLE, 0, 0, connection);
+        kevent(daemon_kq, &event, 1, NULL, 0, NULL);
+    }
+
+    pthread_mutex_unlock(&connection->write_lock);
+    return result;
+}
+
+static void connection_dispatch_frame(struct connection *connection, struct osax_frame_header header, const uint8_t *bytes)
+{
+    uint8_t *message = malloc(header.length + 1);
+    memcpy(message, bytes, header.length);
+
+    dispatch_async(connection->queue, ^{
+        uint8_t rsp_bytes[OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX];
+        struct osax_writer rsp;
+        osax_writer_init(&rsp, rsp_bytes + OSAX_FRAME_HEADER_SIZE, OSAX_FRAME_MAX);
+        handle_message(message, header.length, &rsp);
+        free(message);
+
+        osax_encode_frame_header(rsp_bytes, rsp.length, header.id);
+        connection_write(connection, rsp_bytes, OSAX_FRAME_HEADER_SIZE + rsp.length);
+    });
+}
+
+static void connection_dispatch_legacy(struct connection *connection, const uint8_t *bytes, uint32_t length)
+{
+    if (length < 9 || memcmp(bytes, "handshake", 9) != 0) return;
+
+    dispatch_async(connection->queue, ^{
+        char rsp[BUF_SIZE];
+        int rsp_length = 0;
+        do_legacy_handshake(rsp, &rsp_length);
+        connection_write(connection, rsp, rsp_length);
+    });
+}
+
+static void connection_close(struct connection *connection)
+{
+    pthread_mutex_lock(&connection->write_lock);
+    connection->is_closed = true;
+    pthread_mutex_unlock(&connection->write_lock);
+
+    struct kevent event[2];
+    EV_SET(&event[0], connection->sockfd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&event[1], connection->sockfd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(daemon_kq, event, 2, NULL, 0, NULL);
+}
+
+static void connection_destroy(struct connection *connection)
+{
+    //
+    // Operations of this connection that are still queued append their reply
+    // to the write buffer, so release it only after they have finished. what
+    // they wrote is sent as far as the socket takes it without blocking; this
+    // is how the reply to a legacy handshake gets out.
+    //
+
+    dispatch_async(connection->queue, ^{
+        connection_flush(connection);
+        shutdown(connection->sockfd, SHUT_RDWR);
+        close(connection->sockfd);
+        dispatch_release(connection->queue);
+        pthread_mutex_destroy(&connection->write_lock);
+        free(connection->write_buffer);
+        free(connection);
+    });
+}
+
+static bool connection_read(struct connection *connection, size_t available)
+{
+    size_t space = sizeof(connection->buffer) - connection->length;
+    if (space == 0) return false;
+    if (available == 0 || available > space) available = space;
+
+    ssize_t len = recv(connection->sockfd, connection->buffer + connection->length, available, 0);
+    if (len == -1 && errno == EAGAIN) return true;
+    if (len <= 0) return false;
+    connection->length += len;
+
+    if (!connection->is_stream) {
+        if (connection->length < OSAX_STREAM_MAGIC_LENGTH) return true;
+
+        if (memcmp(connection->buffer, OSAX_STREAM_MAGIC, OSAX_STREAM_MAGIC_LENGTH) != 0) {
+            connection_dispatch_legacy(connection, connection->buffer, connection->length);
+            return false;
+        }
+
+        connection->is_stream = true;
+        connection->length -= OSAX_STREAM_MAGIC_LENGTH;
+        memmove(connection->buffer, connection->buffer + OSAX_STREAM_MAGIC_LENGTH, connection->length);
+    }
+
+    uint32_t offset = 0;
+    struct osax_frame_header header;
+
+    while (connection->length - offset >= OSAX_FRAME_HEADER_SIZE) {
+        header = osax_decode_frame_header(connection->buffer + offset);
+        if (header.length > OSAX_FRAME_MAX) return false;
+        if (connection->length - offset - OSAX_FRAME_HEADER_SIZE < header.length) break;
+
+        connection_dispatch_frame(connection, header, connection->buffer + offset + OSAX_FRAME_HEADER_SIZE);
+        offset += OSAX_FRAME_HEADER_SIZE + header.length;
+    }
+
+    connection->length -= offset;
+    memmove(connection->buffer, connection->buffer + offset, connection->length);
+
+    return true;
+}
+
+static void connection_accept(void)
+{
+    int sockfd = accept(daemon_sockfd, NULL, 0);
+    if (sockfd == -1) return;
+
+    //
+    // The Dock must never be taken down by a write to a
+    // connection that yabai has already closed on its end.
+    //
+
+    int set = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+
+    if (fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK) == -1) {
+        close(sockfd);
+        return;
+    }
+
+    struct connection *connection = malloc(sizeof(struct connection));
+    connection->sockfd = sockfd;
+    connection->is_stream = false;
+    connection->is_closed = false;
+    connection->queue = dispatch_queue_create("com.koekeishiya.yabai-sa.connection", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(connection->queue, message_queue);
+    pthread_mutex_init(&connection->write_lock, NULL);
+    connection->write_buffer = NULL;
+    connection->write_length = 0;
+    connection->write_capacity = 0;
+    connection->length = 0;
+
+    struct kevent event[2];
+    EV_SET(&event[0], sockfd, EVFILT_READ, EV_ADD, 0, 0, connection);
+    EV_SET(&event[1], sockfd, EVFILT_WRITE, EV_ADD | EV_DISABLE, 0, 0, connection);
+    if (kevent(daemon_kq, event, 2, NULL, 0, NULL) == -1) {
+        connection_close(connection);
+        connection_destroy(connection);
     }
-    return false;
 }
 
 static void *handle_connection(void *unused)
 {
+    struct kevent events[DAEMON_EVENT_COUNT];
+    struct connection *closed[DAEMON_EVENT_COUNT];
+
     while (1) {
-        int sockfd = accept(daemon_sockfd, NULL, 0);
-        if (sockfd == -1) continue;
+        int count = kevent(daemon_kq, NULL, 0, events, DAEMON_EVENT_COUNT, NULL);
+        int closed_count = 0;
+
+        for (int i = 0; i < count; ++i) {
+            struct kevent *event = &events[i];
+
+            if (event->ident == daemon_sockfd) {
+                connection_accept();
+                continue;
+            }
+
+            //
+            // A connection may show up twice in one batch, for reading and
+            // for writing, so it is only released once the batch is done.
+            //
+
+            struct connection *connection = event->udata;
+            if (connection->is_closed) continue;
 
-        char message[BUF_SIZE];
-        if (recv_socket(sockfd, message, sizeof(message))) {
-            handle_message(sockfd, message);
+            bool is_open;
+            if (event->filter == EVFILT_WRITE) {
+                is_open = connection_flush(connection);
+            } else if ((event->flags & EV_EOF) && event->data == 0) {
+                is_open = false;
+            } else {
+                is_open = connection_read(connection, event->data);
+            }
+
+            if (!is_open) {
+                connection_close(connection);
+                closed[closed_count++] = connection;
+            }
         }
 
-        shutdown(sockfd, SHUT_RDWR);
-        close(sockfd);
+        for (int i = 0; i < closed_count; ++i) {
+            connection_destroy(closed[i]);
+        }
     }
 
     return NULL;
@@ -903,6 +1247,17 @@ static bool start_daemon(char *socket_path)
         return false;
     }
 
+    if ((daemon_kq = kqueue()) == -1) {
+        return false;
+    }
+
+    struct kevent event;
+    EV_SET(&event, daemon_sockfd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(daemon_kq, &event, 1, NULL, 0, NULL) == -1) {
+        return false;
+    }
+
+    message_queue = dispatch_queue_create("com.koekeishiya.yabai-sa.message", DISPATCH_QUEUE_CONCURRENT);
     pthread_create(&daemon_thread, NULL, &handle_connection, NULL);
     return true;
 }
@@ -915,7 +1270,6 @@ static bool start_daemon(char *socket_path)
 + (void) load
 {
     NSLog(@"[yabai-sa] loaded payload");
-    init_instances();
 
     const char *user = getenv("USER");
     if (!user) {
@@ -923,6 +1277,10 @@ static bool start_daemon(char *socket_path)
         if (ns_user) user = [ns_user UTF8String];
     }
 
+    char cache_file[255];
+    if (user) snprintf(cache_file, sizeof(cache_file), OFFSET_CACHE_PATH_FMT, user);
+    init_instances(user ? cache_file : NULL);
+
     if (!user) {
         NSLog(@"[yabai-sa] could not get 'env USER'! abort..");
         return;
@@ -8,10 +8,20 @@
 #define PAYLOAD_STATUS_NO_ATTRIB 2
 #define PAYLOAD_STATUS_CON_ERROR 3
 
+#define SA_COMPLETION(name) void name(void *context, bool success)
+typedef SA_COMPLETION(sa_completion);
+
 int scripting_addition_check(void);
 int scripting_addition_load(void);
 bool scripting_addition_is_installed(void);
 int scripting_addition_uninstall(void);
 int scripting_addition_install(void);
+void scripting_addition_batch_begin(void);
+void scripting_addition_batch_end(void);
+void scripting_addition_submit(struct osax_op *op, sa_completion *completion, void *context);
+bool scripting_addition_send(struct osax_op *op);
+bool scripting_addition_request(struct osax_op *op);
+bool scripting_addition_request_transaction(struct osax_op *ops, int count);
+void scripting_addition_disconnect(void);
 
 #endif
@@ -175,7 +175,7 @@ static void scripting_addition_prepare_binaries(void)
     system(cmd);
 }
 
-static bool scripting_addition_request_handshake(char *version, uint32_t *attrib)
+static bool scripting_addition_request_legacy_handshake(char *version, uint32_t *attrib)
 {
     bool result = false;
 
@@ -207,6 +207,468 @@ out:
     return result;
 }
 
+//
+// All operations share a single long-lived connection to the payload.
+// requests are written back to back without waiting for the previous one to
+// be handled; replies arrive in request order and carry the id of the
+// request they belong to. a failed write means the Dock went away (e.g. it
+// was restarted), in which case we reconnect once and resend.
+//
+// every new connection starts with a handshake (frame id 0) that negotiates
+// the capabilities supported by both sides.
+//
+
+#define SA_MAX_INFLIGHT 32
+
+static pthread_mutex_t sa_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool sa_is_connected;
+static int sa_sockfd = -1;
+static uint32_t sa_last_id;
+static uint32_t sa_last_acked_id;
+static uint32_t sa_capabilities;
+static uint32_t sa_attrib;
+static char sa_version[MAXLEN];
+
+//
+// Transport statistics, reported in verbose mode every time we wait for
+// a reply. the latency includes the time an operation spent queued
+// behind earlier ones, as that is what the caller observes.
+//
+
+static struct {
+    uint64_t frame_count;
+    uint64_t byte_count;
+    uint64_t ack_count;
+    double ack_total;
+    double ack_max;
+} sa_stats;
+
+static bool scripting_addition_write_all(int sockfd, const void *bytes, size_t length)
+{
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = send(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+static bool scripting_addition_read_all(int sockfd, void *bytes, size_t length)
+{
+    char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = recv(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+static bool scripting_addition_write_frame(int sockfd, uint32_t id, const uint8_t *message, uint32_t length)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX];
+    if (length > OSAX_FRAME_MAX) return false;
+
+    osax_encode_frame_header(bytes, length, id);
+    memcpy(bytes + OSAX_FRAME_HEADER_SIZE, message, length);
+
+    return scripting_addition_write_all(sockfd, bytes, OSAX_FRAME_HEADER_SIZE + length);
+}
+
+static bool scripting_addition_read_frame(int sockfd, struct osax_frame_header *header, uint8_t *rsp)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE];
+    if (!scripting_addition_read_all(sockfd, bytes, sizeof(bytes))) return false;
+
+    *header = osax_decode_frame_header(bytes);
+    if (header->length > OSAX_FRAME_MAX) return false;
+    return scripting_addition_read_all(sockfd, rsp, header->length);
+}
+
+static bool scripting_addition_negotiate(int sockfd)
+{
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+
+    struct osax_op op = { .opcode = OSAX_OP_HANDSHAKE, .handshake = { OSAX_CAPABILITY_ALL } };
+    osax_encode_op(&writer, &op);
+    if (!scripting_addition_write_frame(sockfd, 0, bytes, writer.length)) return false;
+
+    struct osax_frame_header header;
+    if (!scripting_addition_read_frame(sockfd, &header, bytes)) return false;
+
+    struct osax_reader reader;
+    osax_reader_init(&reader, bytes, header.length);
+
+    uint8_t version = osax_read_u8(&reader);
+    uint32_t capabilities = osax_read_u32(&reader);
+    uint32_t attrib = osax_read_u32(&reader);
+    if (reader.error || version != OSAX_PROTOCOL_VERSION) return false;
+
+    uint32_t version_length = min(reader.length - reader.cursor, sizeof(sa_version) - 1);
+    osax_read_bytes(&reader, sa_version, version_length);
+    sa_version[version_length] = '\0';
+
+    sa_capabilities = capabilities & OSAX_CAPABILITY_ALL;
+    sa_attrib = attrib;
+
+    debug("%s: protocol v%d, capabilities 0x%X\n", __FUNCTION__, version, sa_capabilities);
+    return true;
+}
+
+static void scripting_addition_close_connection(void)
+{
+    if (sa_sockfd == -1) return;
+
+    socket_close(sa_sockfd);
+    sa_sockfd = -1;
+    sa_is_connected = false;
+    sa_last_acked_id = sa_last_id;
+    sa_capabilities = 0;
+}
+
+static bool scripting_addition_open_connection(void)
+{
+    int sockfd;
+    if (!socket_connect_un(&sockfd, g_sa_socket_file)) goto err;
+
+    int set = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+
+    if (!scripting_addition_write_all(sockfd, OSAX_STREAM_MAGIC, OSAX_STREAM_MAGIC_LENGTH)) goto err;
+    if (!scripting_addition_negotiate(sockfd)) goto err;
+
+    sa_sockfd = sockfd;
+    sa_is_connected = true;
+    sa_last_acked_id = sa_last_id;
+    return true;
+
+err:
+    socket_close(sockfd);
+    return false;
+}
+
+static bool scripting_addition_await(uint32_t id)
+{
+    struct osax_frame_header header;
+    uint8_t rsp[OSAX_FRAME_MAX];
+
+    while ((int32_t)(id - sa_last_acked_id) > 0) {
+        if (!scripting_addition_read_frame(sa_sockfd, &header, rsp)) goto err;
+        sa_last_acked_id = header.id;
+    }
+
+    return true;
+
+err:
+    scripting_addition_close_connection();
+    return false;
+}
+
+static uint32_t scripting_addition_transmit(const uint8_t *message, uint32_t length)
+{
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (sa_sockfd == -1 && !scripting_addition_open_connection()) return 0;
+
+        if ((sa_last_id - sa_last_acked_id) >= SA_MAX_INFLIGHT) {
+            if (!scripting_addition_await(sa_last_id - SA_MAX_INFLIGHT + 1)) continue;
+        }
+
+        uint32_t id = ++sa_last_id;
+        if (id == 0) id = ++sa_last_id;
+
+        if (scripting_addition_write_frame(sa_sockfd, id, message, length)) {
+            ++sa_stats.frame_count;
+            sa_stats.byte_count += OSAX_FRAME_HEADER_SIZE + length;
+            return id;
+        }
+
+        scripting_addition_close_connection();
+    }
+
+    return 0;
+}
+
+//
+// The connection is only ever touched from a serial queue, so that the event
+// loop never blocks on the Dock. operations are encoded on the calling thread
+// and handed to the queue; only those whose result matters wait for their
+// reply, through a completion or scripting_addition_request.
+//
+
+static bool scripting_addition_acknowledge(uint32_t id, uint8_t opcode, CFAbsoluteTime start)
+{
+    if (id == 0 || !scripting_addition_await(id)) return false;
+
+    double elapsed = (CFAbsoluteTimeGetCurrent() - start) * 1000.0f;
+    sa_stats.ack_total += elapsed;
+    sa_stats.ack_max = max(sa_stats.ack_max, elapsed);
+    ++sa_stats.ack_count;
+
+    debug("%s: op 0x%02X in %.3fms (avg %.3fms, max %.3fms, %lld frames, %lld bytes)\n",
+          __FUNCTION__, opcode, elapsed, sa_stats.ack_total / sa_stats.ack_count, sa_stats.ack_max,
+          sa_stats.frame_count, sa_stats.byte_count);
+
+    return true;
+}
+
+static dispatch_queue_t scripting_addition_queue(void)
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t once;
+
+    dispatch_once(&once, ^{
+        queue = dispatch_queue_create("com.koekeishiya.yabai.sa", DISPATCH_QUEUE_SERIAL);
+    });
+
+    return queue;
+}
+
+static uint32_t scripting_addition_transmit_transaction(const uint8_t *message, uint32_t length)
+{
+    //
+    // The payload did not agree to transactions; send the operations one
+    // by one instead. they are still applied in order, but frames from
+    // other threads may be interleaved with them.
+    //
+
+    struct osax_reader reader;
+    osax_reader_init(&reader, message, length);
+    osax_read_u8(&reader);
+    osax_read_u8(&reader);
+
+    int count = osax_read_u16(&reader);
+
+    uint32_t id = 0;
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    struct osax_op op;
+
+    for (int i = 0; i < count; ++i) {
+        uint8_t opcode = osax_read_u8(&reader);
+        if (!osax_decode_op_fields(&reader, opcode, &op)) break;
+
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_op(&writer, &op);
+        id = scripting_addition_transmit(bytes, writer.length);
+    }
+
+    return id;
+}
+
+static uint32_t scripting_addition_transmit_message(const uint8_t *message, uint32_t length)
+{
+    if (sa_sockfd == -1 && !scripting_addition_open_connection()) return 0;
+    if (message[1] == OSAX_OP_TRANSACTION && !(sa_capabilities & OSAX_CAPABILITY_TRANSACTION)) {
+        return scripting_addition_transmit_transaction(message, length);
+    }
+
+    if (message[1] != OSAX_OP_BATCH || (sa_capabilities & OSAX_CAPABILITY_BATCH)) {
+        return scripting_addition_transmit(message, length);
+    }
+
+    //
+    // The payload did not agree to batching; unpack the
+    // batch and send its operations one by one instead.
+    //
+
+    struct osax_reader reader;
+    osax_reader_init(&reader, message, length);
+    osax_read_u8(&reader);
+    osax_read_u8(&reader);
+
+    uint8_t opcode = osax_read_u8(&reader);
+    int count = osax_read_u16(&reader);
+
+    uint32_t id = 0;
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    struct osax_op op;
+
+    for (int i = 0; i < count; ++i) {
+        if (!osax_decode_op_fields(&reader, opcode, &op)) break;
+
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_op(&writer, &op);
+        id = scripting_addition_transmit(bytes, writer.length);
+    }
+
+    return id;
+}
+
+static void scripting_addition_enqueue(const uint8_t *message, uint32_t length, sa_completion *completion, void *context)
+{
+    uint8_t *bytes = malloc(length);
+    memcpy(bytes, message, length);
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+    dispatch_async(scripting_addition_queue(), ^{
+        uint32_t id = scripting_addition_transmit_message(bytes, length);
+        if (completion) completion(context, scripting_addition_acknowledge(id, bytes[1], start));
+        free(bytes);
+    });
+}
+
+//
+// While a batch is open, consecutive window operations of the same kind are
+// folded into a single batch message carrying the fields of each operation.
+// the batch is flushed when a different kind of operation is sent, when the
+// frame is full, and when the outermost batch is closed.
+//
+
+#define SA_BATCH_COUNT_OFFSET 3
+
+static int sa_batch_depth;
+static uint8_t sa_batch_opcode;
+static uint8_t sa_batch[OSAX_FRAME_MAX];
+static struct osax_writer sa_batch_writer;
+static int sa_batch_count;
+
+static void scripting_addition_batch_flush(void)
+{
+    if (sa_batch_count == 0) return;
+
+    sa_batch[SA_BATCH_COUNT_OFFSET+0] = sa_batch_count & 0xFF;
+    sa_batch[SA_BATCH_COUNT_OFFSET+1] = (sa_batch_count >> 8) & 0xFF;
+
+    if (sa_batch_count > 1) debug("%s: %d x op 0x%02X (%d bytes)\n", __FUNCTION__, sa_batch_count, sa_batch_opcode, sa_batch_writer.length);
+    scripting_addition_enqueue(sa_batch, sa_batch_writer.length, NULL, NULL);
+
+    sa_batch_count = 0;
+}
+
+static bool scripting_addition_batch_append(struct osax_op *op)
+{
+    if (!osax_op_is_batchable(op->opcode)) return false;
+
+    if (sa_batch_count > 0 && sa_batch_opcode != op->opcode) {
+        scripting_addition_batch_flush();
+    }
+
+    uint32_t size = osax_op_fields_size(op->opcode);
+    if (sa_batch_count > 0 && (sa_batch_writer.capacity - sa_batch_writer.length < size || sa_batch_count == UINT16_MAX)) {
+        scripting_addition_batch_flush();
+    }
+
+    if (sa_batch_count == 0) {
+        sa_batch_opcode = op->opcode;
+        osax_writer_init(&sa_batch_writer, sa_batch, sizeof(sa_batch));
+        osax_encode_batch_header(&sa_batch_writer, sa_batch_opcode, 0);
+    }
+
+    osax_encode_op_fields(&sa_batch_writer, op);
+    ++sa_batch_count;
+
+    return true;
+}
+
+void scripting_addition_batch_begin(void)
+{
+    pthread_mutex_lock(&sa_lock);
+    ++sa_batch_depth;
+    pthread_mutex_unlock(&sa_lock);
+}
+
+void scripting_addition_batch_end(void)
+{
+    pthread_mutex_lock(&sa_lock);
+    if (--sa_batch_depth == 0) scripting_addition_batch_flush();
+    pthread_mutex_unlock(&sa_lock);
+}
+
+void scripting_addition_submit(struct osax_op *op, sa_completion *completion, void *context)
+{
+    pthread_mutex_lock(&sa_lock);
+    bool is_batched = !completion && sa_batch_depth > 0 && scripting_addition_batch_append(op);
+    if (!is_batched) {
+        uint8_t bytes[OSAX_FRAME_MAX];
+        struct osax_writer writer;
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_op(&writer, op);
+
+        scripting_addition_batch_flush();
+        scripting_addition_enqueue(bytes, writer.length, completion, context);
+    }
+    pthread_mutex_unlock(&sa_lock);
+}
+
+bool scripting_addition_send(struct osax_op *op)
+{
+    scripting_addition_submit(op, NULL, NULL);
+    return sa_is_connected;
+}
+
+static bool scripting_addition_request_message(uint8_t *message, uint32_t length)
+{
+    pthread_mutex_lock(&sa_lock);
+    scripting_addition_batch_flush();
+    pthread_mutex_unlock(&sa_lock);
+
+    __block bool result = false;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+    dispatch_sync(scripting_addition_queue(), ^{
+        uint32_t id = scripting_addition_transmit_message(message, length);
+        result = scripting_addition_acknowledge(id, message[1], start);
+    });
+
+    return result;
+}
+
+bool scripting_addition_request(struct osax_op *op)
+{
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+    osax_encode_op(&writer, op);
+
+    return scripting_addition_request_message(bytes, writer.length);
+}
+
+bool scripting_addition_request_transaction(struct osax_op *ops, int count)
+{
+    if (count <= 0 || count > UINT16_MAX) return false;
+
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+    osax_encode_transaction(&writer, ops, count);
+    if (writer.overflow) return false;
+
+    debug("%s: %d ops (%d bytes)\n", __FUNCTION__, count, writer.length);
+    return scripting_addition_request_message(bytes, writer.length);
+}
+
+void scripting_addition_disconnect(void)
+{
+    dispatch_async(scripting_addition_queue(), ^{
+        scripting_addition_close_connection();
+    });
+}
+
+static bool scripting_addition_request_handshake(char *version, uint32_t *attrib)
+{
+    __block bool result = false;
+    dispatch_sync(scripting_addition_queue(), ^{
+        result = sa_sockfd != -1 || scripting_addition_open_connection();
+        if (result) {
+            memcpy(version, sa_version, sizeof(sa_version));
+            *attrib = sa_attrib;
+        }
+    });
+
+    //
+    // An outdated payload does not understand the binary handshake. ask for
+    // its version the old way, so that we can report it.
+    //
+
+    return result || scripting_addition_request_legacy_handshake(version, attrib);
+}
+
 static int scripting_addition_perform_validation(bool loaded)
 {
     uint32_t attrib = 0;
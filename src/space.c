@@ -1,6 +1,7 @@
 #include "space.h"
 
 extern int g_connection;
+extern struct space_manager g_space_manager;
 
 CFStringRef space_display_uuid(uint64_t sid)
 {
@@ -9,6 +10,9 @@ CFStringRef space_display_uuid(uint64_t sid)
 
 uint32_t space_display_id(uint64_t sid)
 {
+    struct topology_space *space = topology_find_space(&g_space_manager.topology, sid);
+    if (space && space->did) return space->did;
+
     CFStringRef uuid_string = space_display_uuid(sid);
     if (!uuid_string) return 0;
 
@@ -21,16 +25,14 @@ uint32_t space_display_id(uint64_t sid)
     return id;
 }
 
-uint32_t *space_window_list_for_connection(uint64_t sid, int cid, int *count)
+static uint32_t *space_window_list_for_space_list(CFArrayRef space_list_ref, int cid, int *count)
 {
     uint32_t *window_list = NULL;
     uint64_t set_tags = 0;
     uint64_t clear_tags = 0;
 
-    CFNumberRef space_id_ref = CFNumberCreate(NULL, kCFNumberSInt32Type, &sid);
-    CFArrayRef space_list_ref = CFArrayCreate(NULL, (void *)&space_id_ref, 1, NULL);
     CFArrayRef window_list_ref = SLSCopyWindowsWithOptionsAndTags(g_connection, cid, space_list_ref, 0x2, &set_tags, &clear_tags);
-    if (!window_list_ref) goto err;
+    if (!window_list_ref) return NULL;
 
     *count = CFArrayGetCount(window_list_ref);
     if (!*count) goto out;
@@ -44,12 +46,47 @@ uint32_t *space_window_list_for_connection(uint64_t sid, int cid, int *count)
 
 out:
     CFRelease(window_list_ref);
-err:
+    return window_list;
+}
+
+uint32_t *space_window_list_for_connection(uint64_t sid, int cid, int *count)
+{
+    CFNumberRef space_id_ref = CFNumberCreate(NULL, kCFNumberSInt32Type, &sid);
+    CFArrayRef space_list_ref = CFArrayCreate(NULL, (void *)&space_id_ref, 1, NULL);
+    uint32_t *window_list = space_window_list_for_space_list(space_list_ref, cid, count);
+
     CFRelease(space_list_ref);
     CFRelease(space_id_ref);
     return window_list;
 }
 
+//
+// Enumerate the windows of several spaces with a single SkyLight request. A
+// window that is present on more than one of the given spaces (sticky) is only
+// reported once.
+//
+
+uint32_t *space_window_list_for_spaces(uint64_t *space_list, int space_count, int *count)
+{
+    if (!space_list || !space_count) return NULL;
+
+    CFNumberRef *space_id_refs = malloc(space_count * sizeof(CFNumberRef));
+    for (int i = 0; i < space_count; ++i) {
+        space_id_refs[i] = CFNumberCreate(NULL, kCFNumberSInt64Type, &space_list[i]);
+    }
+
+    CFArrayRef space_list_ref = CFArrayCreate(NULL, (void *)space_id_refs, space_count, &kCFTypeArrayCallBacks);
+    uint32_t *window_list = space_window_list_for_space_list(space_list_ref, 0, count);
+    CFRelease(space_list_ref);
+
+    for (int i = 0; i < space_count; ++i) {
+        CFRelease(space_id_refs[i]);
+    }
+
+    free(space_id_refs);
+    return window_list;
+}
+
 uint32_t *space_window_list(uint64_t sid, int *count)
 {
     return space_window_list_for_connection(sid, 0, count);
@@ -62,7 +99,8 @@ CFStringRef space_uuid(uint64_t sid)
 
 int space_type(uint64_t sid)
 {
-    return SLSSpaceGetType(g_connection, sid);
+    struct topology_space *space = topology_find_space(&g_space_manager.topology, sid);
+    return space ? space->type : SLSSpaceGetType(g_connection, sid);
 }
 
 bool space_is_user(uint64_t sid)
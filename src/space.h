@@ -10,6 +10,7 @@ CFStringRef space_display_uuid(uint64_t sid);
 uint32_t space_display_id(uint64_t sid);
 uint32_t *space_window_list_for_connection(uint64_t sid, int cid, int *count);
 uint32_t *space_window_list(uint64_t sid, int *count);
+uint32_t *space_window_list_for_spaces(uint64_t *space_list, int space_count, int *count);
 CFStringRef space_uuid(uint64_t sid);
 int space_type(uint64_t sid);
 bool space_is_user(uint64_t sid);
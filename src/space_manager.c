@@ -1,7 +1,7 @@
 #include "space_manager.h"
 
+extern struct event_loop g_event_loop;
 extern struct window_manager g_window_manager;
-extern char g_sa_socket_file[MAXLEN];
 extern int g_connection;
 
 static TABLE_HASH_FUNC(hash_view)
@@ -296,6 +296,22 @@ void space_manager_set_layout_for_all_spaces(struct space_manager *sm, enum view
         } \
     }
 
+void space_manager_set_pixel_snap_for_all_spaces(struct space_manager *sm, bool pixel_snap)
+{
+    sm->pixel_snap = pixel_snap;
+    for (int i = 0; i < sm->view.capacity; ++i) {
+        struct bucket *bucket = sm->view.buckets[i];
+        while (bucket) {
+            if (bucket->value) {
+                struct view *view = bucket->value;
+                view_update(view);
+                view_flush(view);
+            }
+            bucket = bucket->next;
+        }
+    }
+}
+
 void space_manager_set_window_gap_for_all_spaces(struct space_manager *sm, int window_gap)
 {
     VIEW_SET_PROPERTY(window_gap);
@@ -427,151 +443,45 @@ void space_manager_toggle_window_split(struct space_manager *sm, struct window *
 
 int space_manager_mission_control_index(uint64_t sid)
 {
-    uint64_t result = 0;
-    int desktop_cnt = 1;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        int spaces_count = CFArrayGetCount(spaces_ref);
-
-        for (int j = 0; j < spaces_count; ++j) {
-            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
-            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &result);
-            if (sid == result) goto out;
-
-            ++desktop_cnt;
-        }
-    }
-
-    desktop_cnt = 0;
-out:
-    CFRelease(display_spaces_ref);
-    return desktop_cnt;
+    struct topology_space *space = topology_find_space(&g_space_manager.topology, sid);
+    return space ? space->mission_control_index : 0;
 }
 
 uint64_t space_manager_mission_control_space(int desktop_id)
 {
-    uint64_t result = 0;
-    int desktop_cnt = 1;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        int spaces_count = CFArrayGetCount(spaces_ref);
-
-        for (int j = 0; j < spaces_count; ++j) {
-            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
-            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &result);
-            if (desktop_cnt == desktop_id) goto out;
-
-            ++desktop_cnt;
-        }
-    }
-
-    result = 0;
-out:
-    CFRelease(display_spaces_ref);
-    return result;
+    struct topology_space *space = topology_find_space_at_index(&g_space_manager.topology, desktop_id);
+    return space ? space->sid : 0;
 }
 
 uint64_t space_manager_prev_space(uint64_t sid)
 {
-    uint64_t p_sid = 0;
-    uint64_t n_sid = 0;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        int spaces_count = CFArrayGetCount(spaces_ref);
-
-        for (int j = 0; j < spaces_count; ++j) {
-            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
-            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &n_sid);
-            if (n_sid == sid) goto out;
-
-            p_sid = n_sid;
-        }
-    }
+    struct topology_space *space = topology_find_space(&g_space_manager.topology, sid);
+    if (!space) return 0;
 
-out:
-    CFRelease(display_spaces_ref);
-    return p_sid != sid ? p_sid : 0;
+    struct topology_space *prev = topology_find_space_at_index(&g_space_manager.topology, space->mission_control_index - 1);
+    return prev ? prev->sid : 0;
 }
 
 uint64_t space_manager_next_space(uint64_t sid)
 {
-    uint64_t n_sid = 0;
-    bool found_sid = false;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    for (int i = 0; i < display_spaces_count; ++i) {
-        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
-        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-        int spaces_count = CFArrayGetCount(spaces_ref);
-
-        for (int j = 0; j < spaces_count; ++j) {
-            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
-            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &n_sid);
-            if (found_sid) goto out;
-
-            found_sid = n_sid == sid;
-        }
-    }
+    struct topology_space *space = topology_find_space(&g_space_manager.topology, sid);
+    if (!space) return 0;
 
-out:
-    CFRelease(display_spaces_ref);
-    return n_sid != sid ? n_sid : 0;
+    struct topology_space *next = topology_find_space_at_index(&g_space_manager.topology, space->mission_control_index + 1);
+    return next ? next->sid : 0;
 }
 
 uint64_t space_manager_first_space(void)
 {
-    uint64_t sid = 0;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, 0);
-    CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-
-    CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, 0);
-    CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-    CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &sid);
-
-    CFRelease(display_spaces_ref);
-    return sid;
+    struct topology_space *space = topology_find_space_at_index(&g_space_manager.topology, 1);
+    return space ? space->sid : 0;
 }
 
 uint64_t space_manager_last_space(void)
 {
-    uint64_t sid = 0;
-
-    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
-    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
-
-    CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, display_spaces_count-1);
-    CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
-    int spaces_count = CFArrayGetCount(spaces_ref);
-
-    CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, spaces_count-1);
-    CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
-    CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &sid);
-
-    CFRelease(display_spaces_ref);
-    return sid;
+    int count = topology_space_count(&g_space_manager.topology);
+    struct topology_space *space = topology_find_space_at_index(&g_space_manager.topology, count);
+    return space ? space->sid : 0;
 }
 
 uint64_t space_manager_active_space(void)
@@ -604,6 +514,9 @@ void space_manager_move_window_to_space(uint64_t sid, struct window *window)
     SLSMoveWindowsToManagedSpace(g_connection, window_list_ref, sid);
     CFRelease(window_list_ref);
     CFRelease(window_id_ref);
+    event_memo_clear(&g_event_loop.memo);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+    space_membership_move_window(&g_space_manager.membership, sid, window->id);
 }
 
 void space_manager_remove_window_from_space(uint64_t sid, struct window *window)
@@ -617,6 +530,9 @@ void space_manager_remove_window_from_space(uint64_t sid, struct window *window)
     CFRelease(space_id_ref);
     CFRelease(window_list_ref);
     CFRelease(window_id_ref);
+    event_memo_clear(&g_event_loop.memo);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+    space_membership_remove_window_from_space(&g_space_manager.membership, sid, window->id);
 }
 
 void space_manager_add_window_to_space(uint64_t sid, struct window *window)
@@ -630,43 +546,36 @@ void space_manager_add_window_to_space(uint64_t sid, struct window *window)
     CFRelease(space_id_ref);
     CFRelease(window_list_ref);
     CFRelease(window_id_ref);
+    event_memo_clear(&g_event_loop.memo);
+    spatial_index_mark_dirty(&g_window_manager.spatial_index);
+    space_membership_add_window(&g_space_manager.membership, sid, window->id);
 }
 
 void space_manager_focus_space(uint64_t sid)
 {
-    int sockfd;
-    char message[MAXLEN];
-
     uint64_t cur_sid = space_manager_active_space();
     uint32_t cur_did = space_display_id(cur_sid);
     uint32_t new_did = space_display_id(sid);
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "space %lld", sid);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_FOCUS, .space = { sid } };
+    if (scripting_addition_request(&op)) {
+        event_memo_clear(&g_event_loop.memo);
 
         if (cur_did != new_did) {
             display_manager_focus_display(new_did);
         }
     }
-    socket_close(sockfd);
 }
 
 void space_manager_move_space_after_space(uint64_t src_sid, uint64_t dst_sid, bool focus)
 {
-    int sockfd;
-    char message[MAXLEN];
-
     if (!src_sid) return;
     if (!dst_sid) return;
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "space_move %lld %lld %d", src_sid, dst_sid, focus);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
-    }
-    socket_close(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_MOVE, .space_move = { src_sid, dst_sid, focus } };
+    scripting_addition_request(&op);
+    topology_mark_dirty(&g_space_manager.topology);
+    event_memo_clear(&g_event_loop.memo);
 }
 
 static inline bool
@@ -692,25 +601,37 @@ space_manager_is_space_last_user_space(uint64_t sid)
     return result;
 }
 
-enum space_op_error space_manager_move_space_to_display(struct space_manager *sm, uint64_t sid, uint32_t did)
+static enum space_op_error space_manager_check_move_space_to_display(uint64_t sid, uint32_t did, uint64_t *d_sid)
 {
-    int sockfd;
-    uint64_t d_sid;
-    char message[MAXLEN];
-
     if (!sid) return SPACE_OP_ERROR_MISSING_SRC;
     if (space_display_id(sid) == did) return SPACE_OP_ERROR_INVALID_DST;
     if (space_manager_is_space_last_user_space(sid)) return SPACE_OP_ERROR_INVALID_SRC;
 
-    d_sid = display_space_id(did);
-    if (!d_sid) return SPACE_OP_ERROR_MISSING_DST;
+    *d_sid = display_space_id(did);
+    if (!*d_sid) return SPACE_OP_ERROR_MISSING_DST;
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "space_move %lld %lld 1", sid, d_sid);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
-    }
-    socket_close(sockfd);
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+static enum space_op_error space_manager_check_destroy_space(uint64_t sid)
+{
+    if (!sid) return SPACE_OP_ERROR_MISSING_SRC;
+    if (!space_is_user(sid)) return SPACE_OP_ERROR_INVALID_TYPE;
+    if (space_manager_is_space_last_user_space(sid)) return SPACE_OP_ERROR_INVALID_SRC;
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+enum space_op_error space_manager_move_space_to_display(struct space_manager *sm, uint64_t sid, uint32_t did)
+{
+    uint64_t d_sid;
+    enum space_op_error result = space_manager_check_move_space_to_display(sid, did, &d_sid);
+    if (result != SPACE_OP_ERROR_SUCCESS) return result;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_MOVE, .space_move = { sid, d_sid, 1 } };
+    scripting_addition_request(&op);
+    topology_mark_dirty(&g_space_manager.topology);
+    event_memo_clear(&g_event_loop.memo);
 
     space_manager_mark_view_invalid(sm, sid);
     space_manager_focus_space(sid);
@@ -720,36 +641,301 @@ enum space_op_error space_manager_move_space_to_display(struct space_manager *sm
 
 enum space_op_error space_manager_destroy_space(uint64_t sid)
 {
-    int sockfd;
-    char message[MAXLEN];
+    enum space_op_error result = space_manager_check_destroy_space(sid);
+    if (result != SPACE_OP_ERROR_SUCCESS) return result;
 
-    if (!sid) return SPACE_OP_ERROR_MISSING_SRC;
-    if (!space_is_user(sid)) return SPACE_OP_ERROR_INVALID_TYPE;
-    if (space_manager_is_space_last_user_space(sid)) return SPACE_OP_ERROR_INVALID_SRC;
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_DESTROY, .space = { sid } };
+    scripting_addition_request(&op);
+    topology_mark_dirty(&g_space_manager.topology);
+    space_membership_remove_space(&g_space_manager.membership, sid);
+    event_memo_clear(&g_event_loop.memo);
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+void space_manager_add_space(uint64_t sid)
+{
+    if (!sid) return;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_CREATE, .space = { sid } };
+    scripting_addition_request(&op);
+    topology_mark_dirty(&g_space_manager.topology);
+    event_memo_clear(&g_event_loop.memo);
+}
+
+//
+// A transaction collects space operations and sends them to the scripting
+// addition as a single frame, which the Dock applies back to back. nothing is
+// applied until the transaction is committed, so every operation is validated
+// against a scratch copy of the topology that is updated as operations are
+// queued; a space that an earlier operation has destroyed can no longer be
+// acted on, and the last user space of a display is still the last one after
+// another space has been moved away or destroyed. spaces created by the
+// transaction have no id yet and are kept with sid 0.
+//
+
+void space_manager_transaction_begin(struct space_transaction *transaction)
+{
+    memset(transaction, 0, sizeof(struct space_transaction));
+
+    int count = topology_space_count(&g_space_manager.topology);
+    for (int i = 1; i <= count; ++i) {
+        struct topology_space *space = topology_find_space_at_index(&g_space_manager.topology, i);
+        if (space) buf_push(transaction->spaces, *space);
+    }
+}
+
+void space_manager_transaction_end(struct space_transaction *transaction)
+{
+    for (int i = 0; i < buf_len(transaction->labels); ++i) {
+        free(transaction->labels[i].label);
+    }
+
+    buf_free(transaction->ops);
+    buf_free(transaction->spaces);
+    buf_free(transaction->labels);
+}
+
+static int space_transaction_find_space(struct space_transaction *transaction, uint64_t sid)
+{
+    if (!sid) return -1;
+
+    for (int i = 0; i < buf_len(transaction->spaces); ++i) {
+        if (transaction->spaces[i].sid == sid) return i;
+    }
+
+    return -1;
+}
+
+static bool space_transaction_is_last_user_space(struct space_transaction *transaction, int index)
+{
+    struct topology_space *space = &transaction->spaces[index];
+
+    for (int i = 0; i < buf_len(transaction->spaces); ++i) {
+        if (i == index) continue;
+        if (transaction->spaces[i].did == space->did && transaction->spaces[i].type == 0) return false;
+    }
+
+    return true;
+}
+
+static void space_transaction_remove_space(struct space_transaction *transaction, int index)
+{
+    int count = buf_len(transaction->spaces);
+    memmove(transaction->spaces + index, transaction->spaces + index + 1, (count - index - 1) * sizeof(struct topology_space));
+    buf__hdr(transaction->spaces)->len--;
+}
+
+static void space_transaction_insert_space(struct space_transaction *transaction, int index, struct topology_space space)
+{
+    buf_push(transaction->spaces, space);
+    int count = buf_len(transaction->spaces);
+    memmove(transaction->spaces + index + 1, transaction->spaces + index, (count - index - 1) * sizeof(struct topology_space));
+    transaction->spaces[index] = space;
+}
+
+static void space_transaction_move_space(struct space_transaction *transaction, int src_index, int dst_index)
+{
+    struct topology_space space = transaction->spaces[src_index];
+    space.did = transaction->spaces[dst_index].did;
+
+    space_transaction_remove_space(transaction, src_index);
+    if (src_index < dst_index) --dst_index;
+
+    space_transaction_insert_space(transaction, dst_index + 1, space);
+}
+
+uint64_t space_manager_transaction_prev_space(struct space_transaction *transaction, uint64_t sid)
+{
+    int index = space_transaction_find_space(transaction, sid);
+    return index > 0 ? transaction->spaces[index-1].sid : 0;
+}
+
+uint64_t space_manager_transaction_next_space(struct space_transaction *transaction, uint64_t sid)
+{
+    int index = space_transaction_find_space(transaction, sid);
+    return index != -1 && index + 1 < buf_len(transaction->spaces) ? transaction->spaces[index+1].sid : 0;
+}
+
+enum space_op_error space_manager_transaction_focus_space(struct space_transaction *transaction, uint64_t sid)
+{
+    if (space_transaction_find_space(transaction, sid) == -1) return SPACE_OP_ERROR_MISSING_SRC;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_FOCUS, .space = { sid } };
+    buf_push(transaction->ops, op);
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+enum space_op_error space_manager_transaction_move_space_after_space(struct space_transaction *transaction, uint64_t src_sid, uint64_t dst_sid, bool focus)
+{
+    int src_index = space_transaction_find_space(transaction, src_sid);
+    if (src_index == -1) return SPACE_OP_ERROR_MISSING_SRC;
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "space_destroy %lld", sid);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    int dst_index = space_transaction_find_space(transaction, dst_sid);
+    if (dst_index == -1) return SPACE_OP_ERROR_MISSING_DST;
+
+    if (transaction->spaces[src_index].did != transaction->spaces[dst_index].did &&
+        space_transaction_is_last_user_space(transaction, src_index)) {
+        return SPACE_OP_ERROR_INVALID_SRC;
     }
-    socket_close(sockfd);
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_MOVE, .space_move = { src_sid, dst_sid, focus } };
+    buf_push(transaction->ops, op);
+    space_transaction_move_space(transaction, src_index, dst_index);
 
     return SPACE_OP_ERROR_SUCCESS;
 }
 
-void space_manager_add_space(uint64_t sid)
+enum space_op_error space_manager_transaction_move_space_to_display(struct space_transaction *transaction, uint64_t sid, uint32_t did)
 {
-    int sockfd;
-    char message[MAXLEN];
+    int src_index = space_transaction_find_space(transaction, sid);
+    if (src_index == -1) return SPACE_OP_ERROR_MISSING_SRC;
+    if (transaction->spaces[src_index].did == did) return SPACE_OP_ERROR_INVALID_DST;
+    if (space_transaction_is_last_user_space(transaction, src_index)) return SPACE_OP_ERROR_INVALID_SRC;
+
+    //
+    // The space is placed after the active space of the display, unless the
+    // transaction has destroyed that space, in which case it goes after the
+    // last space of the display that has an id.
+    //
+
+    int dst_index = space_transaction_find_space(transaction, display_space_id(did));
+    if (dst_index == -1) {
+        for (int i = 0; i < buf_len(transaction->spaces); ++i) {
+            if (transaction->spaces[i].did == did && transaction->spaces[i].sid) dst_index = i;
+        }
+    }
 
-    if (!sid) return;
+    if (dst_index == -1) return SPACE_OP_ERROR_MISSING_DST;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_MOVE, .space_move = { sid, transaction->spaces[dst_index].sid, 1 } };
+    buf_push(transaction->ops, op);
+    space_transaction_move_space(transaction, src_index, dst_index);
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "space_create %lld", sid);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    return space_manager_transaction_focus_space(transaction, sid);
+}
+
+enum space_op_error space_manager_transaction_destroy_space(struct space_transaction *transaction, uint64_t sid)
+{
+    int index = space_transaction_find_space(transaction, sid);
+    if (index == -1) return SPACE_OP_ERROR_MISSING_SRC;
+    if (transaction->spaces[index].type != 0) return SPACE_OP_ERROR_INVALID_TYPE;
+    if (space_transaction_is_last_user_space(transaction, index)) return SPACE_OP_ERROR_INVALID_SRC;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_DESTROY, .space = { sid } };
+    buf_push(transaction->ops, op);
+    space_transaction_remove_space(transaction, index);
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+enum space_op_error space_manager_transaction_add_space(struct space_transaction *transaction, uint64_t sid)
+{
+    int index = space_transaction_find_space(transaction, sid);
+    if (index == -1) return SPACE_OP_ERROR_MISSING_SRC;
+
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_CREATE, .space = { sid } };
+    buf_push(transaction->ops, op);
+
+    //
+    // The Dock appends the new space to the display of the given space.
+    //
+
+    uint32_t did = transaction->spaces[index].did;
+    int last_index = index;
+    for (int i = index + 1; i < buf_len(transaction->spaces); ++i) {
+        if (transaction->spaces[i].did == did) last_index = i;
+    }
+
+    struct topology_space space = { .sid = 0, .did = did, .type = 0 };
+    space_transaction_insert_space(transaction, last_index + 1, space);
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+enum space_op_error space_manager_transaction_label_space(struct space_transaction *transaction, uint64_t sid, char *label)
+{
+    if (space_transaction_find_space(transaction, sid) == -1) {
+        free(label);
+        return SPACE_OP_ERROR_MISSING_SRC;
     }
-    socket_close(sockfd);
+
+    buf_push(transaction->labels, ((struct space_label) {
+        .sid   = sid,
+        .label = label
+    }));
+
+    return SPACE_OP_ERROR_SUCCESS;
+}
+
+bool space_manager_commit_transaction(struct space_manager *sm, struct space_transaction *transaction)
+{
+    struct osax_op *ops = transaction->ops;
+    int count = buf_len(ops);
+    bool result = true;
+
+    if (count) {
+        uint32_t cur_did = space_display_id(space_manager_active_space());
+        uint64_t focus_sid = 0;
+
+        result = scripting_addition_request_transaction(ops, count);
+        topology_mark_dirty(&sm->topology);
+        space_membership_mark_dirty(&sm->membership);
+        event_memo_clear(&g_event_loop.memo);
+
+        for (int i = 0; i < count; ++i) {
+            if (ops[i].opcode == OSAX_OP_SPACE_MOVE) {
+                space_manager_mark_view_invalid(sm, ops[i].space_move.src_sid);
+            } else if (ops[i].opcode == OSAX_OP_SPACE_FOCUS) {
+                focus_sid = ops[i].space.sid;
+            } else if (ops[i].opcode == OSAX_OP_SPACE_DESTROY) {
+                space_membership_remove_space(&sm->membership, ops[i].space.sid);
+            }
+        }
+
+        if (result && focus_sid) {
+            uint32_t new_did = space_display_id(focus_sid);
+            if (cur_did != new_did) display_manager_focus_display(new_did);
+        }
+
+        sm->transaction_settle_time = CFAbsoluteTimeGetCurrent() + SPACE_TRANSACTION_SETTLE_TIME;
+        sm->transaction_reconciled = false;
+    }
+
+    //
+    // Labels are kept by yabai rather than the Dock, so they are applied once
+    // the Dock has accepted the operations, in the order they were given.
+    //
+
+    if (result) {
+        for (int i = 0; i < buf_len(transaction->labels); ++i) {
+            space_manager_set_label_for_space(sm, transaction->labels[i].sid, transaction->labels[i].label);
+        }
+        buf_free(transaction->labels);
+        transaction->labels = NULL;
+    }
+
+    return result;
+}
+
+//
+// The Dock reports every step of a transaction as its own space change. the
+// first notification after a commit is handled as usual and reconciles the
+// final state; those that follow shortly after and still report the space that
+// we have already reconciled are dropped.
+//
+
+bool space_manager_coalesce_space_change(struct space_manager *sm, uint64_t sid)
+{
+    if (CFAbsoluteTimeGetCurrent() >= sm->transaction_settle_time) return false;
+
+    if (!sm->transaction_reconciled) {
+        sm->transaction_reconciled = true;
+        return false;
+    }
+
+    return sid == sm->current_space_id;
 }
 
 void space_manager_assign_process_to_space(pid_t pid, uint64_t sid)
@@ -820,20 +1006,74 @@ void space_manager_mark_spaces_invalid(struct space_manager *sm)
     free(display_list);
 }
 
-bool space_manager_refresh_application_windows(struct space_manager *sm)
+static struct application *space_manager_find_window_owner(uint32_t wid)
 {
-    int window_count = g_window_manager.window.count;
-    for (int i = 0; i < g_window_manager.application.capacity; ++i) {
-        struct bucket *bucket = g_window_manager.application.buckets[i];
-        while (bucket) {
-            if (bucket->value) {
-                struct application *application = bucket->value;
-                window_manager_add_application_windows(sm, &g_window_manager, application);
+    int wcid = 0;
+    pid_t pid = 0;
+
+    if (SLSGetWindowOwner(g_connection, wid, &wcid) != kCGErrorSuccess) return NULL;
+    if (SLSConnectionGetPID(wcid, &pid) != kCGErrorSuccess) return NULL;
+
+    return window_manager_find_application(&g_window_manager, pid);
+}
+
+static void space_manager_find_unknown_window_owners(uint64_t *space_list, int space_count, struct application ***application_list)
+{
+    int window_count = 0;
+    uint32_t *window_list = space_window_list_for_spaces(space_list, space_count, &window_count);
+    if (!window_list) return;
+
+    for (int i = 0; i < window_count; ++i) {
+        if (window_manager_find_window(&g_window_manager, window_list[i])) continue;
+
+        struct application *application = space_manager_find_window_owner(window_list[i]);
+        if (!application) continue;
+
+        bool found = false;
+        for (int j = 0; j < buf_len(*application_list); ++j) {
+            if ((*application_list)[j] == application) {
+                found = true;
+                break;
             }
-            bucket = bucket->next;
         }
+
+        if (!found) buf_push(*application_list, application);
     }
 
+    free(window_list);
+}
+
+//
+// Windows that appeared while their space was not visible are discovered by comparing
+// the window list of the visible spaces against our registry. Only applications that
+// own an unknown window id are asked for their window list.
+//
+
+bool space_manager_refresh_application_windows(struct space_manager *sm)
+{
+    uint32_t display_count = 0;
+    uint32_t *display_list = display_manager_active_display_list(&display_count);
+    if (!display_list) return false;
+
+    uint64_t *space_list = malloc(display_count * sizeof(uint64_t));
+    for (int i = 0; i < display_count; ++i) {
+        space_list[i] = display_space_id(display_list[i]);
+    }
+
+    struct application **application_list = NULL;
+    space_manager_find_unknown_window_owners(space_list, display_count, &application_list);
+
+    int window_count = g_window_manager.window.count;
+    for (int i = 0; i < buf_len(application_list); ++i) {
+        window_manager_add_application_windows(sm, &g_window_manager, application_list[i]);
+    }
+
+    debug("%s: queried %d of %d applications\n", __FUNCTION__, (int) buf_len(application_list), g_window_manager.application.count);
+
+    buf_free(application_list);
+    free(space_list);
+    free(display_list);
+
     return window_count != g_window_manager.window.count;
 }
 
@@ -842,10 +1082,15 @@ void space_manager_init(struct space_manager *sm)
     sm->layout = VIEW_FLOAT;
     sm->split_ratio = 0.5f;
     sm->auto_balance = false;
+    sm->pixel_snap = false;
     sm->window_placement = CHILD_SECOND;
     sm->labels = NULL;
+    sm->transaction_settle_time = 0;
+    sm->transaction_reconciled = true;
 
     table_init(&sm->view, 23, hash_view, compare_view);
+    topology_init(&sm->topology);
+    space_membership_init(&sm->membership);
 
     uint32_t display_count;
     uint32_t *display_list = display_manager_active_display_list(&display_count);
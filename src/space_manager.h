@@ -10,15 +10,26 @@ extern void SLSRemoveWindowsFromSpaces(int cid, CFArrayRef window_list, CFArrayR
 extern void SLSAddWindowsToSpaces(int cid, CFArrayRef window_list, CFArrayRef space_list);
 extern CGError CoreDockSendNotification(CFStringRef notification, int unknown);
 
+#define SPACE_TRANSACTION_SETTLE_TIME 1.0
+
 struct space_label
 {
     uint64_t sid;
     char *label;
 };
 
+struct space_transaction
+{
+    struct osax_op *ops;
+    struct topology_space *spaces;
+    struct space_label *labels;
+};
+
 struct space_manager
 {
     struct table view;
+    struct topology topology;
+    struct space_membership membership;
     uint64_t current_space_id;
     uint64_t last_space_id;
     bool did_begin;
@@ -31,7 +42,10 @@ struct space_manager
     float split_ratio;
     enum window_node_child window_placement;
     bool auto_balance;
+    bool pixel_snap;
     struct space_label *labels;
+    CFAbsoluteTime transaction_settle_time;
+    bool transaction_reconciled;
 };
 
 enum space_op_error
@@ -75,6 +89,7 @@ void space_manager_toggle_gap_for_space(struct space_manager *sm, uint64_t sid);
 void space_manager_toggle_mission_control(uint64_t sid);
 void space_manager_toggle_show_desktop(uint64_t sid);
 void space_manager_set_layout_for_all_spaces(struct space_manager *sm, enum view_type layout);
+void space_manager_set_pixel_snap_for_all_spaces(struct space_manager *sm, bool pixel_snap);
 void space_manager_set_window_gap_for_all_spaces(struct space_manager *sm, int window_gap);
 void space_manager_set_top_padding_for_all_spaces(struct space_manager *sm, int top_padding);
 void space_manager_set_bottom_padding_for_all_spaces(struct space_manager *sm, int bottom_padding);
@@ -92,6 +107,18 @@ void space_manager_move_space_after_space(uint64_t src_sid, uint64_t dst_sid, bo
 enum space_op_error space_manager_move_space_to_display(struct space_manager *sm, uint64_t sid, uint32_t did);
 enum space_op_error space_manager_destroy_space(uint64_t sid);
 void space_manager_add_space(uint64_t sid);
+void space_manager_transaction_begin(struct space_transaction *transaction);
+void space_manager_transaction_end(struct space_transaction *transaction);
+uint64_t space_manager_transaction_prev_space(struct space_transaction *transaction, uint64_t sid);
+uint64_t space_manager_transaction_next_space(struct space_transaction *transaction, uint64_t sid);
+enum space_op_error space_manager_transaction_focus_space(struct space_transaction *transaction, uint64_t sid);
+enum space_op_error space_manager_transaction_move_space_after_space(struct space_transaction *transaction, uint64_t src_sid, uint64_t dst_sid, bool focus);
+enum space_op_error space_manager_transaction_move_space_to_display(struct space_transaction *transaction, uint64_t sid, uint32_t did);
+enum space_op_error space_manager_transaction_destroy_space(struct space_transaction *transaction, uint64_t sid);
+enum space_op_error space_manager_transaction_add_space(struct space_transaction *transaction, uint64_t sid);
+enum space_op_error space_manager_transaction_label_space(struct space_transaction *transaction, uint64_t sid, char *label);
+bool space_manager_commit_transaction(struct space_manager *sm, struct space_transaction *transaction);
+bool space_manager_coalesce_space_change(struct space_manager *sm, uint64_t sid);
 void space_manager_assign_process_to_space(pid_t pid, uint64_t sid);
 void space_manager_assign_process_to_all_spaces(pid_t pid);
 bool space_manager_is_window_on_active_space(struct window *window);
@@ -0,0 +1,241 @@
+#include "space_membership.h"
+
+static TABLE_HASH_FUNC(hash_space_membership)
+{
+    unsigned long result = *(uint64_t *) key;
+    result = (result + 0x7ed55d16) + (result << 12);
+    result = (result ^ 0xc761c23c) ^ (result >> 19);
+    result = (result + 0x165667b1) + (result << 5);
+    result = (result + 0xd3a2646c) ^ (result << 9);
+    result = (result + 0xfd7046c5) + (result << 3);
+    result = (result ^ 0xb55a4f09) ^ (result >> 16);
+    return result;
+}
+
+static TABLE_COMPARE_FUNC(compare_space_membership)
+{
+    return *(uint64_t *) key_a == *(uint64_t *) key_b;
+}
+
+static int space_membership_index_of(uint32_t *window_list, uint32_t wid)
+{
+    for (int i = 0; i < buf_len(window_list); ++i) {
+        if (window_list[i] == wid) return i;
+    }
+
+    return -1;
+}
+
+static void space_membership_erase(uint32_t *window_list, int index)
+{
+    int count = buf_len(window_list);
+    memmove(window_list + index, window_list + index + 1, (count - index - 1) * sizeof(uint32_t));
+    buf__hdr(window_list)->len--;
+}
+
+static void space_membership_push_front(uint32_t **window_list, uint32_t wid)
+{
+    buf_push(*window_list, wid);
+
+    int count = buf_len(*window_list);
+    memmove(*window_list + 1, *window_list, (count - 1) * sizeof(uint32_t));
+    (*window_list)[0] = wid;
+}
+
+static inline bool space_membership_entry_is_fresh(struct space_membership_entry *entry, CFAbsoluteTime now)
+{
+    return !entry->is_dirty && (now - entry->verified_at) < SPACE_MEMBERSHIP_VERIFY_INTERVAL;
+}
+
+static bool space_membership_window_list_equals(uint32_t *window_list, uint32_t *space_list, int space_count)
+{
+    if (buf_len(window_list) != space_count) return false;
+
+    for (int i = 0; i < space_count; ++i) {
+        if (window_list[i] != space_list[i]) return false;
+    }
+
+    return true;
+}
+
+//
+// The window-server is the authority on space membership. Between verifications we keep
+// the lists current from the events we receive and the moves we perform ourselves; a
+// mismatch at verification time is counted as drift. The order of the lists is only as
+// good as the last verification, so anything that depends on the stacking order (rank
+// selection, focusing a display) asks the window-server instead.
+//
+
+static struct space_membership_entry *space_membership_verify(struct space_membership *membership, uint64_t sid)
+{
+    struct space_membership_entry *entry = table_find(&membership->space, &sid);
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+    if (entry && space_membership_entry_is_fresh(entry, now)) {
+        ++membership->hit_count;
+        return entry;
+    }
+
+    int window_count = 0;
+    uint32_t *window_list = space_window_list(sid, &window_count);
+    if (!window_list) window_count = 0;
+
+    if (!entry) {
+        entry = malloc(sizeof(struct space_membership_entry));
+        memset(entry, 0, sizeof(struct space_membership_entry));
+        entry->sid = sid;
+        table_add(&membership->space, &entry->sid, entry);
+    } else if (!entry->is_dirty && !space_membership_window_list_equals(entry->window_list, window_list, window_count)) {
+        ++membership->drift_count;
+        debug("%s: space %lld drifted (%lld drifts, %lld hits)\n", __FUNCTION__, sid, membership->drift_count, membership->hit_count);
+    }
+
+    buf_free(entry->window_list);
+    entry->window_list = NULL;
+
+    for (int i = 0; i < window_count; ++i) {
+        buf_push(entry->window_list, window_list[i]);
+    }
+
+    entry->verified_at = now;
+    entry->is_dirty = false;
+
+    free(window_list);
+    return entry;
+}
+
+uint32_t *space_membership_window_list(struct space_membership *membership, uint64_t sid, int *count)
+{
+    struct space_membership_entry *entry = space_membership_verify(membership, sid);
+
+    *count = buf_len(entry->window_list);
+    if (!*count) return NULL;
+
+    uint32_t *window_list = malloc(*count * sizeof(uint32_t));
+    memcpy(window_list, entry->window_list, *count * sizeof(uint32_t));
+
+    return window_list;
+}
+
+uint64_t space_membership_window_space(struct space_membership *membership, uint32_t wid)
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+    for (int i = 0; i < membership->space.capacity; ++i) {
+        struct bucket *bucket = membership->space.buckets[i];
+        while (bucket) {
+            if (bucket->value) {
+                struct space_membership_entry *entry = bucket->value;
+                if (space_membership_entry_is_fresh(entry, now) && space_membership_index_of(entry->window_list, wid) != -1) {
+                    ++membership->hit_count;
+                    return entry->sid;
+                }
+            }
+
+            bucket = bucket->next;
+        }
+    }
+
+    return 0;
+}
+
+void space_membership_add_window(struct space_membership *membership, uint64_t sid, uint32_t wid)
+{
+    struct space_membership_entry *entry = table_find(&membership->space, &sid);
+    if (!entry || entry->is_dirty) return;
+
+    if (space_membership_index_of(entry->window_list, wid) == -1) {
+        space_membership_push_front(&entry->window_list, wid);
+    }
+}
+
+void space_membership_remove_window_from_space(struct space_membership *membership, uint64_t sid, uint32_t wid)
+{
+    struct space_membership_entry *entry = table_find(&membership->space, &sid);
+    if (!entry) return;
+
+    int index = space_membership_index_of(entry->window_list, wid);
+    if (index != -1) space_membership_erase(entry->window_list, index);
+}
+
+void space_membership_remove_window(struct space_membership *membership, uint32_t wid)
+{
+    for (int i = 0; i < membership->space.capacity; ++i) {
+        struct bucket *bucket = membership->space.buckets[i];
+        while (bucket) {
+            if (bucket->value) {
+                struct space_membership_entry *entry = bucket->value;
+                int index = space_membership_index_of(entry->window_list, wid);
+                if (index != -1) space_membership_erase(entry->window_list, index);
+            }
+
+            bucket = bucket->next;
+        }
+    }
+}
+
+void space_membership_move_window(struct space_membership *membership, uint64_t sid, uint32_t wid)
+{
+    space_membership_remove_window(membership, wid);
+    space_membership_add_window(membership, sid, wid);
+}
+
+void space_membership_remove_space(struct space_membership *membership, uint64_t sid)
+{
+    struct space_membership_entry *entry = table_find(&membership->space, &sid);
+    if (!entry) return;
+
+    table_remove(&membership->space, &sid);
+    buf_free(entry->window_list);
+    free(entry);
+}
+
+//
+// Spaces can also disappear without us asking for it, through mission-control or
+// when a display is disconnected, so the entries are checked against the topology.
+//
+
+void space_membership_remove_stale_spaces(struct space_membership *membership, struct topology *topology)
+{
+    uint64_t *stale_list = NULL;
+
+    for (int i = 0; i < membership->space.capacity; ++i) {
+        struct bucket *bucket = membership->space.buckets[i];
+        while (bucket) {
+            if (bucket->value) {
+                struct space_membership_entry *entry = bucket->value;
+                if (!topology_find_space(topology, entry->sid)) buf_push(stale_list, entry->sid);
+            }
+
+            bucket = bucket->next;
+        }
+    }
+
+    for (int i = 0; i < buf_len(stale_list); ++i) {
+        space_membership_remove_space(membership, stale_list[i]);
+    }
+
+    buf_free(stale_list);
+}
+
+void space_membership_mark_dirty(struct space_membership *membership)
+{
+    for (int i = 0; i < membership->space.capacity; ++i) {
+        struct bucket *bucket = membership->space.buckets[i];
+        while (bucket) {
+            if (bucket->value) {
+                struct space_membership_entry *entry = bucket->value;
+                entry->is_dirty = true;
+            }
+
+            bucket = bucket->next;
+        }
+    }
+}
+
+void space_membership_init(struct space_membership *membership)
+{
+    table_init(&membership->space, 23, hash_space_membership, compare_space_membership);
+    membership->hit_count = 0;
+    membership->drift_count = 0;
+}
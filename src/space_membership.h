@@ -0,0 +1,32 @@
+#ifndef SPACE_MEMBERSHIP_H
+#define SPACE_MEMBERSHIP_H
+
+#define SPACE_MEMBERSHIP_VERIFY_INTERVAL 2.0
+
+struct space_membership_entry
+{
+    uint64_t sid;
+    uint32_t *window_list;
+    CFAbsoluteTime verified_at;
+    bool is_dirty;
+};
+
+struct space_membership
+{
+    struct table space;
+    uint64_t hit_count;
+    uint64_t drift_count;
+};
+
+uint32_t *space_membership_window_list(struct space_membership *membership, uint64_t sid, int *count);
+uint64_t space_membership_window_space(struct space_membership *membership, uint32_t wid);
+void space_membership_add_window(struct space_membership *membership, uint64_t sid, uint32_t wid);
+void space_membership_remove_window_from_space(struct space_membership *membership, uint64_t sid, uint32_t wid);
+void space_membership_remove_window(struct space_membership *membership, uint32_t wid);
+void space_membership_move_window(struct space_membership *membership, uint64_t sid, uint32_t wid);
+void space_membership_remove_space(struct space_membership *membership, uint64_t sid);
+void space_membership_remove_stale_spaces(struct space_membership *membership, struct topology *topology);
+void space_membership_mark_dirty(struct space_membership *membership);
+void space_membership_init(struct space_membership *membership);
+
+#endif
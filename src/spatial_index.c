@@ -0,0 +1,155 @@
+#include "spatial_index.h"
+
+extern struct window_manager g_window_manager;
+extern struct space_manager g_space_manager;
+
+static void spatial_index_clear(struct spatial_index *index)
+{
+    buf_free(index->entries);
+    index->entries = NULL;
+
+    for (int i = 0; i < array_count(index->cells); ++i) {
+        buf_free(index->cells[i]);
+        index->cells[i] = NULL;
+    }
+}
+
+static inline int spatial_index_cell_x(struct spatial_index *index, float x)
+{
+    int cell = (int)((x - index->bounds.origin.x) * SPATIAL_INDEX_GRID_SIZE / index->bounds.size.width);
+    return min(max(cell, 0), SPATIAL_INDEX_GRID_SIZE - 1);
+}
+
+static inline int spatial_index_cell_y(struct spatial_index *index, float y)
+{
+    int cell = (int)((y - index->bounds.origin.y) * SPATIAL_INDEX_GRID_SIZE / index->bounds.size.height);
+    return min(max(cell, 0), SPATIAL_INDEX_GRID_SIZE - 1);
+}
+
+static void spatial_index_insert_cells(struct spatial_index *index, int entry_index)
+{
+    CGRect frame = index->entries[entry_index].frame;
+    int min_x = spatial_index_cell_x(index, CGRectGetMinX(frame));
+    int max_x = spatial_index_cell_x(index, CGRectGetMaxX(frame));
+    int min_y = spatial_index_cell_y(index, CGRectGetMinY(frame));
+    int max_y = spatial_index_cell_y(index, CGRectGetMaxY(frame));
+
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            buf_push(index->cells[y*SPATIAL_INDEX_GRID_SIZE + x], entry_index);
+        }
+    }
+}
+
+static void spatial_index_remove_cells(struct spatial_index *index, int entry_index)
+{
+    CGRect frame = index->entries[entry_index].frame;
+    int min_x = spatial_index_cell_x(index, CGRectGetMinX(frame));
+    int max_x = spatial_index_cell_x(index, CGRectGetMaxX(frame));
+    int min_y = spatial_index_cell_y(index, CGRectGetMinY(frame));
+    int max_y = spatial_index_cell_y(index, CGRectGetMaxY(frame));
+
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            int *cell = index->cells[y*SPATIAL_INDEX_GRID_SIZE + x];
+            for (int i = 0; i < buf_len(cell); ++i) {
+                if (cell[i] == entry_index) {
+                    buf_del(cell, i);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void spatial_index_rebuild(struct spatial_index *index)
+{
+    spatial_index_clear(index);
+    index->bounds = CGRectNull;
+    index->is_dirty = false;
+
+    uint32_t display_count = 0;
+    uint32_t *display_list = display_manager_active_display_list(&display_count);
+    if (!display_list) return;
+
+    uint64_t visible_space_list[display_count];
+    for (int i = 0; i < display_count; ++i) {
+        visible_space_list[i] = display_space_id(display_list[i]);
+        index->bounds = CGRectUnion(index->bounds, display_bounds(display_list[i]));
+    }
+
+    free(display_list);
+    if (CGRectIsEmpty(index->bounds)) return;
+
+    //
+    // Windows are taken from the membership index of the visible spaces and their frames
+    // from the property cache, so a rebuild only asks the window server for frames that
+    // are not cached yet. Moved and resized windows are updated in place afterwards.
+    //
+
+    for (int i = 0; i < display_count; ++i) {
+        int window_count;
+        uint32_t *window_list = space_membership_window_list(&g_space_manager.membership, visible_space_list[i], &window_count);
+        if (!window_list) continue;
+
+        for (int j = 0; j < window_count; ++j) {
+            struct window *window = window_manager_find_window(&g_window_manager, window_list[j]);
+            if (!window || window->is_minimized || window->application->is_hidden) continue;
+
+            struct spatial_index_entry entry = { window->id, window_cached_frame(window) };
+            buf_push(index->entries, entry);
+        }
+
+        free(window_list);
+    }
+
+    for (int i = 0; i < buf_len(index->entries); ++i) {
+        spatial_index_insert_cells(index, i);
+    }
+}
+
+int spatial_index_query_point(struct spatial_index *index, CGPoint point, uint32_t filter_wid, uint32_t *wid)
+{
+    if (index->is_dirty) spatial_index_rebuild(index);
+    if (CGRectIsNull(index->bounds) || !CGRectContainsPoint(index->bounds, point)) return 0;
+
+    int *cell = index->cells[spatial_index_cell_y(index, point.y)*SPATIAL_INDEX_GRID_SIZE + spatial_index_cell_x(index, point.x)];
+    int hit_count = 0;
+
+    for (int i = 0; i < buf_len(cell); ++i) {
+        struct spatial_index_entry *entry = &index->entries[cell[i]];
+        if (entry->wid == filter_wid)                 continue;
+        if (!CGRectContainsPoint(entry->frame, point)) continue;
+
+        if (wid) *wid = entry->wid;
+        ++hit_count;
+    }
+
+    return hit_count;
+}
+
+void spatial_index_update_window(struct spatial_index *index, uint32_t wid, CGRect frame)
+{
+    if (index->is_dirty || CGRectIsNull(index->bounds)) return;
+
+    for (int i = 0; i < buf_len(index->entries); ++i) {
+        if (index->entries[i].wid != wid) continue;
+
+        spatial_index_remove_cells(index, i);
+        index->entries[i].frame = frame;
+        spatial_index_insert_cells(index, i);
+        return;
+    }
+}
+
+void spatial_index_mark_dirty(struct spatial_index *index)
+{
+    index->is_dirty = true;
+}
+
+void spatial_index_init(struct spatial_index *index)
+{
+    memset(index, 0, sizeof(struct spatial_index));
+    index->bounds = CGRectNull;
+    index->is_dirty = true;
+}
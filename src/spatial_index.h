@@ -0,0 +1,25 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#define SPATIAL_INDEX_GRID_SIZE 16
+
+struct spatial_index_entry
+{
+    uint32_t wid;
+    CGRect frame;
+};
+
+struct spatial_index
+{
+    struct spatial_index_entry *entries;
+    int *cells[SPATIAL_INDEX_GRID_SIZE*SPATIAL_INDEX_GRID_SIZE];
+    CGRect bounds;
+    bool is_dirty;
+};
+
+int spatial_index_query_point(struct spatial_index *index, CGPoint point, uint32_t filter_wid, uint32_t *wid);
+void spatial_index_update_window(struct spatial_index *index, uint32_t wid, CGRect frame);
+void spatial_index_mark_dirty(struct spatial_index *index);
+void spatial_index_init(struct spatial_index *index);
+
+#endif
@@ -0,0 +1,151 @@
+#include "topology.h"
+
+extern int g_connection;
+
+static TABLE_HASH_FUNC(hash_topology)
+{
+    unsigned long result = *(uint64_t *) key;
+    result = (result + 0x7ed55d16) + (result << 12);
+    result = (result ^ 0xc761c23c) ^ (result >> 19);
+    result = (result + 0x165667b1) + (result << 5);
+    result = (result + 0xd3a2646c) ^ (result << 9);
+    result = (result + 0xfd7046c5) + (result << 3);
+    result = (result ^ 0xb55a4f09) ^ (result >> 16);
+    return result;
+}
+
+static TABLE_COMPARE_FUNC(compare_topology)
+{
+    return *(uint64_t *) key_a == *(uint64_t *) key_b;
+}
+
+static int topology_display_arrangement(CFArrayRef displays, CFStringRef uuid)
+{
+    int displays_count = CFArrayGetCount(displays);
+    for (int i = 0; i < displays_count; ++i) {
+        if (CFEqual(CFArrayGetValueAtIndex(displays, i), uuid)) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+static void topology_rebuild(struct topology *topology)
+{
+    buf_free(topology->displays);
+    buf_free(topology->spaces);
+    table_free(&topology->space);
+
+    topology->displays = NULL;
+    topology->spaces = NULL;
+    topology->is_dirty = false;
+    table_init(&topology->space, 23, hash_topology, compare_topology);
+
+    CFArrayRef display_spaces_ref = SLSCopyManagedDisplaySpaces(g_connection);
+    if (!display_spaces_ref) goto err;
+
+    CFArrayRef displays_ref = SLSCopyManagedDisplays(g_connection);
+    if (!displays_ref) goto out;
+
+    int display_spaces_count = CFArrayGetCount(display_spaces_ref);
+    for (int i = 0; i < display_spaces_count; ++i) {
+        CFDictionaryRef display_ref = CFArrayGetValueAtIndex(display_spaces_ref, i);
+        CFStringRef identifier = CFDictionaryGetValue(display_ref, CFSTR("Display Identifier"));
+        CFArrayRef spaces_ref = CFDictionaryGetValue(display_ref, CFSTR("Spaces"));
+        int spaces_count = CFArrayGetCount(spaces_ref);
+
+        uint32_t did = 0;
+        CFUUIDRef uuid = CFUUIDCreateFromString(NULL, identifier);
+        if (uuid) {
+            did = CGDisplayGetDisplayIDFromUUID(uuid);
+            CFRelease(uuid);
+        } else {
+            did = display_manager_main_display_id();
+        }
+
+        struct topology_display display = {
+            .did = did,
+            .arrangement = topology_display_arrangement(displays_ref, identifier),
+            .first_space = buf_len(topology->spaces),
+            .space_count = spaces_count
+        };
+        buf_push(topology->displays, display);
+
+        for (int j = 0; j < spaces_count; ++j) {
+            CFDictionaryRef space_ref = CFArrayGetValueAtIndex(spaces_ref, j);
+            CFNumberRef sid_ref = CFDictionaryGetValue(space_ref, CFSTR("id64"));
+            CFNumberRef type_ref = CFDictionaryGetValue(space_ref, CFSTR("type"));
+
+            struct topology_space space = {
+                .did = did,
+                .mission_control_index = buf_len(topology->spaces) + 1
+            };
+
+            CFNumberGetValue(sid_ref, CFNumberGetType(sid_ref), &space.sid);
+            if (type_ref) {
+                CFNumberGetValue(type_ref, kCFNumberIntType, &space.type);
+            } else {
+                space.type = SLSSpaceGetType(g_connection, space.sid);
+            }
+
+            buf_push(topology->spaces, space);
+        }
+    }
+
+    //
+    // The stretchy buffer may have moved while it was being filled, so the lookup
+    // table can only point into it once every space has been added.
+    //
+
+    for (int i = 0; i < buf_len(topology->spaces); ++i) {
+        table_add(&topology->space, &topology->spaces[i].sid, &topology->spaces[i]);
+    }
+
+    CFRelease(displays_ref);
+out:
+    CFRelease(display_spaces_ref);
+err:
+    debug("%s: %d displays, %d spaces\n", __FUNCTION__, (int) buf_len(topology->displays), (int) buf_len(topology->spaces));
+}
+
+struct topology_space *topology_find_space(struct topology *topology, uint64_t sid)
+{
+    if (topology->is_dirty) topology_rebuild(topology);
+    return table_find(&topology->space, &sid);
+}
+
+struct topology_space *topology_find_space_at_index(struct topology *topology, int mission_control_index)
+{
+    if (topology->is_dirty) topology_rebuild(topology);
+    if (mission_control_index < 1 || mission_control_index > buf_len(topology->spaces)) return NULL;
+    return &topology->spaces[mission_control_index - 1];
+}
+
+struct topology_display *topology_find_display(struct topology *topology, uint32_t did)
+{
+    if (topology->is_dirty) topology_rebuild(topology);
+    for (int i = 0; i < buf_len(topology->displays); ++i) {
+        if (topology->displays[i].did == did) return &topology->displays[i];
+    }
+
+    return NULL;
+}
+
+int topology_space_count(struct topology *topology)
+{
+    if (topology->is_dirty) topology_rebuild(topology);
+    return buf_len(topology->spaces);
+}
+
+void topology_mark_dirty(struct topology *topology)
+{
+    topology->is_dirty = true;
+}
+
+void topology_init(struct topology *topology)
+{
+    memset(topology, 0, sizeof(struct topology));
+    table_init(&topology->space, 23, hash_topology, compare_topology);
+    topology->is_dirty = true;
+}
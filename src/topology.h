@@ -0,0 +1,35 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+struct topology_space
+{
+    uint64_t sid;
+    uint32_t did;
+    int type;
+    int mission_control_index;
+};
+
+struct topology_display
+{
+    uint32_t did;
+    int arrangement;
+    int first_space;
+    int space_count;
+};
+
+struct topology
+{
+    struct topology_display *displays;
+    struct topology_space *spaces;
+    struct table space;
+    bool is_dirty;
+};
+
+struct topology_space *topology_find_space(struct topology *topology, uint64_t sid);
+struct topology_space *topology_find_space_at_index(struct topology *topology, int mission_control_index);
+struct topology_display *topology_find_display(struct topology *topology, uint32_t did);
+int topology_space_count(struct topology *topology);
+void topology_mark_dirty(struct topology *topology);
+void topology_init(struct topology *topology);
+
+#endif
@@ -38,13 +38,106 @@ static float window_node_get_gap(struct view *view)
     return view->enable_gap ? view->window_gap*0.5f : 0.0f;
 }
 
+static CGSize window_node_min_size(struct view *view, struct window_node *node)
+{
+    if (!node->left && !node->right) {
+        struct window *window = node->window_id ? window_manager_find_window(&g_window_manager, node->window_id) : NULL;
+        if (!window) return CGSizeZero;
+
+        float offset = window_node_border_window_offset(window);
+        return (CGSize) {
+            window->min_size.width  > 0.0f ? window->min_size.width  + 2*offset : 0.0f,
+            window->min_size.height > 0.0f ? window->min_size.height + 2*offset : 0.0f
+        };
+    }
+
+    CGSize left = window_node_min_size(view, node->left);
+    CGSize right = window_node_min_size(view, node->right);
+    float gap = view->enable_gap ? view->window_gap : 0.0f;
+
+    if (node->split == SPLIT_Y) {
+        return (CGSize) { left.width + right.width + gap, max(left.height, right.height) };
+    } else {
+        return (CGSize) { max(left.width, right.width), left.height + right.height + gap };
+    }
+}
+
+static void area_fit_min_size(struct view *view, struct window_node *node, enum window_node_split split)
+{
+    CGSize left_min = window_node_min_size(view, node->left);
+    CGSize right_min = window_node_min_size(view, node->right);
+    float shift = 0.0f;
+
+    //
+    // Move the split edge so that both subtrees get at least the minimum
+    // size their windows are known to accept. If the node is too small to satisfy both,
+    // the left subtree gets what is left over from the right subtree and no more.
+    //
+
+    if (split == SPLIT_Y) {
+        if (node->left->area.w < left_min.width) {
+            shift = min(left_min.width - node->left->area.w, max(0.0f, node->right->area.w - right_min.width));
+        } else if (node->right->area.w < right_min.width) {
+            shift = -min(right_min.width - node->right->area.w, max(0.0f, node->left->area.w - left_min.width));
+        }
+    } else {
+        if (node->left->area.h < left_min.height) {
+            shift = min(left_min.height - node->left->area.h, max(0.0f, node->right->area.h - right_min.height));
+        } else if (node->right->area.h < right_min.height) {
+            shift = -min(right_min.height - node->right->area.h, max(0.0f, node->left->area.h - left_min.height));
+        }
+    }
+
+    if (shift == 0.0f) return;
+    if (g_space_manager.pixel_snap) shift = shift > 0.0f ? ceilf(shift) : floorf(shift);
+
+    if (split == SPLIT_Y) {
+        node->left->area.w  += shift;
+        node->right->area.x += shift;
+        node->right->area.w -= shift;
+    } else {
+        node->left->area.h  += shift;
+        node->right->area.y += shift;
+        node->right->area.h -= shift;
+    }
+}
+
+static void area_make_pair_snapped(struct view *view, struct window_node *node, enum window_node_split split, float ratio)
+{
+    float gap = window_node_get_gap(view);
+
+    node->left->area = node->area;
+    node->right->area = node->area;
+
+    //
+    // Both children are sized from the parent area, which is itself integral,
+    // so every node ends up on whole pixels and repeatedly rotating, mirroring
+    // or balancing a tree can never accumulate any fractional drift. each child
+    // is rounded from its own share rather than from a shared edge, so that a
+    // child keeps its exact size when a rotation or mirror moves it to the other
+    // side of the split; the gap absorbs the rounding and may be a pixel off.
+    //
+
+    if (split == SPLIT_Y) {
+        node->left->area.w = roundf(node->area.w * ratio - gap);
+        node->right->area.w = roundf(node->area.w * (1 - ratio) - gap);
+        node->right->area.x = node->area.x + node->area.w - node->right->area.w;
+    } else {
+        node->left->area.h = roundf(node->area.h * ratio - gap);
+        node->right->area.h = roundf(node->area.h * (1 - ratio) - gap);
+        node->right->area.y = node->area.y + node->area.h - node->right->area.h;
+    }
+}
+
 static void area_make_pair(struct view *view, struct window_node *node)
 {
     enum window_node_split split = window_node_get_split(node);
     float ratio = window_node_get_ratio(node);
     float gap   = window_node_get_gap(view);
 
-    if (split == SPLIT_Y) {
+    if (g_space_manager.pixel_snap) {
+        area_make_pair_snapped(view, node, split, ratio);
+    } else if (split == SPLIT_Y) {
         node->left->area = node->area;
         node->left->area.w *= ratio;
         node->left->area.w -= gap;
@@ -66,7 +159,10 @@ static void area_make_pair(struct view *view, struct window_node *node)
         node->right->area.h -= gap;
     }
 
+    area_fit_min_size(view, node, split);
+
     node->split = split;
+    view->is_adjacency_dirty = true;
     node->ratio = ratio;
 }
 
@@ -152,6 +248,7 @@ static void window_node_split(struct view *view, struct window_node *node, struc
     right->parent = node;
 
     node->window_id = 0;
+    node->applied_window_id = 0;
     node->left = left;
     node->right = right;
 
@@ -188,23 +285,47 @@ float window_node_border_window_offset(struct window *window)
     return 0.0f; // shutup compiler
 }
 
+static inline bool area_is_equal(struct area a, struct area b)
+{
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
 void window_node_flush(struct window_node *node)
 {
-    if (window_node_is_occupied(node)) {
-        struct window *window = window_manager_find_window(&g_window_manager, node->window_id);
-        if (window) {
-            float offset = window_node_border_window_offset(window);
-            if (node->zoom) {
-                window_manager_set_window_frame(window, node->zoom->area.x + offset, node->zoom->area.y + offset, node->zoom->area.w - 2*offset, node->zoom->area.h - 2*offset);
-            } else {
-                window_manager_set_window_frame(window, node->area.x + offset, node->area.y + offset, node->area.w - 2*offset, node->area.h - 2*offset);
-            }
+    struct window_node *last_leaf = window_node_find_last_leaf(node);
+
+    for (struct window_node *leaf = window_node_find_first_leaf(node); leaf; leaf = leaf != last_leaf ? window_node_find_next_leaf(leaf) : NULL) {
+        if (!window_node_is_occupied(leaf)) continue;
+
+        struct window *window = window_manager_find_window(&g_window_manager, leaf->window_id);
+        if (!window) continue;
+
+        float offset = window_node_border_window_offset(window);
+        if (g_space_manager.pixel_snap) offset = floorf(offset);
+
+        struct area area = leaf->zoom ? leaf->zoom->area : leaf->area;
+        area.x += offset;
+        area.y += offset;
+        area.w -= 2*offset;
+        area.h -= 2*offset;
+
+        //
+        // The target frame is integral and only changes when the layout does, so a leaf
+        // that was already given this exact frame does not need the AX writes (or the
+        // moved / resized notifications they cause) again. The cached frame is dropped
+        // as soon as the window is moved or resized by someone other than us.
+        //
+
+        if (g_space_manager.pixel_snap &&
+            leaf->applied_window_id == leaf->window_id &&
+            area_is_equal(leaf->applied_area, area)) {
+            continue;
         }
-    }
 
-    if (!window_node_is_leaf(node)) {
-        window_node_flush(node->left);
-        window_node_flush(node->right);
+        if (window_manager_set_window_frame(window, area.x, area.y, area.w, area.h)) {
+            leaf->applied_area = area;
+            leaf->applied_window_id = leaf->window_id;
+        }
     }
 }
 
@@ -358,6 +479,8 @@ void view_remove_window_node(struct view *view, struct window *window)
                                : parent->right;
 
     parent->window_id = child->window_id;
+    parent->applied_window_id = child->applied_window_id;
+    parent->applied_area = child->applied_area;
     parent->left      = NULL;
     parent->right     = NULL;
 
@@ -374,6 +497,8 @@ void view_remove_window_node(struct view *view, struct window *window)
     free(child);
     free(node);
 
+    view->is_adjacency_dirty = true;
+
     if (g_space_manager.auto_balance) {
         window_node_equalize(view->root);
         view_update(view);
@@ -426,6 +551,63 @@ uint32_t *view_find_window_list(struct view *view)
     return window_list;
 }
 
+static inline int direction_index(int direction)
+{
+    return (direction / 90) % 4;
+}
+
+static inline CGRect area_to_cgrect(struct area area)
+{
+    return (CGRect) { { area.x, area.y }, { area.w, area.h } };
+}
+
+static void view_update_adjacency(struct view *view)
+{
+    static const int direction_list[] = { DIR_NORTH, DIR_EAST, DIR_SOUTH, DIR_WEST };
+    struct window_node **leaf_list = NULL;
+
+    struct window_node *node = window_node_find_first_leaf(view->root);
+    while (node) {
+        buf_push(leaf_list, node);
+        node = window_node_find_next_leaf(node);
+    }
+
+    for (int i = 0; i < buf_len(leaf_list); ++i) {
+        struct window_node *source = leaf_list[i];
+        CGRect source_frame = area_to_cgrect(source->area);
+
+        for (int j = 0; j < array_count(direction_list); ++j) {
+            int direction = direction_list[j];
+            struct window_node *best_node = NULL;
+            uint32_t best_distance = UINT32_MAX;
+
+            for (int k = 0; k < buf_len(leaf_list); ++k) {
+                if (k == i) continue;
+
+                CGRect frame = area_to_cgrect(leaf_list[k]->area);
+                if (!rect_is_in_direction(source_frame, frame, direction)) continue;
+
+                uint32_t distance = rect_distance(source_frame, frame, direction);
+                if (distance < best_distance) {
+                    best_node = leaf_list[k];
+                    best_distance = distance;
+                }
+            }
+
+            source->neighbour[direction_index(direction)] = best_node;
+        }
+    }
+
+    buf_free(leaf_list);
+    view->is_adjacency_dirty = false;
+}
+
+struct window_node *view_find_window_node_in_direction(struct view *view, struct window_node *source, int direction)
+{
+    if (view->is_adjacency_dirty) view_update_adjacency(view);
+    return source->neighbour[direction_index(direction)];
+}
+
 bool view_is_invalid(struct view *view)
 {
     return !view->is_valid;
@@ -453,7 +635,7 @@ void view_serialize(FILE *rsp, struct view *view)
     uint32_t windows[MAXLEN] = {};
 
     int window_count = 0;
-    uint32_t *window_list = space_window_list(view->sid, &window_count);
+    uint32_t *window_list = space_membership_window_list(&g_space_manager.membership, view->sid, &window_count);
     if (window_list) {
         for (int i = 0; i < window_count; ++i) {
             if (window_manager_find_window(&g_window_manager, window_list[i])) {
@@ -510,6 +692,7 @@ void view_update(struct view *view)
 {
     uint32_t did = space_display_id(view->sid);
     CGRect frame = display_bounds_constrained(did);
+    if (g_space_manager.pixel_snap) frame = CGRectIntegral(frame);
     view->root->area = area_from_cgrect(frame);
 
     if (view->enable_padding) {
@@ -522,6 +705,7 @@ void view_update(struct view *view)
     window_node_update(view, view->root);
     view->is_valid = true;
     view->is_dirty = true;
+    view->is_adjacency_dirty = true;
 }
 
 struct view *view_create(uint64_t sid)
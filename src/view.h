@@ -55,6 +55,9 @@ struct window_node
     struct window_node *zoom;
     enum window_node_split split;
     enum window_node_child child;
+    struct window_node *neighbour[4];
+    struct area applied_area;
+    uint32_t applied_window_id;
     int insert_direction;
     float ratio;
 };
@@ -94,6 +97,7 @@ struct view
     bool enable_gap;
     bool is_valid;
     bool is_dirty;
+    bool is_adjacency_dirty;
 };
 
 float window_node_border_window_offset(struct window *window);
@@ -107,6 +111,7 @@ struct window_node *view_find_window_node(struct view *view, uint32_t window_id)
 void view_remove_window_node(struct view *view, struct window *window);
 void view_add_window_node(struct view *view, struct window *window);
 uint32_t *view_find_window_list(struct view *view);
+struct window_node *view_find_window_node_in_direction(struct view *view, struct window_node *source, int direction);
 
 void view_serialize(FILE *rsp, struct view *view);
 bool view_is_invalid(struct view *view);
@@ -1,7 +1,9 @@
 #include "window.h"
 
+extern struct event_loop g_event_loop;
 extern int g_connection;
 extern struct window_manager g_window_manager;
+extern struct space_manager g_space_manager;
 
 int g_normal_window_level;
 int g_floating_window_level;
@@ -49,6 +51,9 @@ CFStringRef window_display_uuid(struct window *window)
 
 int window_display_id(struct window *window)
 {
+    uint64_t memo = 0;
+    if (event_memo_find(&g_event_loop.memo, EVENT_MEMO_WINDOW_DISPLAY, window->id, &memo)) return (int) memo;
+
     CFStringRef uuid_string = window_display_uuid(window);
     if (!uuid_string) return 0;
 
@@ -58,12 +63,15 @@ int window_display_id(struct window *window)
     CFRelease(uuid);
     CFRelease(uuid_string);
 
+    event_memo_store(&g_event_loop.memo, EVENT_MEMO_WINDOW_DISPLAY, window->id, id);
     return id;
 }
 
 uint64_t window_space(struct window *window)
 {
-    uint64_t sid = 0;
+    uint64_t sid = space_membership_window_space(&g_space_manager.membership, window->id);
+    if (sid) return sid;
+
     CFNumberRef window_id_ref = CFNumberCreate(NULL, kCFNumberSInt32Type, &window->id);
     CFArrayRef window_list_ref = CFArrayCreate(NULL, (void *)&window_id_ref, 1, NULL);
     CFArrayRef space_list_ref = SLSCopySpacesForWindows(g_connection, 0x7, window_list_ref);
@@ -107,13 +115,91 @@ err:
     return space_list;
 }
 
+//
+// A property is only marked valid once its value has actually been obtained. a
+// title that could not be read (e.g. because the circuit breaker of the owning
+// application is open), a role that has not settled yet, or a frame or
+// fullscreen state the system failed to report is asked for again next time.
+//
+
+static void window_update_properties(struct window *window)
+{
+    struct window_properties *properties = &window->properties;
+
+    if (!(properties->valid & WINDOW_PROPERTY_TITLE)) {
+        if (properties->title) free(properties->title);
+        properties->title = window_title(window);
+        if (properties->title) properties->valid |= WINDOW_PROPERTY_TITLE;
+    }
+
+    if (!(properties->valid & WINDOW_PROPERTY_FRAME)) {
+        properties->frame = (CGRect) {};
+        if (SLSGetWindowBounds(g_connection, window->id, &properties->frame) == kCGErrorSuccess) {
+            properties->valid |= WINDOW_PROPERTY_FRAME;
+        }
+    }
+
+    if (!(properties->valid & WINDOW_PROPERTY_ROLE)) {
+        if (properties->role) free(properties->role);
+        if (properties->subrole) free(properties->subrole);
+        properties->role = NULL;
+        properties->subrole = NULL;
+
+        CFStringRef cfrole = window_role(window);
+        if (cfrole) {
+            properties->role = cfstring_copy(cfrole);
+            CFRelease(cfrole);
+        }
+
+        CFStringRef cfsubrole = window_subrole(window);
+        if (cfsubrole) {
+            properties->subrole = cfstring_copy(cfsubrole);
+            CFRelease(cfsubrole);
+        }
+
+        properties->can_move = window->can_move;
+        properties->can_resize = window_can_resize(window);
+
+        if (window->ax_role) properties->valid |= WINDOW_PROPERTY_ROLE;
+    }
+
+    if (!(properties->valid & WINDOW_PROPERTY_FULLSCREEN)) {
+        CFTypeRef value = NULL;
+        properties->is_fullscreen = false;
+        if (AXUIElementCopyAttributeValue(window->ref, kAXFullscreenAttribute, &value) == kAXErrorSuccess) {
+            properties->is_fullscreen = CFBooleanGetValue(value);
+            properties->valid |= WINDOW_PROPERTY_FULLSCREEN;
+            CFRelease(value);
+        }
+    }
+}
+
+CGRect window_cached_frame(struct window *window)
+{
+    if (!(window->properties.valid & WINDOW_PROPERTY_FRAME)) {
+        window->properties.frame = (CGRect) {};
+        if (SLSGetWindowBounds(g_connection, window->id, &window->properties.frame) == kCGErrorSuccess) {
+            window->properties.valid |= WINDOW_PROPERTY_FRAME;
+        }
+    }
+
+    return window->properties.frame;
+}
+
+void window_invalidate_properties(struct window *window, uint8_t properties)
+{
+    window->properties.valid &= ~properties;
+}
+
 void window_serialize(FILE *rsp, struct window *window)
 {
-    char *title = window_title(window);
+    window_update_properties(window);
+
+    char *title = window->properties.title;
     char *escaped_title = string_escape_quote(title);
-    CGRect frame = window_frame(window);
-    char *role = NULL;
-    char *subrole = NULL;
+    CGRect frame = window->properties.frame;
+    char *role = window->properties.role;
+    char *subrole = window->properties.subrole;
     bool sticky = window_is_sticky(window);
     uint64_t sid = window_space(window);
     int space = space_manager_mission_control_index(sid);
@@ -121,18 +207,6 @@ void window_serialize(FILE *rsp, struct window *window)
     bool visible = sticky || space_is_visible(sid);
     bool is_topmost = window_is_topmost(window);
 
-    CFStringRef cfrole = window_role(window);
-    if (cfrole) {
-        role = cfstring_copy(cfrole);
-        CFRelease(cfrole);
-    }
-
-    CFStringRef cfsubrole = window_subrole(window);
-    if (cfsubrole) {
-        subrole = cfstring_copy(cfsubrole);
-        CFRelease(cfsubrole);
-    }
-
     struct view *view = window_manager_find_managed_window(&g_window_manager, window);
     struct window_node *node = view ? view_find_window_node(view, window->id) : NULL;
 
@@ -165,7 +239,9 @@ void window_serialize(FILE *rsp, struct window *window)
             "\t\"shadow\":%d,\n"
             "\t\"zoom-parent\":%d,\n"
             "\t\"zoom-fullscreen\":%d,\n"
-            "\t\"native-fullscreen\":%d\n"
+            "\t\"native-fullscreen\":%d,\n"
+            "\t\"ax-state\":\"%s\",\n"
+            "\t\"suppressed-frame-events\":%d\n"
             "}",
             window->id,
             window->application->pid,
@@ -176,8 +252,8 @@ void window_serialize(FILE *rsp, struct window *window)
             window_level(window),
             role ? role : "",
             subrole ? subrole : "",
-            window_can_move(window),
-            window_can_resize(window),
+            window->properties.can_move,
+            window->properties.can_resize,
             display,
             space,
             visible,
@@ -190,11 +266,10 @@ void window_serialize(FILE *rsp, struct window *window)
             window->has_shadow,
             zoom_parent,
             zoom_fullscreen,
-            window_is_fullscreen(window));
+            window->properties.is_fullscreen,
+            ax_breaker_state_str[window->application->ax.state],
+            window->suppressed_frame_events);
 
-    if (subrole) free(subrole);
-    if (role) free(role);
-    if (title) free(title);
     if (escaped_title) free(escaped_title);
 }
 
@@ -206,7 +281,9 @@ char *window_title(struct window *window)
 #if 0
     SLSCopyWindowProperty(g_connection, window->id, CFSTR("kCGSWindowTitle"), &value);
 #else
-    AXUIElementCopyAttributeValue(window->ref, kAXTitleAttribute, &value);
+    CFAbsoluteTime start;
+    if (!application_ax_begin(window->application, window->ref, AX_ACCESS_READ, &start)) return NULL;
+    application_ax_end(window->application, AX_ACCESS_READ, start, AXUIElementCopyAttributeValue(window->ref, kAXTitleAttribute, &value));
 #endif
 
     if (value) {
@@ -223,8 +300,11 @@ CGRect window_ax_frame(struct window *window)
     CFTypeRef position_ref = NULL;
     CFTypeRef size_ref = NULL;
 
+    CFAbsoluteTime start;
+    if (!application_ax_begin(window->application, window->ref, AX_ACCESS_READ, &start)) return frame;
+
     AXUIElementCopyAttributeValue(window->ref, kAXPositionAttribute, &position_ref);
-    AXUIElementCopyAttributeValue(window->ref, kAXSizeAttribute, &size_ref);
+    application_ax_end(window->application, AX_ACCESS_READ, start, AXUIElementCopyAttributeValue(window->ref, kAXSizeAttribute, &size_ref));
 
     if (position_ref != NULL) {
         AXValueGetValue(position_ref, kAXValueTypeCGPoint, &frame.origin);
@@ -324,17 +404,34 @@ int window_level(struct window *window)
     return level;
 }
 
+//
+// Some applications report an empty or AXUnknown role while a window is still being set up,
+// and only fill in the real one later. Those answers are not cached, so that the window is
+// asked again the next time we need to classify it.
+//
+
+static inline bool window_role_is_settled(CFTypeRef role)
+{
+    return role && CFGetTypeID(role) == CFStringGetTypeID() && CFStringGetLength(role) > 0 && !CFEqual(role, kAXUnknownSubrole);
+}
+
 CFStringRef window_role(struct window *window)
 {
+    if (window->ax_role) return CFRetain(window->ax_role);
+
     const void *role = NULL;
     AXUIElementCopyAttributeValue(window->ref, kAXRoleAttribute, &role);
+    if (window_role_is_settled(role)) window->ax_role = CFRetain(role);
     return role;
 }
 
 CFStringRef window_subrole(struct window *window)
 {
+    if (window->ax_subrole) return CFRetain(window->ax_subrole);
+
     const void *srole = NULL;
     AXUIElementCopyAttributeValue(window->ref, kAXSubroleAttribute, &srole);
+    if (window_role_is_settled(srole)) window->ax_subrole = CFRetain(srole);
     return srole;
 }
 
@@ -407,7 +504,77 @@ bool window_is_unknown(struct window *window)
     return result;
 }
 
-struct window *window_create(struct application *application, AXUIElementRef window_ref, uint32_t window_id)
+static inline CFTypeRef window_attribute_value(CFArrayRef values, int index, CFTypeID type)
+{
+    if (!values || index >= CFArrayGetCount(values)) return NULL;
+
+    CFTypeRef value = CFArrayGetValueAtIndex(values, index);
+    return value && CFGetTypeID(value) == type ? value : NULL;
+}
+
+//
+// Fetch every attribute we need to classify a new window in a single request to the
+// application. Role and subrole do not change once they are settled, so we keep them
+// around and answer window_role/window_subrole from memory from now on. This only talks
+// to the application, so that it can run on a worker thread while the applications that
+// are already running are discovered at startup.
+//
+
+void window_fetch_attributes(struct application *application, AXUIElementRef window_ref, struct window_attributes *attributes)
+{
+    CFStringRef attribute_names[] = {
+        kAXRoleAttribute,
+        kAXSubroleAttribute,
+        kAXMinimizedAttribute,
+        kAXFullscreenAttribute,
+        kAXTitleAttribute
+    };
+
+    memset(attributes, 0, sizeof(struct window_attributes));
+
+    CFAbsoluteTime start;
+    if (!application_ax_begin(application, window_ref, AX_ACCESS_READ, &start)) return;
+
+    CFArrayRef attribute_list = CFArrayCreate(NULL, (void *)attribute_names, array_count(attribute_names), &kCFTypeArrayCallBacks);
+    application_ax_end(application, AX_ACCESS_READ, start, AXUIElementCopyMultipleAttributeValues(window_ref, attribute_list, 0, &attributes->values));
+    CFRelease(attribute_list);
+
+    Boolean can_move;
+    if (AXUIElementIsAttributeSettable(window_ref, kAXPositionAttribute, &can_move) == kAXErrorSuccess) {
+        attributes->can_move = can_move;
+    }
+}
+
+static void window_apply_attributes(struct window *window, struct window_attributes *attributes)
+{
+    window->can_move = attributes->can_move;
+
+    CFArrayRef values = attributes->values;
+    if (!values) return;
+
+    CFTypeRef role = window_attribute_value(values, 0, CFStringGetTypeID());
+    if (window_role_is_settled(role)) window->ax_role = CFRetain(role);
+
+    CFTypeRef subrole = window_attribute_value(values, 1, CFStringGetTypeID());
+    if (window_role_is_settled(subrole)) window->ax_subrole = CFRetain(subrole);
+
+    CFTypeRef minimized = window_attribute_value(values, 2, CFBooleanGetTypeID());
+    window->is_minimized = minimized && CFBooleanGetValue(minimized);
+
+    CFTypeRef fullscreen = window_attribute_value(values, 3, CFBooleanGetTypeID());
+    window->is_fullscreen = fullscreen && CFBooleanGetValue(fullscreen);
+
+    CFTypeRef title = window_attribute_value(values, 4, CFStringGetTypeID());
+    if (title) {
+        window->properties.title = cfstring_copy(title);
+        window->properties.valid |= WINDOW_PROPERTY_TITLE;
+    }
+
+    CFRelease(values);
+    attributes->values = NULL;
+}
+
+struct window *window_create_with_attributes(struct application *application, AXUIElementRef window_ref, uint32_t window_id, struct window_attributes *attributes)
 {
     struct window *window = malloc(sizeof(struct window));
     memset(window, 0, sizeof(struct window));
@@ -416,12 +583,32 @@ struct window *window_create(struct application *application, AXUIElementRef win
     window->ref = window_ref;
     window->id = window_id;
     SLSGetWindowOwner(g_connection, window->id, &window->connection);
-    window->is_minimized = window_is_minimized(window);
-    window->is_fullscreen = window_is_fullscreen(window) || space_is_fullscreen(window_space(window));
+    window_apply_attributes(window, attributes);
+
+    //
+    // Whether a window can be moved is fixed when the application creates it,
+    // and the only level changes we expect are our own, between the normal and
+    // the floating level; both count as standard. these are asked for once,
+    // so that classifying the window again (e.g. on every space change) does not
+    // cost an AX round-trip and a window server request each time.
+    //
+
+    window->has_standard_level = window_level_is_standard(window);
+    window->is_fullscreen = window->is_fullscreen || space_is_fullscreen(window_space(window));
     window->id_ptr = malloc(sizeof(uint32_t *));
     *window->id_ptr = &window->id;
     window->has_shadow = true;
 
+    //
+    // The window may already be translucent, either because the application
+    // made it so or because a previous instance of yabai faded it, so fades
+    // have to start from the alpha the window server reports.
+    //
+
+    if (SLSGetWindowAlpha(g_connection, window->id, &window->opacity) != kCGErrorSuccess) {
+        window->opacity = 1.0f;
+    }
+
     if ((window_is_standard(window)) || (window_is_dialog(window))) {
         border_window_create(window);
 
@@ -433,8 +620,20 @@ struct window *window_create(struct application *application, AXUIElementRef win
     return window;
 }
 
+struct window *window_create(struct application *application, AXUIElementRef window_ref, uint32_t window_id)
+{
+    struct window_attributes attributes;
+    window_fetch_attributes(application, window_ref, &attributes);
+    return window_create_with_attributes(application, window_ref, window_id, &attributes);
+}
+
 void window_destroy(struct window *window)
 {
+    if (window->properties.title) free(window->properties.title);
+    if (window->properties.role) free(window->properties.role);
+    if (window->properties.subrole) free(window->properties.subrole);
+    if (window->ax_role) CFRelease(window->ax_role);
+    if (window->ax_subrole) CFRelease(window->ax_subrole);
     border_window_destroy(window);
     CFRelease(window->ref);
     free(window->id_ptr);
@@ -4,6 +4,7 @@
 extern int SLSMainConnectionID(void);
 extern CGError SLSGetWindowBounds(int cid, uint32_t wid, CGRect *frame);
 extern CGError SLSGetWindowLevel(int cid, uint32_t wid, int *level);
+extern CGError SLSGetWindowAlpha(int cid, uint32_t wid, float *alpha);
 extern CGError SLSCopyWindowProperty(int cid, uint32_t wid, CFStringRef property, CFTypeRef *value);
 extern CFStringRef SLSCopyManagedDisplayForWindow(int cid, uint32_t wid);
 extern CFStringRef SLSCopyBestManagedDisplayForRect(int cid, CGRect rect);
@@ -29,6 +30,33 @@ static CFStringRef ax_window_notification[] =
     [AX_WINDOW_DEMINIMIZED_INDEX]    = kAXWindowDeminiaturizedNotification
 };
 
+#define WINDOW_PROPERTY_TITLE      (1 << 0)
+#define WINDOW_PROPERTY_FRAME      (1 << 1)
+#define WINDOW_PROPERTY_ROLE       (1 << 2)
+#define WINDOW_PROPERTY_FULLSCREEN (1 << 3)
+#define WINDOW_PROPERTY_ALL        (WINDOW_PROPERTY_TITLE |\
+                                    WINDOW_PROPERTY_FRAME |\
+                                    WINDOW_PROPERTY_ROLE |\
+                                    WINDOW_PROPERTY_FULLSCREEN)
+
+struct window_properties
+{
+    uint8_t valid;
+    char *title;
+    char *role;
+    char *subrole;
+    CGRect frame;
+    bool can_move;
+    bool can_resize;
+    bool is_fullscreen;
+};
+
+struct window_attributes
+{
+    CFArrayRef values;
+    bool can_move;
+};
+
 struct window
 {
     struct application *application;
@@ -42,15 +70,27 @@ struct window
     bool is_fullscreen;
     bool is_minimized;
     bool is_floating;
+    bool can_move;
+    bool has_standard_level;
     float rule_alpha;
+    float opacity;
     bool rule_manage;
     bool rule_fullscreen;
+    CGSize min_size;
+    CGRect expected_frame;
+    uint32_t frame_generation;
+    uint32_t suppressed_frame_events;
+    struct window_properties properties;
+    CFStringRef ax_role;
+    CFStringRef ax_subrole;
 };
 
 CFStringRef window_display_uuid(struct window *window);
 int window_display_id(struct window *window);
 uint64_t window_space(struct window *window);
 uint64_t *window_space_list(struct window *window, int *count);
+CGRect window_cached_frame(struct window *window);
+void window_invalidate_properties(struct window *window, uint8_t properties);
 void window_serialize(FILE *rsp, struct window *window);
 char *window_title(struct window *window);
 CGRect window_ax_frame(struct window *window);
@@ -72,6 +112,8 @@ bool window_is_popover(struct window *window);
 bool window_is_unknown(struct window *window);
 bool window_observe(struct window *window);
 void window_unobserve(struct window *window);
+void window_fetch_attributes(struct application *application, AXUIElementRef window_ref, struct window_attributes *attributes);
+struct window *window_create_with_attributes(struct application *application, AXUIElementRef window_ref, uint32_t window_id, struct window_attributes *attributes);
 struct window *window_create(struct application *application, AXUIElementRef window_ref, uint32_t window_id);
 void window_destroy(struct window *window);
 
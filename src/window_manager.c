@@ -1,8 +1,8 @@
 #include "window_manager.h"
 
+extern struct event_loop g_event_loop;
 extern struct process_manager g_process_manager;
 extern struct mouse_state g_mouse_state;
-extern char g_sa_socket_file[MAXLEN];
 
 static TABLE_HASH_FUNC(hash_wm)
 {
@@ -21,12 +21,17 @@ static TABLE_COMPARE_FUNC(compare_wm)
     return *(uint32_t *) key_a == *(uint32_t *) key_b;
 }
 
-void window_manager_query_windows_for_space(FILE *rsp, uint64_t sid)
+static TIMER_CALLBACK(opacity_timer_handler)
 {
-    int window_count;
-    uint32_t *window_list = space_window_list(sid, &window_count);
-    if (!window_list) return;
+    if (!__sync_bool_compare_and_swap(&g_window_manager.opacity_tick_pending, false, true)) return;
 
+    struct event *event;
+    event_create(event, WINDOW_OPACITY_TICK, NULL);
+    event_loop_post(&g_event_loop, event);
+}
+
+static void window_manager_serialize_window_list(FILE *rsp, uint32_t *window_list, int window_count)
+{
     struct window **window_aggregate_list = NULL;
     for (int i = 0; i < window_count; ++i) {
         struct window *window = window_manager_find_window(&g_window_manager, window_list[i]);
@@ -42,6 +47,15 @@ void window_manager_query_windows_for_space(FILE *rsp, uint64_t sid)
     fprintf(rsp, "]\n");
 
     buf_free(window_aggregate_list);
+}
+
+void window_manager_query_windows_for_space(FILE *rsp, uint64_t sid)
+{
+    int window_count;
+    uint32_t *window_list = space_window_list(sid, &window_count);
+    if (!window_list) return;
+
+    window_manager_serialize_window_list(rsp, window_list, window_count);
     free(window_list);
 }
 
@@ -51,29 +65,11 @@ void window_manager_query_windows_for_display(FILE *rsp, uint32_t did)
     uint64_t *space_list = display_space_list(did, &space_count);
     if (!space_list) return;
 
-    struct window **window_aggregate_list = NULL;
-    for (int i = 0; i < space_count; ++i) {
-        int window_count;
-        uint32_t *window_list = space_window_list(space_list[i], &window_count);
-        if (!window_list) continue;
-
-        for (int j = 0; j < window_count; ++j) {
-            struct window *window = window_manager_find_window(&g_window_manager, window_list[j]);
-            if (window) buf_push(window_aggregate_list, window);
-        }
-
-        free(window_list);
-    }
-
-    fprintf(rsp, "[");
-    for (int i = 0; i < buf_len(window_aggregate_list); ++i) {
-        struct window *window = window_aggregate_list[i];
-        window_serialize(rsp, window);
-        if (i < buf_len(window_aggregate_list) - 1) fprintf(rsp, ",");
-    }
-    fprintf(rsp, "]\n");
+    int window_count = 0;
+    uint32_t *window_list = space_window_list_for_spaces(space_list, space_count, &window_count);
+    window_manager_serialize_window_list(rsp, window_list, window_list ? window_count : 0);
 
-    buf_free(window_aggregate_list);
+    free(window_list);
     free(space_list);
 }
 
@@ -83,37 +79,25 @@ void window_manager_query_windows_for_displays(FILE *rsp)
     uint32_t *display_list = display_manager_active_display_list(&display_count);
     if (!display_list) return;
 
-    struct window **window_aggregate_list = NULL;
+    uint64_t *space_list = NULL;
     for (int i = 0; i < display_count; ++i) {
         int space_count;
-        uint64_t *space_list = display_space_list(display_list[i], &space_count);
-        if (!space_list) continue;
+        uint64_t *display_spaces = display_space_list(display_list[i], &space_count);
+        if (!display_spaces) continue;
 
         for (int j = 0; j < space_count; ++j) {
-            int window_count;
-            uint32_t *window_list = space_window_list(space_list[j], &window_count);
-            if (!window_list) continue;
-
-            for (int k = 0; k < window_count; ++k) {
-                struct window *window = window_manager_find_window(&g_window_manager, window_list[k]);
-                if (window) buf_push(window_aggregate_list, window);
-            }
-
-            free(window_list);
+            buf_push(space_list, display_spaces[j]);
         }
 
-        free(space_list);
+        free(display_spaces);
     }
 
-    fprintf(rsp, "[");
-    for (int i = 0; i < buf_len(window_aggregate_list); ++i) {
-        struct window *window = window_aggregate_list[i];
-        window_serialize(rsp, window);
-        if (i < buf_len(window_aggregate_list) - 1) fprintf(rsp, ",");
-    }
-    fprintf(rsp, "]\n");
+    int window_count = 0;
+    uint32_t *window_list = space_window_list_for_spaces(space_list, buf_len(space_list), &window_count);
+    window_manager_serialize_window_list(rsp, window_list, window_list ? window_count : 0);
 
-    buf_free(window_aggregate_list);
+    free(window_list);
+    buf_free(space_list);
     free(display_list);
 }
 
@@ -227,9 +211,9 @@ bool window_manager_should_manage_window(struct window *window)
 {
     if (window->rule_manage) return true;
 
-    return ((window_level_is_standard(window)) &&
+    return ((window->has_standard_level) &&
             (window_is_standard(window)) &&
-            (window_can_move(window)) &&
+            (window->can_move) &&
             (!window_is_sticky(window)) &&
             (!window->is_floating));
 }
@@ -314,29 +298,149 @@ void window_manager_resize_window_relative(struct window_manager *wm, struct win
 
 void window_manager_move_window(struct window *window, float x, float y)
 {
+    CFAbsoluteTime start;
+    if (!application_ax_begin(window->application, window->ref, AX_ACCESS_WRITE, &start)) return;
+
     CGPoint position = CGPointMake(x, y);
     CFTypeRef position_ref = AXValueCreate(kAXValueTypeCGPoint, (void *) &position);
     if (!position_ref) return;
 
-    AXUIElementSetAttributeValue(window->ref, kAXPositionAttribute, position_ref);
+    application_ax_end(window->application, AX_ACCESS_WRITE, start, AXUIElementSetAttributeValue(window->ref, kAXPositionAttribute, position_ref));
     CFRelease(position_ref);
+    event_memo_clear(&g_event_loop.memo);
 }
 
 void window_manager_resize_window(struct window *window, float width, float height)
 {
+    CFAbsoluteTime start;
+    if (!application_ax_begin(window->application, window->ref, AX_ACCESS_WRITE, &start)) return;
+
     CGSize size = CGSizeMake(width, height);
     CFTypeRef size_ref = AXValueCreate(kAXValueTypeCGSize, (void *) &size);
     if (!size_ref) return;
 
-    AXUIElementSetAttributeValue(window->ref, kAXSizeAttribute, size_ref);
+    application_ax_end(window->application, AX_ACCESS_WRITE, start, AXUIElementSetAttributeValue(window->ref, kAXSizeAttribute, size_ref));
     CFRelease(size_ref);
 }
 
-void window_manager_set_window_frame(struct window *window, float x, float y, float width, float height)
+static inline bool window_manager_frame_is_close(CGRect a, CGRect b)
+{
+    return fabs(a.origin.x    - b.origin.x)    < 1.0f &&
+           fabs(a.origin.y    - b.origin.y)    < 1.0f &&
+           fabs(a.size.width  - b.size.width)  < 1.0f &&
+           fabs(a.size.height - b.size.height) < 1.0f;
+}
+
+bool window_manager_set_window_frame(struct window *window, float x, float y, float width, float height)
 {
+    if (window->application->ax.state == AX_BREAKER_OPEN) {
+        debug("%s: %s is not responding, skipping frame update for %d\n", __FUNCTION__, window->application->name, window->id);
+        return false;
+    }
+
+    window->frame_generation = __sync_add_and_fetch(&g_window_manager.frame_generation, 1);
+    window->expected_frame = (CGRect) { { x, y }, { width, height } };
+
     window_manager_resize_window(window, width, height);
     window_manager_move_window(window, x, y);
     window_manager_resize_window(window, width, height);
+
+    return true;
+}
+
+enum frame_event window_manager_correlate_frame_event(struct window_manager *wm, struct window *window, uint32_t generation, CGRect *frame)
+{
+    *frame = window_frame(window);
+    if (!window->frame_generation) return FRAME_EVENT_EXTERNAL;
+
+    //
+    // Moved / resized notifications are stamped with the frame generation that was current
+    // when they were posted. A notification stamped before our latest write to this window
+    // describes a frame that has already been replaced, and the notification for the frame
+    // we wrote is still on its way.
+    //
+
+    if ((int32_t)(generation - window->frame_generation) < 0) {
+        ++window->suppressed_frame_events;
+        return FRAME_EVENT_SUPERSEDED;
+    }
+
+    //
+    // A notification posted after our latest write was caused by that write as long as the
+    // window is still at the frame we gave it. Applications may round fractional frames, so
+    // we allow for a difference of less than a pixel. If the window ended up somewhere else,
+    // the application refused (part of) the frame, and anything after that is not ours.
+    //
+
+    if (window_manager_frame_is_close(*frame, window->expected_frame)) {
+        ++window->suppressed_frame_events;
+        return FRAME_EVENT_EXPECTED;
+    }
+
+    window->frame_generation = 0;
+    return FRAME_EVENT_REFUSED;
+}
+
+bool window_manager_update_window_constraints(struct window *window, CGRect frame, bool refused)
+{
+    bool did_learn_constraints = false;
+
+    //
+    // An application that refuses a size we asked for answers with the smallest size it is
+    // willing to take (character cells, minimum size), which the layout has to respect from
+    // then on. A window that is seen smaller than its learned minimum is no longer enforcing
+    // it (a different font, the user resized it), so the constraint is dropped again.
+    //
+
+    if (refused && frame.size.width >= window->expected_frame.size.width + 1.0f) {
+        if (frame.size.width > window->min_size.width) {
+            window->min_size.width = frame.size.width;
+            did_learn_constraints = true;
+        }
+    } else if (frame.size.width < window->min_size.width - 1.0f) {
+        debug("%s: %s %d no longer enforces minimum width %.0f\n", __FUNCTION__, window->application->name, window->id, window->min_size.width);
+        window->min_size.width = 0.0f;
+    }
+
+    if (refused && frame.size.height >= window->expected_frame.size.height + 1.0f) {
+        if (frame.size.height > window->min_size.height) {
+            window->min_size.height = frame.size.height;
+            did_learn_constraints = true;
+        }
+    } else if (frame.size.height < window->min_size.height - 1.0f) {
+        debug("%s: %s %d no longer enforces minimum height %.0f\n", __FUNCTION__, window->application->name, window->id, window->min_size.height);
+        window->min_size.height = 0.0f;
+    }
+
+    if (did_learn_constraints) {
+        debug("%s: %s %d learned minimum size %.0fx%.0f\n", __FUNCTION__, window->application->name, window->id, window->min_size.width, window->min_size.height);
+    }
+
+    return did_learn_constraints;
+}
+
+void window_manager_invalidate_window_frame(struct window_manager *wm, struct window *window)
+{
+    struct view *view = window_manager_find_managed_window(wm, window);
+    if (!view) return;
+
+    struct window_node *node = view_find_window_node(view, window->id);
+    if (node) node->applied_window_id = 0;
+}
+
+void window_manager_invalidate_window_properties(struct window_manager *wm)
+{
+    for (int window_index = 0; window_index < wm->window.capacity; ++window_index) {
+        struct bucket *bucket = wm->window.buckets[window_index];
+        while (bucket) {
+            if (bucket->value) {
+                struct window *window = bucket->value;
+                window_invalidate_properties(window, WINDOW_PROPERTY_ALL);
+            }
+
+            bucket = bucket->next;
+        }
+    }
 }
 
 void window_manager_set_purify_mode(struct window_manager *wm, enum purify_mode mode)
@@ -463,15 +567,68 @@ void window_manager_set_window_opacity(struct window_manager *wm, struct window
     if (window->rule_alpha != 0.0f) return;
     if ((!window_is_standard(window)) && (!window_is_dialog(window))) return;
 
-    int sockfd;
-    char message[MAXLEN];
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    struct opacity_animation animation = { window->id, window->opacity, opacity, wm->window_opacity_duration, now };
+
+    //
+    // A window has at most one opacity animation. A new
+    // target supersedes the running animation, which continues from the
+    // alpha that was last pushed to the window instead of queueing behind it.
+    //
+
+    for (int i = 0; i < buf_len(wm->opacity_animations); ++i) {
+        if (wm->opacity_animations[i].wid == window->id) {
+            buf_del(wm->opacity_animations, i);
+            break;
+        }
+    }
+
+    if (animation.duration <= 0.0f) {
+        struct osax_op op = { .opcode = OSAX_OP_WINDOW_ALPHA, .window_alpha = { window->id, opacity } };
+        if (scripting_addition_send(&op)) window->opacity = opacity;
+        return;
+    }
+
+    buf_push(wm->opacity_animations, animation);
+    if (buf_len(wm->opacity_animations) == 1) CFRunLoopTimerSetNextFireDate(wm->opacity_timer, now);
+}
+
+void window_manager_animate_window_opacity(struct window_manager *wm)
+{
+    __sync_lock_release(&wm->opacity_tick_pending);
+
+    //
+    // Every animating window is stepped from the same
+    // timestamp, and because this runs as an event the alpha updates of a
+    // single tick go out to the scripting addition as one batched frame.
+    //
+
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    for (int i = 0; i < buf_len(wm->opacity_animations);) {
+        struct opacity_animation *animation = &wm->opacity_animations[i];
+        struct window *window = window_manager_find_window(wm, animation->wid);
+        if (!window) {
+            buf_del(wm->opacity_animations, i);
+            continue;
+        }
+
+        float t = (now - animation->start) / animation->duration;
+        if (t > 1.0f) t = 1.0f;
+
+        float alpha = animation->from + (animation->to - animation->from) * t;
+        struct osax_op op = { .opcode = OSAX_OP_WINDOW_ALPHA, .window_alpha = { window->id, alpha } };
+        if (scripting_addition_send(&op)) window->opacity = alpha;
+
+        if (t == 1.0f) {
+            buf_del(wm->opacity_animations, i);
+        } else {
+            ++i;
+        }
+    }
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_alpha_fade %d %f %f", window->id, opacity, wm->window_opacity_duration);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    if (buf_len(wm->opacity_animations) == 0) {
+        CFRunLoopTimerSetNextFireDate(wm->opacity_timer, now + OPACITY_ANIMATION_IDLE);
     }
-    socket_close(sockfd);
 }
 
 void window_manager_set_active_window_opacity(struct window_manager *wm, float opacity)
@@ -499,15 +656,8 @@ void window_manager_set_normal_window_opacity(struct window_manager *wm, float o
 
 void window_manager_make_topmost(uint32_t wid, bool topmost)
 {
-    int sockfd;
-    char message[MAXLEN];
-
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_level %d %d", wid, topmost ? kCGFloatingWindowLevelKey : kCGNormalWindowLevelKey);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
-    }
-    socket_close(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_WINDOW_LEVEL, .window = { wid, topmost ? kCGFloatingWindowLevelKey : kCGNormalWindowLevelKey } };
+    scripting_addition_send(&op);
 }
 
 void window_manager_make_floating(struct window_manager *wm, uint32_t wid, bool floating)
@@ -518,22 +668,13 @@ void window_manager_make_floating(struct window_manager *wm, uint32_t wid, bool
 
 void window_manager_make_sticky(uint32_t wid, bool sticky)
 {
-    int sockfd;
-    char message[MAXLEN];
-
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_sticky %d %d", wid, sticky);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
-    }
-    socket_close(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_WINDOW_STICKY, .window = { wid, sticky } };
+    scripting_addition_send(&op);
 }
 
 void window_manager_purify_window(struct window_manager *wm, struct window *window)
 {
     int value;
-    int sockfd;
-    char message[MAXLEN];
 
     if (wm->purify_mode == PURIFY_DISABLED) {
         value = 1;
@@ -543,13 +684,10 @@ void window_manager_purify_window(struct window_manager *wm, struct window *wind
         value = 0;
     }
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_shadow %d %d", window->id, value);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_WINDOW_SHADOW, .window = { window->id, value } };
+    if (scripting_addition_send(&op)) {
         window->has_shadow = value;
     }
-    socket_close(sockfd);
 }
 
 static struct window *window_manager_find_window_on_space_by_rank(struct window_manager *wm, uint64_t sid, int rank)
@@ -579,6 +717,8 @@ struct window *window_manager_find_window_at_point_filtering_window(struct windo
     CGPoint window_point;
     int window_cid;
 
+    if (!spatial_index_query_point(&wm->spatial_index, point, filter_wid, NULL)) return NULL;
+
     SLSFindWindowByGeometry(g_connection, filter_wid, 0xffffffff, 0, &point, &window_point, &window_id, &window_cid);
     return window_manager_find_window(wm, window_id);
 }
@@ -589,6 +729,15 @@ struct window *window_manager_find_window_at_point(struct window_manager *wm, CG
     CGPoint window_point;
     int window_cid;
 
+    //
+    // The index only knows the windows we track. If none of them covers the point, the
+    // window server can only answer with a window we do not track (a menu, a panel, the
+    // desktop), which we would not find either. Otherwise the window server has the final
+    // say, as it is the only one that knows the stacking order and every other window.
+    //
+
+    if (!spatial_index_query_point(&wm->spatial_index, point, 0, NULL)) return NULL;
+
     SLSFindWindowByGeometry(g_connection, 0, 1, 0, &point, &window_point, &window_id, &window_cid);
     return window_manager_find_window(wm, window_id);
 }
@@ -628,25 +777,53 @@ struct window *window_manager_find_closest_managed_window_in_direction(struct wi
     struct view *view = window_manager_find_managed_window(wm, window);
     if (!view) return NULL;
 
-    uint32_t *view_window_list = view_find_window_list(view);
-    if (!view_window_list) return NULL;
+    struct window_node *node = view_find_window_node(view, window->id);
+    if (!node) return NULL;
 
-    struct window *result = window_manager_find_closest_window_for_direction_in_window_list(wm, window, direction, view_window_list, buf_len(view_window_list));
-    buf_free(view_window_list);
+    struct window_node *closest = view_find_window_node_in_direction(view, node, direction);
+    if (!closest) return NULL;
 
-    return result;
+    return window_manager_find_window(wm, closest->window_id);
 }
 
 struct window *window_manager_find_closest_window_in_direction(struct window_manager *wm, struct window *window, int direction)
 {
     int window_count;
-    uint32_t *window_list = space_window_list(display_space_id(window_display_id(window)), &window_count);
-    if (!window_list) return NULL;
+    uint32_t *window_list = space_membership_window_list(&g_space_manager.membership, display_space_id(window_display_id(window)), &window_count);
+    if (!window_list) return window_manager_find_closest_managed_window_in_direction(wm, window, direction);
+
+    if (!window_manager_find_managed_window(wm, window)) {
+        struct window *result = window_manager_find_closest_window_for_direction_in_window_list(wm, window, direction, window_list, window_count);
+        free(window_list);
+        return result;
+    }
 
-    struct window *result = window_manager_find_closest_window_for_direction_in_window_list(wm, window, direction, window_list, window_count);
+    //
+    // The adjacency graph only knows about managed windows. Windows that float above
+    // the layout are searched by frame, and the graph neighbour is kept unless one of
+    // them is closer. When there are no such windows no frame has to be read at all.
+    //
+
+    int unmanaged_count = 0;
+    for (int i = 0; i < window_count; ++i) {
+        struct window *candidate = window_manager_find_window(wm, window_list[i]);
+        if (candidate && !window_manager_find_managed_window(wm, candidate)) {
+            window_list[unmanaged_count++] = window_list[i];
+        }
+    }
+
+    struct window *managed = window_manager_find_closest_managed_window_in_direction(wm, window, direction);
+    struct window *unmanaged = unmanaged_count ? window_manager_find_closest_window_for_direction_in_window_list(wm, window, direction, window_list, unmanaged_count) : NULL;
     free(window_list);
 
-    return result;
+    if (!managed)   return unmanaged;
+    if (!unmanaged) return managed;
+
+    CGRect source_frame = window_frame(window);
+    uint32_t managed_distance = rect_distance(source_frame, window_frame(managed), direction);
+    uint32_t unmanaged_distance = rect_distance(source_frame, window_frame(unmanaged), direction);
+
+    return unmanaged_distance < managed_distance ? unmanaged : managed;
 }
 
 struct window *window_manager_find_prev_managed_window(struct space_manager *sm, struct window_manager *wm, struct window *window)
@@ -824,6 +1001,7 @@ void window_manager_focus_window_without_raise(ProcessSerialNumber *window_psn,
 
     _SLPSSetFrontProcessWithOptions(window_psn, window_id, kCPSUserGenerated);
     window_manager_make_key_window(window_psn, window_id);
+    event_memo_clear(&g_event_loop.memo);
 }
 
 void window_manager_focus_window_with_raise(ProcessSerialNumber *window_psn, uint32_t window_id, AXUIElementRef window_ref)
@@ -833,16 +1011,11 @@ void window_manager_focus_window_with_raise(ProcessSerialNumber *window_psn, uin
     window_manager_make_key_window(window_psn, window_id);
     AXUIElementPerformAction(window_ref, kAXRaiseAction);
 #else
-    int sockfd;
-    char message[MAXLEN];
-
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_focus %d", window_id);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
-    }
-    socket_close(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_WINDOW_FOCUS, .window = { window_id } };
+    scripting_addition_request(&op);
 #endif
+
+    event_memo_clear(&g_event_loop.memo);
 }
 
 #pragma clang diagnostic push
@@ -858,8 +1031,13 @@ struct window *window_manager_focused_window(struct window_manager *wm)
     struct application *application = window_manager_find_application(wm, pid);
     if (!application) return NULL;
 
-    uint32_t window_id = application_focused_window(application);
-    return window_manager_find_window(wm, window_id);
+    uint64_t window_id = 0;
+    if (!event_memo_find(&g_event_loop.memo, EVENT_MEMO_FOCUSED_WINDOW, pid, &window_id)) {
+        window_id = application_focused_window(application);
+        event_memo_store(&g_event_loop.memo, EVENT_MEMO_FOCUSED_WINDOW, pid, window_id);
+    }
+
+    return window_manager_find_window(wm, (uint32_t) window_id);
 }
 #pragma clang diagnostic pop
 
@@ -915,11 +1093,15 @@ struct window *window_manager_find_window(struct window_manager *wm, uint32_t wi
 void window_manager_remove_window(struct window_manager *wm, uint32_t window_id)
 {
     table_remove(&wm->window, &window_id);
+    spatial_index_mark_dirty(&wm->spatial_index);
+    space_membership_remove_window(&g_space_manager.membership, window_id);
 }
 
 void window_manager_add_window(struct window_manager *wm, struct window *window)
 {
     table_add(&wm->window, &window->id, window);
+    spatial_index_mark_dirty(&wm->spatial_index);
+    space_membership_add_window(&g_space_manager.membership, window_space(window), window->id);
 }
 
 struct application *window_manager_find_application(struct window_manager *wm, pid_t pid)
@@ -968,12 +1150,8 @@ struct window **window_manager_find_application_windows(struct window_manager *w
     return result;
 }
 
-void window_manager_add_application_windows(struct space_manager *sm, struct window_manager *wm, struct application *application)
+static void window_manager_add_application_window_list(struct space_manager *sm, struct window_manager *wm, struct application *application, struct window **window_list, int window_count)
 {
-    int window_count;
-    struct window **window_list = application_window_list(application, &window_count);
-    if (!window_list) return;
-
     for (int window_index = 0; window_index < window_count; ++window_index) {
         struct window *window = window_list[window_index];
         if (!window) continue;
@@ -1001,9 +1179,9 @@ void window_manager_add_application_windows(struct space_manager *sm, struct win
             if ((!application->is_hidden) && (!window->is_minimized) && (!window->is_fullscreen) && (!window->rule_manage)) {
                 if (window->rule_fullscreen) {
                     window->rule_fullscreen = false;
-                } else if ((!window_level_is_standard(window)) ||
+                } else if ((!window->has_standard_level) ||
                            (!window_is_standard(window)) ||
-                           (!window_can_move(window)) ||
+                           (!window->can_move) ||
                            (window_is_sticky(window)) ||
                            (window_is_undersized(window))) {
                     window_manager_make_children_floating(wm, window, true);
@@ -1018,7 +1196,15 @@ void window_manager_add_application_windows(struct space_manager *sm, struct win
             window_destroy(window);
         }
     }
+}
+
+void window_manager_add_application_windows(struct space_manager *sm, struct window_manager *wm, struct application *application)
+{
+    int window_count;
+    struct window **window_list = application_window_list(application, &window_count);
+    if (!window_list) return;
 
+    window_manager_add_application_window_list(sm, wm, application, window_list, window_count);
     free(window_list);
 }
 
@@ -1342,17 +1528,12 @@ void window_manager_toggle_window_sticky(struct space_manager *sm, struct window
 
 void window_manager_toggle_window_shadow(struct space_manager *sm, struct window_manager *wm, struct window *window)
 {
-    int sockfd;
-    char message[MAXLEN];
     bool shadow = !window->has_shadow;
 
-    if (socket_connect_un(&sockfd, g_sa_socket_file)) {
-        snprintf(message, sizeof(message), "window_shadow %d %d", window->id, shadow);
-        socket_write(sockfd, message);
-        socket_wait(sockfd);
+    struct osax_op op = { .opcode = OSAX_OP_WINDOW_SHADOW, .window = { window->id, shadow } };
+    if (scripting_addition_send(&op)) {
         window->has_shadow = shadow;
     }
-    socket_close(sockfd);
 }
 
 void window_manager_toggle_window_native_fullscreen(struct space_manager *sm, struct window_manager *wm, struct window *window)
@@ -1430,37 +1611,110 @@ void window_manager_toggle_window_expose(struct window_manager *wm, struct windo
     CoreDockSendNotification(CFSTR("com.apple.expose.front.awake"), 0);
 }
 
-void window_manager_validate_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid)
+static int compare_window_id(const void *a, const void *b)
 {
-    int window_count;
+    uint32_t lhs = *(uint32_t *) a;
+    uint32_t rhs = *(uint32_t *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+void window_manager_diff_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid, struct window_delta *delta)
+{
+    memset(delta, 0, sizeof(struct window_delta));
+
+    int window_count = 0;
     uint32_t *window_list = space_window_list(sid, &window_count);
     if (!window_list) return;
 
     struct view *view = space_manager_find_view(sm, sid);
     uint32_t *view_window_list = view_find_window_list(view);
+    int view_window_count = buf_len(view_window_list);
 
-    for (int i = 0; i < buf_len(view_window_list); ++i) {
-        bool found = false;
+    qsort(window_list, window_count, sizeof(uint32_t), compare_window_id);
+    qsort(view_window_list, view_window_count, sizeof(uint32_t), compare_window_id);
 
-        for (int j = 0; j < window_count; ++j) {
-            if (view_window_list[i] == window_list[j]) {
-                found = true;
-                break;
+    int i = 0, j = 0;
+    while (i < view_window_count || j < window_count) {
+        if (j == window_count || (i < view_window_count && view_window_list[i] < window_list[j])) {
+            struct window *window = window_manager_find_window(wm, view_window_list[i]);
+            if (window) buf_push(delta->removed, window);
+            ++i;
+        } else if (i == view_window_count || window_list[j] < view_window_list[i]) {
+            struct window *window = window_manager_find_window(wm, window_list[j]);
+            if (window && window_manager_should_manage_window(window) && !window->is_minimized && !window->application->is_hidden) {
+                struct view *existing_view = window_manager_find_managed_window(wm, window);
+                if (!existing_view) {
+                    buf_push(delta->added, window);
+                } else if (existing_view->sid != sid) {
+                    buf_push(delta->moved, window);
+                }
             }
+            ++j;
+        } else {
+            ++i;
+            ++j;
         }
+    }
 
-        if (!found) {
-            struct window *window = window_manager_find_window(wm, view_window_list[i]);
-            if (!window) continue;
+    buf_free(view_window_list);
+    free(window_list);
+}
 
-            space_manager_untile_window(sm, view, window);
+void window_manager_apply_window_delta(struct space_manager *sm, struct window_manager *wm, uint64_t sid, struct window_delta *delta)
+{
+    int removed_count = buf_len(delta->removed);
+    int moved_count = buf_len(delta->moved);
+    int added_count = buf_len(delta->added);
+    if (!removed_count && !moved_count && !added_count) return;
+
+    struct view *view = space_manager_find_view(sm, sid);
+
+    for (int i = 0; i < removed_count; ++i) {
+        struct window *window = delta->removed[i];
+        if (view->layout == VIEW_BSP) view_remove_window_node(view, window);
+        window_manager_remove_managed_window(wm, window->id);
+        window_manager_purify_window(wm, window);
+    }
+
+    for (int i = 0; i < moved_count; ++i) {
+        struct window *window = delta->moved[i];
+        struct view *existing_view = window_manager_find_managed_window(wm, window);
+        if (existing_view) {
+            space_manager_untile_window(sm, existing_view, window);
             window_manager_remove_managed_window(wm, window->id);
             window_manager_purify_window(wm, window);
         }
+
+        if (view->layout == VIEW_BSP) view_add_window_node(view, window);
+        window_manager_add_managed_window(wm, window, view);
     }
 
-    buf_free(view_window_list);
-    free(window_list);
+    for (int i = 0; i < added_count; ++i) {
+        struct window *window = delta->added[i];
+        if (view->layout == VIEW_BSP) view_add_window_node(view, window);
+        window_manager_add_managed_window(wm, window, view);
+    }
+
+    if (view->layout == VIEW_BSP) {
+        view_flush(view);
+
+        if (!space_is_visible(view->sid)) {
+            view->is_dirty = true;
+        }
+    }
+
+    debug("%s: %lld removed %d, moved %d, added %d\n", __FUNCTION__, sid, removed_count, moved_count, added_count);
+}
+
+void window_manager_reconcile_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid)
+{
+    struct window_delta delta;
+    window_manager_diff_windows_on_space(sm, wm, sid, &delta);
+    window_manager_apply_window_delta(sm, wm, sid, &delta);
+
+    buf_free(delta.removed);
+    buf_free(delta.moved);
+    buf_free(delta.added);
 }
 
 void window_manager_check_for_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid)
@@ -1553,36 +1807,114 @@ void window_manager_init(struct window_manager *wm)
     wm->active_window_opacity = 1.0f;
     wm->normal_window_opacity = 1.0f;
     wm->window_opacity_duration = 0.2f;
+    wm->opacity_animations = NULL;
+    wm->opacity_tick_pending = false;
+    wm->frame_generation = 0;
 
     table_init(&wm->application, 150, hash_wm, compare_wm);
     table_init(&wm->window, 150, hash_wm, compare_wm);
     table_init(&wm->managed_window, 150, hash_wm, compare_wm);
     table_init(&wm->window_lost_focused_event, 150, hash_wm, compare_wm);
     table_init(&wm->application_lost_front_switched_event, 150, hash_wm, compare_wm);
+    spatial_index_init(&wm->spatial_index);
+
+    wm->opacity_timer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + OPACITY_ANIMATION_IDLE, OPACITY_ANIMATION_INTERVAL, 0, 0, opacity_timer_handler, NULL);
+    CFRunLoopAddTimer(CFRunLoopGetMain(), wm->opacity_timer, kCFRunLoopCommonModes);
 }
 
+//
+// Creating the observer, reading the window list and fetching the attributes of every window
+// is where we spend our time during startup, and it is all AX traffic with a single
+// application. Fan it out across a worker pool. The workers do not touch anything but the
+// application they were given: window structs, borders, and anything that consults the
+// registries, the space membership or the topology are left to the merge, which runs on
+// the event-loop thread like every other change to that state.
+//
+
 void window_manager_begin(struct space_manager *sm, struct window_manager *wm)
 {
+    CFAbsoluteTime begin_start = CFAbsoluteTimeGetCurrent();
+
+    struct startup_application *startup_list = NULL;
     for (int process_index = 0; process_index < g_process_manager.process.capacity; ++process_index) {
         struct bucket *bucket = g_process_manager.process.buckets[process_index];
         while (bucket) {
             if (bucket->value) {
-                struct process *process = bucket->value;
-                struct application *application = application_create(process);
-
-                if (application_observe(application)) {
-                    window_manager_add_application(wm, application);
-                    window_manager_add_application_windows(sm, wm, application);
-                } else {
-                    application_unobserve(application);
-                    application_destroy(application);
-                }
+                struct startup_application entry = { .process = bucket->value };
+                buf_push(startup_list, entry);
             }
 
             bucket = bucket->next;
         }
     }
 
+    if (!startup_list) return;
+
+    dispatch_apply(buf_len(startup_list), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t index) {
+        struct startup_application *entry = &startup_list[index];
+        entry->application = application_create(entry->process);
+        entry->is_observing = application_observe(entry->application);
+        if (!entry->is_observing) return;
+
+        CFArrayRef window_list_ref = application_window_ref_list(entry->application);
+        if (!window_list_ref) return;
+
+        entry->window_count = CFArrayGetCount(window_list_ref);
+        entry->window_list = malloc(entry->window_count * sizeof(struct startup_window));
+
+        for (int i = 0; i < entry->window_count; ++i) {
+            struct startup_window *window = &entry->window_list[i];
+            AXUIElementRef window_ref = CFArrayGetValueAtIndex(window_list_ref, i);
+
+            memset(window, 0, sizeof(struct startup_window));
+            window->id = ax_window_id(window_ref);
+            if (!window->id) continue;
+
+            window->ref = CFRetain(window_ref);
+            window_fetch_attributes(entry->application, window_ref, &window->attributes);
+        }
+
+        CFRelease(window_list_ref);
+    });
+
+    debug("%s: %d applications, discover %.3fms\n", __FUNCTION__, buf_len(startup_list), (CFAbsoluteTimeGetCurrent() - begin_start) * 1000.0f);
+
+    struct event *event;
+    event_create(event, APPLICATIONS_DISCOVERED, startup_list);
+    event_loop_post(&g_event_loop, event);
+}
+
+void window_manager_add_discovered_applications(struct space_manager *sm, struct window_manager *wm, struct startup_application *startup_list)
+{
+    CFAbsoluteTime merge_start = CFAbsoluteTimeGetCurrent();
+
+    for (int i = 0; i < buf_len(startup_list); ++i) {
+        struct startup_application *entry = &startup_list[i];
+
+        if (entry->is_observing) {
+            window_manager_add_application(wm, entry->application);
+
+            if (entry->window_list) {
+                struct window **window_list = malloc(entry->window_count * sizeof(struct window *));
+                for (int j = 0; j < entry->window_count; ++j) {
+                    struct startup_window *window = &entry->window_list[j];
+                    window_list[j] = window->id ? window_create_with_attributes(entry->application, window->ref, window->id, &window->attributes) : NULL;
+                }
+
+                window_manager_add_application_window_list(sm, wm, entry->application, window_list, entry->window_count);
+                free(window_list);
+                free(entry->window_list);
+            }
+        } else {
+            application_unobserve(entry->application);
+            application_destroy(entry->application);
+        }
+    }
+
+    debug("%s: %d applications, merge %.3fms\n", __FUNCTION__, buf_len(startup_list), (CFAbsoluteTimeGetCurrent() - merge_start) * 1000.0f);
+
+    buf_free(startup_list);
+
     struct window *window = window_manager_focused_window(wm);
     if (window) {
         wm->last_window_id = window->id;
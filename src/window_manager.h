@@ -19,6 +19,9 @@ extern CGError SLSGetCurrentCursorLocation(int cid, CGPoint *point);
 #define kCPSUserGenerated 0x200
 #define kCPSNoWindows     0x400
 
+#define OPACITY_ANIMATION_INTERVAL (1.0f / 60.0f)
+#define OPACITY_ANIMATION_IDLE     1.0e10
+
 enum purify_mode
 {
     PURIFY_DISABLED,
@@ -47,6 +50,23 @@ static const char *ffm_mode_str[] =
     "autoraise"
 };
 
+enum frame_event
+{
+    FRAME_EVENT_EXTERNAL,
+    FRAME_EVENT_SUPERSEDED,
+    FRAME_EVENT_EXPECTED,
+    FRAME_EVENT_REFUSED
+};
+
+struct opacity_animation
+{
+    uint32_t wid;
+    float from;
+    float to;
+    float duration;
+    CFAbsoluteTime start;
+};
+
 struct window_manager
 {
     AXUIElementRef system_element;
@@ -55,6 +75,7 @@ struct window_manager
     struct table managed_window;
     struct table window_lost_focused_event;
     struct table application_lost_front_switched_event;
+    struct spatial_index spatial_index;
     struct rule **rules;
     uint32_t focused_window_id;
     ProcessSerialNumber focused_window_psn;
@@ -75,6 +96,33 @@ struct window_manager
     float active_window_opacity;
     float normal_window_opacity;
     float window_opacity_duration;
+    struct opacity_animation *opacity_animations;
+    CFRunLoopTimerRef opacity_timer;
+    volatile bool opacity_tick_pending;
+    volatile uint32_t frame_generation;
+};
+
+struct startup_window
+{
+    AXUIElementRef ref;
+    uint32_t id;
+    struct window_attributes attributes;
+};
+
+struct startup_application
+{
+    struct process *process;
+    struct application *application;
+    struct startup_window *window_list;
+    int window_count;
+    bool is_observing;
+};
+
+struct window_delta
+{
+    struct window **removed;
+    struct window **moved;
+    struct window **added;
 };
 
 void window_manager_query_windows_for_space(FILE *rsp, uint64_t sid);
@@ -87,7 +135,10 @@ bool window_manager_should_manage_window(struct window *window);
 void window_manager_tile_window(struct window_manager *wm, struct window *window);
 void window_manager_move_window(struct window *window, float x, float y);
 void window_manager_resize_window(struct window *window, float width, float height);
-void window_manager_set_window_frame(struct window *window, float x, float y, float width, float height);
+bool window_manager_set_window_frame(struct window *window, float x, float y, float width, float height);
+enum frame_event window_manager_correlate_frame_event(struct window_manager *wm, struct window *window, uint32_t generation, CGRect *frame);
+bool window_manager_update_window_constraints(struct window *window, CGRect frame, bool refused);
+void window_manager_invalidate_window_frame(struct window_manager *wm, struct window *window);
 struct window *window_manager_find_window_at_point_filtering_window(struct window_manager *wm, CGPoint point, uint32_t filter_wid);
 struct window *window_manager_find_window_at_point(struct window_manager *wm, CGPoint point);
 struct window *window_manager_find_window_below_cursor(struct window_manager *wm);
@@ -122,6 +173,7 @@ void window_manager_add_application(struct window_manager *wm, struct applicatio
 struct window **window_manager_find_application_windows(struct window_manager *wm, struct application *application, int *count);
 void window_manager_move_window_relative(struct window_manager *wm, struct window *window, int type, float dx, float dy);
 void window_manager_resize_window_relative(struct window_manager *wm, struct window *window, int direction, float dx, float dy);
+void window_manager_invalidate_window_properties(struct window_manager *wm);
 void window_manager_set_purify_mode(struct window_manager *wm, enum purify_mode mode);
 void window_manager_set_active_window_opacity(struct window_manager *wm, float opacity);
 void window_manager_set_normal_window_opacity(struct window_manager *wm, float opacity);
@@ -131,6 +183,7 @@ void window_manager_set_border_window_radius(struct window_manager *wm, float ra
 void window_manager_set_active_border_window_color(struct window_manager *wm, uint32_t color);
 void window_manager_set_normal_border_window_color(struct window_manager *wm, uint32_t color);
 void window_manager_set_window_opacity(struct window_manager *wm, struct window *window, float opacity);
+void window_manager_animate_window_opacity(struct window_manager *wm);
 void window_manager_set_window_insertion(struct space_manager *sm, struct window_manager *wm, struct window *window, int direction);
 void window_manager_warp_window(struct space_manager *sm, struct window_manager *wm, struct window *a, struct window *b);
 void window_manager_swap_window(struct space_manager *sm, struct window_manager *wm, struct window *a, struct window *b);
@@ -152,9 +205,12 @@ void window_manager_toggle_window_fullscreen(struct space_manager *sm, struct wi
 void window_manager_toggle_window_native_fullscreen(struct space_manager *sm, struct window_manager *wm, struct window *window);
 void window_manager_toggle_window_border(struct window_manager *wm, struct window *window);
 void window_manager_toggle_window_expose(struct window_manager *wm, struct window *window);
-void window_manager_validate_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid);
+void window_manager_diff_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid, struct window_delta *delta);
+void window_manager_apply_window_delta(struct space_manager *sm, struct window_manager *wm, uint64_t sid, struct window_delta *delta);
+void window_manager_reconcile_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid);
 void window_manager_check_for_windows_on_space(struct space_manager *sm, struct window_manager *wm, uint64_t sid);
 void window_manager_handle_display_add_and_remove(struct space_manager *sm, struct window_manager *wm, uint32_t display_id, uint64_t sid);
+void window_manager_add_discovered_applications(struct space_manager *sm, struct window_manager *wm, struct startup_application *startup_list);
 void window_manager_begin(struct space_manager *sm, struct window_manager *window_manager);
 void window_manager_init(struct window_manager *window_manager);
 
@@ -5,6 +5,7 @@
 
 #define CLIENT_OPT_LONG         "--message"
 #define CLIENT_OPT_SHRT         "-m"
+#define CLIENT_BATCH_OPT        "--batch"
 
 #define DEBUG_VERBOSE_OPT_LONG  "--verbose"
 #define DEBUG_VERBOSE_OPT_SHRT  "-V"
@@ -46,24 +47,129 @@ char g_config_file[4096];
 char g_lock_file[MAXLEN];
 bool g_verbose;
 
-static int client_send_message(int argc, char **argv)
+static void client_connect(int *sockfd)
 {
-    if (argc <= 1) {
-        error("yabai-msg: no arguments given! abort..\n");
-    }
-
     char *user = getenv("USER");
     if (!user) {
         error("yabai-msg: 'env USER' not set! abort..\n");
     }
 
-    int sockfd;
     char socket_file[MAXLEN];
     snprintf(socket_file, sizeof(socket_file), SOCKET_PATH_FMT, user);
 
-    if (!socket_connect_un(&sockfd, socket_file)) {
+    if (!socket_connect_un(sockfd, socket_file)) {
         error("yabai-msg: failed to connect to socket..\n");
     }
+}
+
+//
+// Splits a line into NUL-separated arguments in place, the way a shell
+// would pass them to 'yabai -m'. arguments are separated by whitespace,
+// and may be quoted with single or double quotes. a backslash escapes the
+// next character, except inside single quotes. returns the length of the
+// resulting message, or zero for blank lines and comments.
+//
+
+static inline bool client_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int client_parse_line(char *line)
+{
+    char *src = line;
+    char *dst = line;
+    int arg_count = 0;
+
+    for (;;) {
+        while (client_is_space(*src)) ++src;
+        if (!*src || (*src == '#' && arg_count == 0)) break;
+
+        char quote = 0;
+        while (*src) {
+            if (quote && *src == quote) {
+                quote = 0;
+                ++src;
+            } else if (!quote && (*src == '\'' || *src == '"')) {
+                quote = *src++;
+            } else if (!quote && client_is_space(*src)) {
+                break;
+            } else {
+                if (*src == '\\' && quote != '\'' && src[1]) ++src;
+                *dst++ = *src++;
+            }
+        }
+
+        if (*src) ++src;
+        *dst++ = '\0';
+        ++arg_count;
+    }
+
+    return arg_count ? dst - line : 0;
+}
+
+static int client_send_batch(void)
+{
+    int sockfd;
+    client_connect(&sockfd);
+
+    if (!socket_write_bytes(sockfd, SESSION_MESSAGE, 1)) {
+        error("yabai-msg: failed to send data..\n");
+    }
+
+    int result = EXIT_SUCCESS;
+    char *line = NULL;
+    size_t line_size = 0;
+
+    while (getline(&line, &line_size, stdin) != -1) {
+        int message_length = client_parse_line(line);
+        if (!message_length) continue;
+
+        if (message_length > SESSION_REQUEST_MAX) {
+            fprintf(stderr, "yabai-msg: message is longer than %d bytes, skipped..\n", SESSION_REQUEST_MAX);
+            result = EXIT_FAILURE;
+            continue;
+        }
+
+        if (!socket_session_write(sockfd, line, message_length)) {
+            error("yabai-msg: failed to send data..\n");
+        }
+
+        uint32_t rsp_length;
+        char *rsp = socket_session_read(sockfd, &rsp_length, UINT32_MAX);
+        if (!rsp) {
+            error("yabai-msg: lost connection to socket..\n");
+        }
+
+        if (rsp_length > 0 && rsp[0] == FAILURE_MESSAGE[0]) {
+            result = EXIT_FAILURE;
+            fwrite(rsp + 1, 1, rsp_length - 1, stderr);
+            fflush(stderr);
+        } else {
+            fwrite(rsp, 1, rsp_length, stdout);
+            fflush(stdout);
+        }
+
+        free(rsp);
+    }
+
+    free(line);
+    socket_close(sockfd);
+    return result;
+}
+
+static int client_send_message(int argc, char **argv)
+{
+    if (argc <= 1) {
+        error("yabai-msg: no arguments given! abort..\n");
+    }
+
+    if (argc == 2 && string_equals(argv[1], CLIENT_BATCH_OPT)) {
+        return client_send_batch();
+    }
+
+    int sockfd;
+    client_connect(&sockfd);
 
     int message_length = argc - 1;
     int argl[argc];
@@ -0,0 +1,63 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+//
+// Helpers shared by the tests, fuzzers and benchmarks in this directory. a
+// failed expectation is reported and counted; once too many have failed the
+// run is cut short, as the ones that follow are usually caused by the first.
+// rng_next is a xorshift generator, so that a run can be repeated from the
+// seed it was started with.
+//
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define TEST_FAILURE_MAX 16
+
+static int test_failures;
+
+#define expect(cond)\
+    do {\
+        if (!(cond)) {\
+            fprintf(stderr, "%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #cond);\
+            if (++test_failures > TEST_FAILURE_MAX) exit(1);\
+        }\
+    } while (0)
+
+static inline bool test_failed(const char *name)
+{
+    if (test_failures) printf("%s: %d failure(s)\n", name, test_failures);
+    return test_failures != 0;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15;
+
+static inline void rng_seed(uint64_t seed)
+{
+    rng_state = seed ? seed : 1;
+}
+
+static inline uint64_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static inline uint32_t rng_range(uint32_t n)
+{
+    return n ? rng_next() % n : 0;
+}
+
+static inline double time_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TEST_HEX_FIND_SEQ_H
+#define TEST_HEX_FIND_SEQ_H
+
+#include <stdint.h>
+#include <string.h>
+
+//
+// The byte-by-byte scan the payload used to locate Dock functions with, before
+// it was replaced by hex_pattern_find. kept as it was, apart from its loop
+// counters being unsigned, to serve as the reference that hex_pattern_find is
+// checked and timed against.
+//
+
+static uint64_t hex_find_seq(uint64_t baddr, const char *c_pattern)
+{
+    if (!baddr || !c_pattern) return 0;
+
+    uint64_t addr = baddr;
+    uint64_t pattern_length = (strlen(c_pattern) + 1) / 3;
+    char buffer_a[pattern_length];
+    char buffer_b[pattern_length];
+    memset(buffer_a, 0, sizeof(buffer_a));
+    memset(buffer_b, 0, sizeof(buffer_b));
+
+    char *pattern = (char *) c_pattern + 1;
+    for (uint64_t i = 0; i < pattern_length; ++i) {
+        char c = pattern[-1];
+        if (c == '?') {
+            buffer_b[i] = 1;
+        } else {
+            int temp = c <= '9' ? 0 : 9;
+            temp = (temp + c) << 0x4;
+            c = pattern[0];
+            int temp2 = c <= '9' ? 0xd0 : 0xc9;
+            buffer_a[i] = temp2 + c + temp;
+        }
+        pattern += 3;
+    }
+
+loop:
+    for (uint64_t counter = 0; counter < pattern_length; ++counter) {
+        if ((buffer_b[counter] == 0) && (((char *)addr)[counter] != buffer_a[counter])) {
+            addr = (uint64_t)((char *)addr + 1);
+            if (addr - baddr < 0x286a0) {
+                goto loop;
+            } else {
+                return 0;
+            }
+        }
+    }
+
+    return addr;
+}
+
+#endif
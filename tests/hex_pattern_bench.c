@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/osax/hex_pattern.h"
+#include "../src/misc/macros.h"
+#include "hex_find_seq.h"
+#include "helpers.h"
+
+//
+// Measures how long it takes to locate Dock functions with the byte-by-byte scan
+// the payload used before and with the anchored matcher it uses now. the Dock is
+// not available here, so the patterns are searched for in generated bytes with
+// roughly the byte distribution of x86-64 code, planted at the end of the
+// scanned range (the worst case for both) or left out entirely.
+//
+// usage: hex_pattern_bench [iterations]
+//
+
+#define DEFAULT_ITERATIONS 100
+
+static volatile uint64_t sink;
+
+static const char *patterns[] = {
+    "?? ?? ?? 00 48 8B 38 48 8B B5 E0 FD FF FF 4C 8B BD B8 FE FF FF 4C 89 FA 41 FF D5 48 89 C7 E8 ?? ?? ?? 00 49 89 C5 4C 89 EF 48 8B B5 80 FE FF FF FF 15 ?? ?? ?? 00 48 89 C7 E8 ?? ?? ?? 00 48 89 C3 48 89 9D C8 FE FF FF 4C 89 EF 48 8B 05 ?? ?? ?? 00",
+    "55 48 89 E5 41 57 41 56 41 55 41 54 53 48 83 EC 38 4C 89 6D B0 49 89 FC 48 BB 01 00 00 00 00 00 00 C0 48 B9 01 00 00 00 00 00 00 80 49 BF F8 FF FF FF FF FF FF 00 49 8D 45 28 48 89 45 C0 4D 8B 75 28 41 80 7D 38 01 4C 89 65 C8",
+    "55 48 89 E5 41 57 41 56 41 55 41 54 53 48 83 EC 48 4D 89 EC 41 89 D5 49 89 ?? ?? 89 FB 48 8B 05 ?? ?? ?? 00 4C 8B 3C 03 4C 89 ?? 4C 89 E6 E8 ?? CC 00 00 48 89 55 ?? 48 89 45 ?? 48 85 C0 0F 84 ?? ?? 00 00",
+};
+
+static const uint8_t common_bytes[] = {
+    0x00, 0xFF, 0x0F, 0x24, 0x41, 0x45, 0x48, 0x49, 0x4C, 0x4D, 0x53, 0x54,
+    0x55, 0x56, 0x57, 0x5D, 0x83, 0x85, 0x89, 0x8B, 0x8D, 0xC3, 0xC7, 0xE5,
+    0xE8, 0xEC
+};
+
+static void fill_code(uint8_t *bytes, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t r = rng_next();
+        bytes[i] = (r & 0xFF) < 0x66 ? common_bytes[(r >> 8) % array_count(common_bytes)] : (r >> 16) & 0xFF;
+    }
+}
+
+static void report(const char *name, double elapsed, int count)
+{
+    double us = elapsed * 1.0e6 / count;
+    printf("hex_pattern_bench: %-32s %10.1f us/scan %10.1f MB/s\n", name, us, HEX_FIND_SEQ_RANGE / us / (1024.0 * 1024.0) * 1.0e6);
+}
+
+static void bench(const char *name, uint8_t *haystack, const char *c_pattern, int iterations)
+{
+    struct hex_pattern pattern;
+    hex_pattern_compile(c_pattern, &pattern);
+
+    uint64_t expected = hex_find_seq((uint64_t) haystack, c_pattern);
+    if (hex_pattern_find(&pattern, (uint64_t) haystack) != expected) {
+        fprintf(stderr, "hex_pattern_bench: %s: the scans disagree\n", name);
+        exit(1);
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s byte scan", name);
+
+    double start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        sink += hex_find_seq((uint64_t) haystack, c_pattern);
+    }
+    double byte_scan = time_now() - start;
+    report(label, byte_scan, iterations);
+
+    snprintf(label, sizeof(label), "%s anchored", name);
+
+    start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        hex_pattern_compile(c_pattern, &pattern);
+        sink += hex_pattern_find(&pattern, (uint64_t) haystack);
+    }
+    double anchored = time_now() - start;
+    report(label, anchored, iterations);
+
+    printf("hex_pattern_bench: %-32s %10.1fx\n", name, byte_scan / anchored);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+    for (int i = 0; i < (int) array_count(patterns); ++i) {
+        struct hex_pattern pattern;
+        hex_pattern_compile(patterns[i], &pattern);
+
+        size_t size = HEX_FIND_SEQ_RANGE + pattern.length - 1;
+        uint8_t *haystack = malloc(size);
+        fill_code(haystack, size);
+
+        char name[32];
+        snprintf(name, sizeof(name), "pattern %d, no match", i);
+        bench(name, haystack, patterns[i], iterations);
+
+        for (int j = 0; j < pattern.length; ++j) {
+            if (!pattern.is_wildcard[j]) haystack[HEX_FIND_SEQ_RANGE - 1 + j] = pattern.bytes[j];
+        }
+
+        snprintf(name, sizeof(name), "pattern %d, match at end", i);
+        bench(name, haystack, patterns[i], iterations);
+
+        free(haystack);
+    }
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/osax/hex_pattern.h"
+#include "../src/misc/macros.h"
+#include "hex_find_seq.h"
+#include "helpers.h"
+
+//
+// Checks the pattern matcher the payload uses to locate functions in the Dock:
+// how patterns compile, which byte is picked as the anchor, and that a match is
+// found wherever it sits in the scanned range, including at its very end. the
+// haystacks are allocated at the exact size a scan may read, so that the
+// sanitizers catch any read past them. random patterns are checked against the
+// byte-by-byte scan the matcher replaced, which returns the first match.
+//
+// usage: hex_pattern_test [iterations] [seed]
+//
+
+#define DEFAULT_ITERATIONS 500
+#define FILLER 0x90
+
+//
+// A scan starting at the beginning of the haystack looks at candidates up to
+// HEX_FIND_SEQ_RANGE - 1 and compares the full pattern there, so that is how
+// much memory it may touch. extra makes room for a match just past the range.
+//
+
+static uint8_t *haystack_create(struct hex_pattern *pattern, int extra, size_t *size)
+{
+    *size = HEX_FIND_SEQ_RANGE + pattern->length - 1 + extra;
+    uint8_t *haystack = malloc(*size);
+    memset(haystack, FILLER, *size);
+    return haystack;
+}
+
+static void haystack_plant(uint8_t *haystack, struct hex_pattern *pattern, int offset)
+{
+    for (int i = 0; i < pattern->length; ++i) {
+        if (!pattern->is_wildcard[i]) haystack[offset + i] = pattern->bytes[i];
+    }
+}
+
+static int find_offset(struct hex_pattern *pattern, uint8_t *haystack)
+{
+    uint64_t addr = hex_pattern_find(pattern, (uint64_t) haystack);
+    return addr ? (int)(addr - (uint64_t) haystack) : -1;
+}
+
+static void test_compile(void)
+{
+    struct hex_pattern pattern;
+
+    expect(hex_pattern_compile("48 8B ?? 05", &pattern));
+    expect(pattern.length == 4);
+    expect(pattern.bytes[0] == 0x48 && pattern.bytes[1] == 0x8B && pattern.bytes[3] == 0x05);
+    expect(!pattern.is_wildcard[0] && !pattern.is_wildcard[1] && pattern.is_wildcard[2] && !pattern.is_wildcard[3]);
+    expect(pattern.anchor == 3);
+
+    expect(hex_pattern_compile("e8 a1  ff", &pattern));
+    expect(pattern.length == 3);
+    expect(pattern.bytes[0] == 0xE8 && pattern.bytes[1] == 0xA1 && pattern.bytes[2] == 0xFF);
+    expect(pattern.anchor == 1);
+
+    expect(hex_pattern_compile("00 FF 00", &pattern));
+    expect(pattern.anchor == 0);
+
+    expect(hex_pattern_compile("?? ??", &pattern));
+    expect(pattern.length == 2);
+    expect(pattern.anchor == -1);
+
+    expect(!hex_pattern_compile("", &pattern));
+    expect(!hex_pattern_compile("   ", &pattern));
+    expect(!hex_pattern_compile("4", &pattern));
+    expect(!hex_pattern_compile("48 8", &pattern));
+    expect(!hex_pattern_compile("4G", &pattern));
+    expect(!hex_pattern_compile("?A", &pattern));
+
+    char too_long[HEX_PATTERN_MAX * 3 + 4];
+    for (int i = 0; i <= HEX_PATTERN_MAX; ++i) memcpy(too_long + i * 3, "A1 ", 3);
+    too_long[HEX_PATTERN_MAX * 3 + 2] = '\0';
+    expect(!hex_pattern_compile(too_long, &pattern));
+    too_long[HEX_PATTERN_MAX * 3 - 1] = '\0';
+    expect(hex_pattern_compile(too_long, &pattern));
+    expect(pattern.length == HEX_PATTERN_MAX);
+}
+
+static void test_anchor_offsets(void)
+{
+    struct {
+        const char *pattern;
+        int anchor;
+    } cases[] = {
+        { "A1 48 89 E5",          0 },
+        { "48 89 A1 E5 ?? 00",    2 },
+        { "?? 48 89 E5 ?? A1",    5 },
+        { "?? ?? ?? 00 48 8B 38", 6 },
+    };
+
+    int offsets[] = { 0, 1, 7, 4096, HEX_FIND_SEQ_RANGE / 2, HEX_FIND_SEQ_RANGE - 2 };
+
+    for (int i = 0; i < array_count(cases); ++i) {
+        struct hex_pattern pattern;
+        expect(hex_pattern_compile(cases[i].pattern, &pattern));
+        expect(pattern.anchor == cases[i].anchor);
+
+        for (int j = 0; j < array_count(offsets); ++j) {
+            size_t size;
+            uint8_t *haystack = haystack_create(&pattern, 0, &size);
+            haystack_plant(haystack, &pattern, offsets[j]);
+            expect(find_offset(&pattern, haystack) == offsets[j]);
+            free(haystack);
+        }
+    }
+}
+
+static void test_no_match(void)
+{
+    struct hex_pattern pattern;
+    expect(hex_pattern_compile("48 89 ?? A1 E5", &pattern));
+
+    size_t size;
+    uint8_t *haystack = haystack_create(&pattern, 0, &size);
+    expect(find_offset(&pattern, haystack) == -1);
+
+    //
+    // every position holds the anchor, but the rest of the pattern never follows
+    //
+
+    memset(haystack, 0xA1, size);
+    expect(find_offset(&pattern, haystack) == -1);
+
+    //
+    // near misses, differing from the pattern in a single byte
+    //
+
+    memset(haystack, FILLER, size);
+    for (int offset = 0; offset + pattern.length <= size; offset += 64) {
+        haystack_plant(haystack, &pattern, offset);
+        haystack[offset + (offset & 64 ? 0 : 4)] ^= 0x01;
+    }
+    expect(find_offset(&pattern, haystack) == -1);
+
+    free(haystack);
+}
+
+static void test_range_end(void)
+{
+    struct hex_pattern pattern;
+    expect(hex_pattern_compile("48 ?? A1 E5", &pattern));
+
+    size_t size;
+    uint8_t *haystack = haystack_create(&pattern, 0, &size);
+    haystack_plant(haystack, &pattern, HEX_FIND_SEQ_RANGE - 1);
+    expect(find_offset(&pattern, haystack) == HEX_FIND_SEQ_RANGE - 1);
+    expect(hex_find_seq((uint64_t) haystack, "48 ?? A1 E5") == (uint64_t) haystack + HEX_FIND_SEQ_RANGE - 1);
+    free(haystack);
+
+    haystack = haystack_create(&pattern, 1, &size);
+    haystack_plant(haystack, &pattern, HEX_FIND_SEQ_RANGE);
+    expect(find_offset(&pattern, haystack) == -1);
+    expect(hex_find_seq((uint64_t) haystack, "48 ?? A1 E5") == 0);
+    free(haystack);
+}
+
+static void test_first_match(void)
+{
+    struct hex_pattern pattern;
+    expect(hex_pattern_compile("48 48 A1", &pattern));
+
+    size_t size;
+    uint8_t *haystack = haystack_create(&pattern, 0, &size);
+    haystack_plant(haystack, &pattern, 50000);
+    haystack_plant(haystack, &pattern, 100);
+    haystack_plant(haystack, &pattern, HEX_FIND_SEQ_RANGE - 1);
+    expect(find_offset(&pattern, haystack) == 100);
+
+    //
+    // 48 48 48 A1 only matches at its second byte
+    //
+
+    haystack[10] = 0x48;
+    haystack[11] = 0x48;
+    haystack[12] = 0x48;
+    haystack[13] = 0xA1;
+    expect(find_offset(&pattern, haystack) == 11);
+
+    free(haystack);
+
+    expect(hex_pattern_compile("?? ?? ??", &pattern));
+    haystack = haystack_create(&pattern, 0, &size);
+    expect(find_offset(&pattern, haystack) == 0);
+    free(haystack);
+}
+
+//
+// Patterns and haystacks are drawn from a handful of byte values, so that
+// anchors show up everywhere and most patterns match several times.
+//
+
+static void test_against_byte_scan(void)
+{
+    static const uint8_t alphabet[] = { 0x48, 0x89, 0xE5, 0xA1 };
+    char c_pattern[16 * 3 + 1];
+    struct hex_pattern pattern;
+
+    int length = 1 + rng_range(16);
+    for (int i = 0; i < length; ++i) {
+        if (rng_range(4) == 0) {
+            memcpy(c_pattern + i * 3, "?? ", 3);
+        } else {
+            snprintf(c_pattern + i * 3, 4, "%02X ", alphabet[rng_range(array_count(alphabet))]);
+        }
+    }
+    c_pattern[length * 3 - 1] = '\0';
+
+    expect(hex_pattern_compile(c_pattern, &pattern));
+    expect(pattern.length == length);
+
+    size_t size;
+    uint8_t *haystack = haystack_create(&pattern, 0, &size);
+
+    uint32_t density = 1 + rng_range(64);
+    for (size_t i = 0; i < size; ++i) {
+        if (rng_range(density) == 0) haystack[i] = alphabet[rng_range(array_count(alphabet))];
+    }
+
+    uint64_t expected = hex_find_seq((uint64_t) haystack, c_pattern);
+    uint64_t actual = hex_pattern_find(&pattern, (uint64_t) haystack);
+    if (actual != expected) {
+        fprintf(stderr, "hex_pattern_test: '%s' found at %lld, byte scan found %lld\n", c_pattern,
+                actual ? (long long)(actual - (uint64_t) haystack) : -1,
+                expected ? (long long)(expected - (uint64_t) haystack) : -1);
+    }
+    expect(actual == expected);
+
+    free(haystack);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (argc > 2) rng_seed(strtoull(argv[2], NULL, 0));
+
+    test_compile();
+    test_anchor_offsets();
+    test_no_match();
+    test_range_end();
+    test_first_match();
+
+    for (int i = 0; i < iterations; ++i) {
+        test_against_byte_scan();
+    }
+
+    if (test_failed("hex_pattern_test")) return 1;
+
+    printf("hex_pattern_test: %d iterations ok\n", iterations);
+    return 0;
+}
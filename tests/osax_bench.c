@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/osax/common.h"
+#include "helpers.h"
+
+//
+// Measures how long it takes to encode and decode scripting addition messages,
+// for single operations and for full batch frames, next to the text format the
+// protocol used before (snprintf on one end, tokenize and strtoul / strtof on the
+// other).
+//
+// usage: osax_bench [iterations]
+//
+
+#define DEFAULT_ITERATIONS 2000000
+
+static volatile uint64_t sink;
+
+static void report(const char *name, double elapsed, int count, uint64_t bytes)
+{
+    printf("osax_bench: %-28s %8.1f ns/op %10.1f MB/s\n", name, elapsed * 1.0e9 / count, bytes / elapsed / (1024.0 * 1024.0));
+}
+
+static struct osax_op make_op(int i)
+{
+    switch (i % 4) {
+    case 0:  return (struct osax_op) { .opcode = OSAX_OP_WINDOW_ALPHA_FADE, .window_alpha = { 1000 + i, 0.85f, 0.25f } };
+    case 1:  return (struct osax_op) { .opcode = OSAX_OP_WINDOW_SHADOW, .window = { 1000 + i, i & 1 } };
+    case 2:  return (struct osax_op) { .opcode = OSAX_OP_WINDOW_MOVE, .window_move = { 1000 + i, i & 0xFFF, (i >> 12) & 0xFFF } };
+    default: return (struct osax_op) { .opcode = OSAX_OP_SPACE_FOCUS, .space = { 0x100000000 + i } };
+    }
+}
+
+static void bench_binary_single(int iterations)
+{
+    uint8_t bytes[64];
+    struct osax_writer writer;
+    struct osax_reader reader;
+    struct osax_op decoded;
+    uint64_t total = 0;
+
+    double start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        struct osax_op op = make_op(i);
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_op(&writer, &op);
+        total += writer.length;
+    }
+    report("binary encode", time_now() - start, iterations, total);
+
+    struct osax_op op = make_op(0);
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+    osax_encode_op(&writer, &op);
+
+    start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        osax_reader_init(&reader, bytes, writer.length);
+        uint8_t version = osax_read_u8(&reader);
+        uint8_t opcode = osax_read_u8(&reader);
+        osax_decode_op_fields(&reader, opcode, &decoded);
+        sink += version + decoded.window_alpha.wid;
+    }
+    report("binary decode", time_now() - start, iterations, (uint64_t) iterations * writer.length);
+}
+
+static void bench_binary_batch(int iterations)
+{
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    struct osax_reader reader;
+    struct osax_op decoded;
+
+    int per_frame = 200;
+    int frames = iterations / per_frame;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+
+    double start = time_now();
+    for (int f = 0; f < frames; ++f) {
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_batch_header(&writer, OSAX_OP_WINDOW_ALPHA_FADE, per_frame);
+        for (int i = 0; i < per_frame; ++i) {
+            struct osax_op op = { .opcode = OSAX_OP_WINDOW_ALPHA_FADE, .window_alpha = { 1000 + i, 0.85f, 0.25f } };
+            osax_encode_op_fields(&writer, &op);
+        }
+        sink += writer.length;
+    }
+    report("binary batch encode (200)", time_now() - start, frames * per_frame, (uint64_t) frames * writer.length);
+
+    start = time_now();
+    for (int f = 0; f < frames; ++f) {
+        osax_reader_init(&reader, bytes, writer.length);
+        osax_read_u8(&reader);
+        osax_read_u8(&reader);
+        uint8_t opcode = osax_read_u8(&reader);
+        int count = osax_read_u16(&reader);
+        for (int i = 0; i < count; ++i) {
+            osax_decode_op_fields(&reader, opcode, &decoded);
+            sink += decoded.window_alpha.wid;
+        }
+    }
+    report("binary batch decode (200)", time_now() - start, frames * per_frame, (uint64_t) frames * writer.length);
+}
+
+//
+// The text format as it was produced by the daemon and parsed by the payload.
+//
+
+static const char *text_token(const char **message, int *length)
+{
+    const char *start = *message;
+    while (**message && **message != ' ' && **message != '\n') ++(*message);
+    *length = *message - start;
+    if (**message) ++(*message);
+    return start;
+}
+
+static uint32_t text_token_to_uint32(const char *token, int length)
+{
+    char buffer[length + 1];
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    return strtoul(buffer, NULL, 0);
+}
+
+static float text_token_to_float(const char *token, int length)
+{
+    char buffer[length + 1];
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    return strtof(buffer, NULL);
+}
+
+static void bench_text_single(int iterations)
+{
+    char bytes[64];
+    uint64_t total = 0;
+
+    double start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        total += snprintf(bytes, sizeof(bytes), "window_alpha_fade %d %f %f", 1000 + i, 0.85f, 0.25f);
+    }
+    report("text encode", time_now() - start, iterations, total);
+
+    int length = snprintf(bytes, sizeof(bytes), "window_alpha_fade %d %f %f", 1000, 0.85f, 0.25f);
+
+    start = time_now();
+    for (int i = 0; i < iterations; ++i) {
+        int token_length;
+        const char *message = bytes;
+        const char *token = text_token(&message, &token_length);
+        if (token_length != 17 || memcmp(token, "window_alpha_fade", 17) != 0) continue;
+
+        token = text_token(&message, &token_length);
+        uint32_t wid = text_token_to_uint32(token, token_length);
+        token = text_token(&message, &token_length);
+        float alpha = text_token_to_float(token, token_length);
+        token = text_token(&message, &token_length);
+        float duration = text_token_to_float(token, token_length);
+        sink += wid + (uint64_t)(alpha * 100) + (uint64_t)(duration * 100);
+    }
+    report("text decode", time_now() - start, iterations, (uint64_t) iterations * length);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+    bench_binary_single(iterations);
+    bench_binary_batch(iterations);
+    bench_text_single(iterations);
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/osax/common.h"
+#include "helpers.h"
+
+//
+// Feeds random and mutated messages through the decoding paths of the scripting
+// addition protocol and checks that every operation survives an encode / decode
+// round-trip. Buffers are allocated at their exact size, so that the sanitizers
+// catch any read or write outside of them.
+//
+// usage: osax_fuzz [iterations] [seed]
+//
+
+#define DEFAULT_ITERATIONS 200000
+
+static void rng_fill(uint8_t *bytes, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; ++i) bytes[i] = rng_next() & 0xFF;
+}
+
+static uint8_t random_opcode(void)
+{
+    return OSAX_OP_HANDSHAKE + rng_range(OSAX_OP_TRANSACTION - OSAX_OP_HANDSHAKE + 1);
+}
+
+static struct osax_op random_op(uint8_t opcode)
+{
+    struct osax_op op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = opcode;
+
+    switch (opcode) {
+    case OSAX_OP_HANDSHAKE: {
+        op.handshake.capabilities = rng_next();
+    } break;
+    case OSAX_OP_SPACE_FOCUS:
+    case OSAX_OP_SPACE_CREATE:
+    case OSAX_OP_SPACE_DESTROY: {
+        op.space.sid = rng_next();
+    } break;
+    case OSAX_OP_SPACE_MOVE: {
+        op.space_move.src_sid = rng_next();
+        op.space_move.dst_sid = rng_next();
+        op.space_move.focus = rng_next() & 0xFF;
+    } break;
+    case OSAX_OP_WINDOW_MOVE: {
+        op.window_move.wid = rng_next();
+        op.window_move.x = rng_next();
+        op.window_move.y = rng_next();
+    } break;
+    case OSAX_OP_WINDOW_ALPHA:
+    case OSAX_OP_WINDOW_ALPHA_FADE: {
+        op.window_alpha.wid = rng_next();
+        op.window_alpha.alpha = (float) rng_range(1001) / 1000.0f;
+        op.window_alpha.duration = opcode == OSAX_OP_WINDOW_ALPHA_FADE ? (float) rng_range(5001) / 1000.0f : 0.0f;
+    } break;
+    case OSAX_OP_WINDOW_LEVEL: {
+        op.window.wid = rng_next();
+        op.window.value = rng_next();
+    } break;
+    case OSAX_OP_WINDOW_STICKY:
+    case OSAX_OP_WINDOW_SHADOW: {
+        op.window.wid = rng_next();
+        op.window.value = rng_next() & 0xFF;
+    } break;
+    case OSAX_OP_WINDOW_FOCUS:
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: {
+        op.window.wid = rng_next();
+    } break;
+    }
+
+    return op;
+}
+
+static bool op_equals(struct osax_op *a, struct osax_op *b)
+{
+    if (a->opcode != b->opcode) return false;
+
+    switch (a->opcode) {
+    case OSAX_OP_HANDSHAKE:                  return a->handshake.capabilities == b->handshake.capabilities;
+    case OSAX_OP_SPACE_FOCUS:
+    case OSAX_OP_SPACE_CREATE:
+    case OSAX_OP_SPACE_DESTROY:              return a->space.sid == b->space.sid;
+    case OSAX_OP_SPACE_MOVE:                 return a->space_move.src_sid == b->space_move.src_sid &&
+                                                    a->space_move.dst_sid == b->space_move.dst_sid &&
+                                                    a->space_move.focus == b->space_move.focus;
+    case OSAX_OP_WINDOW_MOVE:                return a->window_move.wid == b->window_move.wid &&
+                                                    a->window_move.x == b->window_move.x &&
+                                                    a->window_move.y == b->window_move.y;
+    case OSAX_OP_WINDOW_ALPHA:               return a->window_alpha.wid == b->window_alpha.wid &&
+                                                    a->window_alpha.alpha == b->window_alpha.alpha;
+    case OSAX_OP_WINDOW_ALPHA_FADE:          return a->window_alpha.wid == b->window_alpha.wid &&
+                                                    a->window_alpha.alpha == b->window_alpha.alpha &&
+                                                    a->window_alpha.duration == b->window_alpha.duration;
+    case OSAX_OP_WINDOW_LEVEL:
+    case OSAX_OP_WINDOW_STICKY:
+    case OSAX_OP_WINDOW_SHADOW:              return a->window.wid == b->window.wid && a->window.value == b->window.value;
+    case OSAX_OP_WINDOW_FOCUS:
+    case OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE: return a->window.wid == b->window.wid;
+    }
+
+    return false;
+}
+
+//
+// Walks a message the same way handle_message in payload.m does.
+//
+
+static int decode_message(const uint8_t *bytes, uint32_t length)
+{
+    struct osax_reader reader;
+    struct osax_op op;
+    int decoded = 0;
+
+    osax_reader_init(&reader, bytes, length);
+    uint8_t version = osax_read_u8(&reader);
+    uint8_t opcode = osax_read_u8(&reader);
+    if (reader.error || version != OSAX_PROTOCOL_VERSION) return 0;
+
+    if (opcode == OSAX_OP_BATCH) {
+        uint8_t batch_opcode = osax_read_u8(&reader);
+        int count = osax_read_u16(&reader);
+        if (reader.error || !osax_op_is_batchable(batch_opcode)) return 0;
+
+        for (int i = 0; i < count; ++i) {
+            if (!osax_decode_op_fields(&reader, batch_opcode, &op)) break;
+            ++decoded;
+        }
+    } else if (opcode == OSAX_OP_TRANSACTION) {
+        struct osax_op op_list[OSAX_TRANSACTION_OP_MAX];
+        decoded = osax_decode_transaction(&reader, op_list, OSAX_TRANSACTION_OP_MAX);
+        for (int i = 0; i < decoded; ++i) expect(osax_op_is_transactable(op_list[i].opcode));
+    } else if (osax_decode_op_fields(&reader, opcode, &op)) {
+        decoded = 1;
+    }
+
+    expect(reader.cursor <= reader.length);
+    return decoded;
+}
+
+//
+// Splits a stream into frames the same way connection_read in payload.m does.
+//
+
+static int split_frames(const uint8_t *bytes, uint32_t length)
+{
+    uint32_t offset = 0;
+    int count = 0;
+
+    while (length - offset >= OSAX_FRAME_HEADER_SIZE) {
+        struct osax_frame_header header = osax_decode_frame_header(bytes + offset);
+        if (header.length > OSAX_FRAME_MAX) return -1;
+        if (length - offset - OSAX_FRAME_HEADER_SIZE < header.length) break;
+
+        uint8_t *message = malloc(header.length ? header.length : 1);
+        memcpy(message, bytes + offset + OSAX_FRAME_HEADER_SIZE, header.length);
+        decode_message(message, header.length);
+        free(message);
+
+        offset += OSAX_FRAME_HEADER_SIZE + header.length;
+        ++count;
+    }
+
+    return count;
+}
+
+static void fuzz_message(void)
+{
+    uint32_t length = rng_range(8) == 0 ? rng_range(OSAX_FRAME_MAX + 1) : rng_range(64);
+    uint8_t *bytes = malloc(length ? length : 1);
+    rng_fill(bytes, length);
+
+    //
+    // Purely random bytes rarely get past the version check, so most messages start
+    // with a valid version and opcode, and batches and transactions with a plausible
+    // record opcode.
+    //
+
+    if (length >= 1 && rng_range(4)) bytes[0] = OSAX_PROTOCOL_VERSION;
+    if (length >= 2 && rng_range(4)) bytes[1] = random_opcode();
+    if (length >= 3 && rng_range(2)) bytes[2] = random_opcode();
+    if (length >= 5 && rng_range(2)) bytes[4] = 0;
+
+    decode_message(bytes, length);
+    free(bytes);
+}
+
+static void fuzz_stream(void)
+{
+    uint32_t length = rng_range(3 * (OSAX_FRAME_HEADER_SIZE + 64));
+    uint8_t *bytes = malloc(length ? length : 1);
+    rng_fill(bytes, length);
+
+    for (uint32_t offset = 0; offset + OSAX_FRAME_HEADER_SIZE <= length; offset += OSAX_FRAME_HEADER_SIZE + 16) {
+        if (rng_range(2)) osax_store_u32(bytes + offset, rng_range(length));
+    }
+
+    split_frames(bytes, length);
+    free(bytes);
+}
+
+static void round_trip_op(void)
+{
+    uint8_t opcode = OSAX_OP_HANDSHAKE + rng_range(OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE);
+    struct osax_op op = random_op(opcode);
+
+    uint32_t size = 2 + osax_op_fields_size(opcode);
+    uint8_t *bytes = malloc(size);
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, size);
+    osax_encode_op(&writer, &op);
+    expect(!writer.overflow);
+    expect(writer.length == size);
+
+    struct osax_reader reader;
+    struct osax_op decoded;
+    osax_reader_init(&reader, bytes, writer.length);
+    expect(osax_read_u8(&reader) == OSAX_PROTOCOL_VERSION);
+    expect(osax_read_u8(&reader) == opcode);
+    expect(osax_decode_op_fields(&reader, opcode, &decoded));
+    expect(reader.cursor == reader.length);
+    expect(op_equals(&op, &decoded));
+
+    //
+    // Every truncation of the message must be rejected.
+    //
+
+    uint32_t truncated = rng_range(size - 2);
+    osax_reader_init(&reader, bytes + 2, truncated);
+    expect(!osax_decode_op_fields(&reader, opcode, &decoded));
+
+    //
+    // A writer that is one byte short must stop without writing past its end.
+    //
+
+    osax_writer_init(&writer, bytes, size - 1);
+    osax_encode_op(&writer, &op);
+    expect(writer.overflow);
+    expect(writer.length <= size - 1);
+
+    free(bytes);
+}
+
+static void round_trip_batch(void)
+{
+    static const uint8_t batchable[] = {
+        OSAX_OP_WINDOW_MOVE, OSAX_OP_WINDOW_ALPHA, OSAX_OP_WINDOW_ALPHA_FADE, OSAX_OP_WINDOW_LEVEL,
+        OSAX_OP_WINDOW_STICKY, OSAX_OP_WINDOW_SHADOW, OSAX_OP_WINDOW_SHADOW_IRREVERSIBLE
+    };
+
+    uint8_t opcode = batchable[rng_range(sizeof(batchable))];
+    int capacity = (OSAX_FRAME_MAX - 5) / osax_op_fields_size(opcode);
+    int count = 1 + rng_range(capacity);
+
+    struct osax_op *ops = malloc(sizeof(struct osax_op) * count);
+    uint8_t *bytes = malloc(OSAX_FRAME_MAX);
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, OSAX_FRAME_MAX);
+    osax_encode_batch_header(&writer, opcode, count);
+
+    for (int i = 0; i < count; ++i) {
+        ops[i] = random_op(opcode);
+        osax_encode_op_fields(&writer, &ops[i]);
+    }
+    expect(!writer.overflow);
+
+    struct osax_reader reader;
+    struct osax_op decoded;
+    osax_reader_init(&reader, bytes, writer.length);
+    expect(osax_read_u8(&reader) == OSAX_PROTOCOL_VERSION);
+    expect(osax_read_u8(&reader) == OSAX_OP_BATCH);
+    expect(osax_read_u8(&reader) == opcode);
+    expect(osax_read_u16(&reader) == count);
+
+    for (int i = 0; i < count; ++i) {
+        expect(osax_decode_op_fields(&reader, opcode, &decoded));
+        expect(op_equals(&ops[i], &decoded));
+    }
+    expect(reader.cursor == reader.length);
+    expect(decode_message(bytes, writer.length) == count);
+
+    free(bytes);
+    free(ops);
+}
+
+static void round_trip_transaction(void)
+{
+    int count = 1 + rng_range(16);
+    struct osax_op ops[16];
+    struct osax_op decoded[OSAX_TRANSACTION_OP_MAX];
+
+    for (int i = 0; i < count; ++i) {
+        ops[i] = random_op(OSAX_OP_SPACE_FOCUS + rng_range(OSAX_OP_SPACE_MOVE - OSAX_OP_SPACE_FOCUS + 1));
+    }
+
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+    osax_encode_transaction(&writer, ops, count);
+    expect(!writer.overflow);
+
+    struct osax_reader reader;
+    osax_reader_init(&reader, bytes + 2, writer.length - 2);
+    expect(osax_decode_transaction(&reader, decoded, OSAX_TRANSACTION_OP_MAX) == count);
+    for (int i = 0; i < count; ++i) expect(op_equals(&ops[i], &decoded[i]));
+
+    //
+    // A window operation inside a transaction rejects the whole transaction.
+    //
+
+    bytes[4] = OSAX_OP_WINDOW_FOCUS;
+    osax_reader_init(&reader, bytes + 2, writer.length - 2);
+    expect(osax_decode_transaction(&reader, decoded, OSAX_TRANSACTION_OP_MAX) == -1);
+}
+
+static void round_trip_frame_header(void)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE];
+    uint32_t length = rng_next();
+    uint32_t id = rng_next();
+
+    osax_encode_frame_header(bytes, length, id);
+    struct osax_frame_header header = osax_decode_frame_header(bytes);
+    expect(header.length == length);
+    expect(header.id == id);
+}
+
+static void test_wire_format(void)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE];
+    uint8_t expected_header[] = { 0x44, 0x33, 0x22, 0x11, 0xDD, 0xCC, 0xBB, 0xAA };
+    osax_encode_frame_header(bytes, 0x11223344, 0xAABBCCDD);
+    expect(memcmp(bytes, expected_header, sizeof(expected_header)) == 0);
+
+    uint8_t message[32];
+    struct osax_writer writer;
+    struct osax_op op = { .opcode = OSAX_OP_SPACE_MOVE, .space_move = { 0x0102030405060708, 0x1112131415161718, 1 } };
+    uint8_t expected_message[] = {
+        OSAX_PROTOCOL_VERSION, OSAX_OP_SPACE_MOVE,
+        0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01,
+        0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11,
+        0x01
+    };
+    osax_writer_init(&writer, message, sizeof(message));
+    osax_encode_op(&writer, &op);
+    expect(writer.length == sizeof(expected_message));
+    expect(memcmp(message, expected_message, sizeof(expected_message)) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (argc > 2) rng_seed(strtoull(argv[2], NULL, 0));
+
+    test_wire_format();
+
+    for (int i = 0; i < iterations; ++i) {
+        fuzz_message();
+        if ((i & 3) == 0) fuzz_stream();
+        round_trip_op();
+        round_trip_frame_header();
+        if ((i & 15) == 0) round_trip_batch();
+        if ((i & 15) == 0) round_trip_transaction();
+    }
+
+    if (test_failed("osax_fuzz")) return 1;
+
+    printf("osax_fuzz: %d iterations ok\n", iterations);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef TEST_PLATFORM_H
+#define TEST_PLATFORM_H
+
+//
+// Just enough of CoreGraphics for the platform independent parts of yabai
+// to compile on a machine without the macOS SDK.
+//
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef double CGFloat;
+
+typedef struct { CGFloat x; CGFloat y; } CGPoint;
+typedef struct { CGFloat width; CGFloat height; } CGSize;
+typedef struct { CGPoint origin; CGSize size; } CGRect;
+
+static const CGSize CGSizeZero;
+
+static inline CGFloat CGRectGetMaxX(CGRect r) { return r.origin.x + r.size.width;  }
+static inline CGFloat CGRectGetMaxY(CGRect r) { return r.origin.y + r.size.height; }
+
+static inline CGRect CGRectIntegral(CGRect r)
+{
+    CGFloat x = floor(r.origin.x);
+    CGFloat y = floor(r.origin.y);
+    return (CGRect) { { x, y }, { ceil(CGRectGetMaxX(r)) - x, ceil(CGRectGetMaxY(r)) - y } };
+}
+
+#endif
@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../src/osax/common.h"
+
+//
+// Replays the traffic yabai sends to the scripting addition against sa_standin
+// and reports throughput and per-event latency for each transport:
+//
+//   legacy - one connection per operation, closed by the payload once applied;
+//            the transport yabai used before the stream protocol.
+//   stream - one persistent connection, one frame per operation, up to
+//            SA_MAX_INFLIGHT frames in flight, as in osax/sa.m.
+//   batch  - the stream, with consecutive window operations of the same kind
+//            within an event folded into batch frames, as in osax/sa.m.
+//
+// The latency of an event is the time from its first operation being sent until
+// the payload has applied the last one, which is what the user ends up seeing.
+//
+// usage: sa_bench -x <sa_standin> [-s socket] [-t transport] [-n scale] [-- standin options]
+//
+
+#define SA_MAX_INFLIGHT 32
+#define DEFAULT_SOCKET "/tmp/yabai-sa-standin.socket"
+
+enum transport
+{
+    TRANSPORT_LEGACY,
+    TRANSPORT_STREAM,
+    TRANSPORT_BATCH,
+
+    TRANSPORT_COUNT
+};
+
+static const char *transport_str[] =
+{
+    "legacy",
+    "stream",
+    "batch",
+};
+
+static const char *socket_path = DEFAULT_SOCKET;
+
+static uint64_t time_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int connect_socket(void)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == -1) return -1;
+
+    if (connect(sockfd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+static bool write_all(int sockfd, const void *bytes, size_t length)
+{
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = send(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+static bool read_all(int sockfd, void *bytes, size_t length)
+{
+    char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = recv(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+//
+// The connection used by the stream transport.
+//
+
+static struct {
+    int sockfd;
+    uint32_t last_id;
+    uint32_t last_acked_id;
+    uint32_t capabilities;
+} stream = { -1, 0, 0, 0 };
+
+static bool stream_write_frame(uint32_t id, const uint8_t *message, uint32_t length)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX];
+    osax_encode_frame_header(bytes, length, id);
+    memcpy(bytes + OSAX_FRAME_HEADER_SIZE, message, length);
+    return write_all(stream.sockfd, bytes, OSAX_FRAME_HEADER_SIZE + length);
+}
+
+static bool stream_read_frame(struct osax_frame_header *header, uint8_t *rsp)
+{
+    uint8_t bytes[OSAX_FRAME_HEADER_SIZE];
+    if (!read_all(stream.sockfd, bytes, sizeof(bytes))) return false;
+
+    *header = osax_decode_frame_header(bytes);
+    if (header->length > OSAX_FRAME_MAX) return false;
+    return read_all(stream.sockfd, rsp, header->length);
+}
+
+static bool stream_await(uint32_t id)
+{
+    struct osax_frame_header header;
+    uint8_t rsp[OSAX_FRAME_MAX];
+
+    while ((int32_t)(id - stream.last_acked_id) > 0) {
+        if (!stream_read_frame(&header, rsp)) return false;
+        stream.last_acked_id = header.id;
+    }
+
+    return true;
+}
+
+static bool stream_open(void)
+{
+    stream.sockfd = connect_socket();
+    if (stream.sockfd == -1) return false;
+    if (!write_all(stream.sockfd, OSAX_STREAM_MAGIC, OSAX_STREAM_MAGIC_LENGTH)) return false;
+
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    osax_writer_init(&writer, bytes, sizeof(bytes));
+
+    struct osax_op op = { .opcode = OSAX_OP_HANDSHAKE, .handshake = { OSAX_CAPABILITY_ALL } };
+    osax_encode_op(&writer, &op);
+    if (!stream_write_frame(0, bytes, writer.length)) return false;
+
+    struct osax_frame_header header;
+    if (!stream_read_frame(&header, bytes)) return false;
+
+    struct osax_reader reader;
+    osax_reader_init(&reader, bytes, header.length);
+    uint8_t version = osax_read_u8(&reader);
+    stream.capabilities = osax_read_u32(&reader);
+    if (reader.error || version != OSAX_PROTOCOL_VERSION) return false;
+
+    stream.last_id = stream.last_acked_id = 0;
+    return true;
+}
+
+static void stream_close(void)
+{
+    if (stream.sockfd != -1) close(stream.sockfd);
+    stream.sockfd = -1;
+}
+
+static uint32_t stream_transmit(const uint8_t *message, uint32_t length)
+{
+    if ((stream.last_id - stream.last_acked_id) >= SA_MAX_INFLIGHT) {
+        if (!stream_await(stream.last_id - SA_MAX_INFLIGHT + 1)) return 0;
+    }
+
+    uint32_t id = ++stream.last_id;
+    return stream_write_frame(id, message, length) ? id : 0;
+}
+
+//
+// An event is the list of operations yabai sends while handling one event.
+//
+
+struct event
+{
+    struct osax_op *ops;
+    int count;
+};
+
+static bool legacy_send(struct osax_op *op)
+{
+    char message[256];
+
+    switch (op->opcode) {
+    case OSAX_OP_SPACE_FOCUS: {
+        snprintf(message, sizeof(message), "space %lld", (long long) op->space.sid);
+    } break;
+    case OSAX_OP_WINDOW_ALPHA_FADE: {
+        snprintf(message, sizeof(message), "window_alpha_fade %d %f %f", op->window_alpha.wid, op->window_alpha.alpha, op->window_alpha.duration);
+    } break;
+    case OSAX_OP_WINDOW_SHADOW: {
+        snprintf(message, sizeof(message), "window_shadow %d %d", op->window.wid, op->window.value);
+    } break;
+    default: {
+        snprintf(message, sizeof(message), "window_level %d %d", op->window.wid, op->window.value);
+    } break;
+    }
+
+    int sockfd = connect_socket();
+    if (sockfd == -1) return false;
+
+    bool result = write_all(sockfd, message, strlen(message));
+
+    char dummy[64];
+    while (result && recv(sockfd, dummy, sizeof(dummy), 0) > 0);
+
+    close(sockfd);
+    return result;
+}
+
+//
+// Same rules as scripting_addition_batch_append in osax/sa.m; the batch is flushed
+// when a different kind of operation comes in, when the frame is full, before an
+// operation that cannot be batched, and at the end of the event.
+//
+
+#define BATCH_COUNT_OFFSET 3
+
+static struct {
+    uint8_t opcode;
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    int count;
+} batch;
+
+static bool batch_flush(uint32_t *id)
+{
+    if (batch.count == 0) return true;
+
+    batch.bytes[BATCH_COUNT_OFFSET+0] = batch.count & 0xFF;
+    batch.bytes[BATCH_COUNT_OFFSET+1] = (batch.count >> 8) & 0xFF;
+    batch.count = 0;
+
+    return (*id = stream_transmit(batch.bytes, batch.writer.length)) != 0;
+}
+
+static bool batch_append(struct osax_op *op, uint32_t *id)
+{
+    if (!(stream.capabilities & OSAX_CAPABILITY_BATCH)) return false;
+    if (!osax_op_is_batchable(op->opcode)) return false;
+
+    if (batch.count > 0 && batch.opcode != op->opcode) {
+        if (!batch_flush(id)) return false;
+    }
+
+    uint32_t size = osax_op_fields_size(op->opcode);
+    if (batch.count > 0 && (batch.writer.capacity - batch.writer.length < size || batch.count == UINT16_MAX)) {
+        if (!batch_flush(id)) return false;
+    }
+
+    if (batch.count == 0) {
+        batch.opcode = op->opcode;
+        osax_writer_init(&batch.writer, batch.bytes, sizeof(batch.bytes));
+        osax_encode_batch_header(&batch.writer, batch.opcode, 0);
+    }
+
+    osax_encode_op_fields(&batch.writer, op);
+    ++batch.count;
+
+    return true;
+}
+
+static bool run_event(enum transport transport, struct event *event)
+{
+    if (transport == TRANSPORT_LEGACY) {
+        for (int i = 0; i < event->count; ++i) {
+            if (!legacy_send(&event->ops[i])) return false;
+        }
+        return true;
+    }
+
+    uint8_t bytes[OSAX_FRAME_MAX];
+    struct osax_writer writer;
+    uint32_t id = 0;
+
+    for (int i = 0; i < event->count; ++i) {
+        if (transport == TRANSPORT_BATCH && batch_append(&event->ops[i], &id)) continue;
+        if (transport == TRANSPORT_BATCH && !batch_flush(&id)) return false;
+
+        osax_writer_init(&writer, bytes, sizeof(bytes));
+        osax_encode_op(&writer, &event->ops[i]);
+        if (!(id = stream_transmit(bytes, writer.length))) return false;
+    }
+
+    if (transport == TRANSPORT_BATCH && !batch_flush(&id)) return false;
+    return stream_await(id);
+}
+
+//
+// Scenarios
+//
+
+struct scenario
+{
+    const char *name;
+    struct event *events;
+    int event_count;
+    int op_count;
+};
+
+static struct scenario make_scenario(const char *name, int event_count, int ops_per_event)
+{
+    struct scenario scenario = { name, calloc(event_count, sizeof(struct event)), event_count, event_count * ops_per_event };
+    for (int i = 0; i < event_count; ++i) {
+        scenario.events[i].ops = calloc(ops_per_event, sizeof(struct osax_op));
+        scenario.events[i].count = ops_per_event;
+    }
+    return scenario;
+}
+
+//
+// Focus moves between the windows on screen; the window that loses focus fades to the
+// normal opacity and the window that gains it to the active opacity.
+//
+
+static struct scenario scenario_focus(int scale)
+{
+    struct scenario scenario = make_scenario("focus + opacity", 100 * scale, 2);
+    for (int i = 0; i < scenario.event_count; ++i) {
+        uint32_t prev = 1000 + (i % 12);
+        uint32_t next = 1000 + ((i + 1) % 12);
+        scenario.events[i].ops[0] = (struct osax_op) { .opcode = OSAX_OP_WINDOW_ALPHA_FADE, .window_alpha = { prev, 0.90f, 0.20f } };
+        scenario.events[i].ops[1] = (struct osax_op) { .opcode = OSAX_OP_WINDOW_ALPHA_FADE, .window_alpha = { next, 1.00f, 0.20f } };
+    }
+    return scenario;
+}
+
+//
+// Switching back and forth between spaces, each switch waiting for the Dock.
+//
+
+static struct scenario scenario_space(int scale)
+{
+    struct scenario scenario = make_scenario("space switching", 20 * scale, 1);
+    for (int i = 0; i < scenario.event_count; ++i) {
+        scenario.events[i].ops[0] = (struct osax_op) { .opcode = OSAX_OP_SPACE_FOCUS, .space = { 1 + (i % 6) } };
+    }
+    return scenario;
+}
+
+//
+// Toggling purify mode with 100 windows open removes or restores every shadow.
+//
+
+static struct scenario scenario_purify(int scale)
+{
+    struct scenario scenario = make_scenario("purify sweep (100)", 2 * scale, 100);
+    for (int i = 0; i < scenario.event_count; ++i) {
+        for (int j = 0; j < 100; ++j) {
+            scenario.events[i].ops[j] = (struct osax_op) { .opcode = OSAX_OP_WINDOW_SHADOW, .window = { 1000 + j, i & 1 } };
+        }
+    }
+    return scenario;
+}
+
+//
+// window_manager_set_normal_window_opacity and the topmost toggle with 200 windows
+// open; every window fades to the same opacity, then every window changes level.
+//
+
+static struct scenario scenario_bulk(int scale)
+{
+    struct scenario scenario = make_scenario("bulk 200 windows", 2 * scale, 400);
+    for (int i = 0; i < scenario.event_count; ++i) {
+        for (int j = 0; j < 200; ++j) {
+            scenario.events[i].ops[j] = (struct osax_op) { .opcode = OSAX_OP_WINDOW_ALPHA_FADE, .window_alpha = { 1000 + j, (i & 1) ? 1.0f : 0.9f, 0.20f } };
+            scenario.events[i].ops[200+j] = (struct osax_op) { .opcode = OSAX_OP_WINDOW_LEVEL, .window = { 1000 + j, (i & 1) ? 3 : 4 } };
+        }
+    }
+    return scenario;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static bool run_scenario(enum transport transport, struct scenario *scenario)
+{
+    uint64_t *latency = malloc(sizeof(uint64_t) * scenario->event_count);
+
+    if (transport != TRANSPORT_LEGACY && !stream_open()) {
+        fprintf(stderr, "sa_bench: could not connect to %s\n", socket_path);
+        return false;
+    }
+
+    uint64_t start = time_now_ns();
+    for (int i = 0; i < scenario->event_count; ++i) {
+        uint64_t event_start = time_now_ns();
+        if (!run_event(transport, &scenario->events[i])) {
+            fprintf(stderr, "sa_bench: %s failed during %s\n", transport_str[transport], scenario->name);
+            stream_close();
+            free(latency);
+            return false;
+        }
+        latency[i] = time_now_ns() - event_start;
+    }
+    uint64_t elapsed = time_now_ns() - start;
+
+    stream_close();
+    qsort(latency, scenario->event_count, sizeof(uint64_t), compare_u64);
+
+    printf("sa_bench: %-20s %-8s %6d events %6d ops %10.0f ops/s   p50 %8.3fms  p99 %8.3fms  max %8.3fms\n",
+           scenario->name, transport_str[transport], scenario->event_count, scenario->op_count,
+           scenario->op_count / (elapsed / 1.0e9),
+           latency[scenario->event_count / 2] / 1.0e6,
+           latency[(scenario->event_count * 99) / 100] / 1.0e6,
+           latency[scenario->event_count - 1] / 1.0e6);
+
+    free(latency);
+    return true;
+}
+
+static pid_t spawn_standin(const char *standin, char **options, int option_count)
+{
+    char **argv = calloc(option_count + 4, sizeof(char *));
+    argv[0] = (char *) standin;
+    argv[1] = "-s";
+    argv[2] = (char *) socket_path;
+    for (int i = 0; i < option_count; ++i) argv[3+i] = options[i];
+
+    unlink(socket_path);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(standin, argv);
+        perror("sa_bench: execv");
+        _exit(1);
+    }
+    free(argv);
+
+    for (int i = 0; i < 200; ++i) {
+        int sockfd = connect_socket();
+        if (sockfd != -1) {
+            write_all(sockfd, "handshake", 9);
+            char dummy[64];
+            while (recv(sockfd, dummy, sizeof(dummy), 0) > 0);
+            close(sockfd);
+            return pid;
+        }
+        usleep(10000);
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *standin = NULL;
+    int transport_mask = (1 << TRANSPORT_COUNT) - 1;
+    int scale = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "x:s:t:n:")) != -1) {
+        switch (option) {
+        case 'x': standin = optarg; break;
+        case 's': socket_path = optarg; break;
+        case 'n': scale = atoi(optarg); break;
+        case 't': {
+            transport_mask = 0;
+            for (int i = 0; i < TRANSPORT_COUNT; ++i) {
+                if (strstr(optarg, transport_str[i])) transport_mask |= 1 << i;
+            }
+        } break;
+        default: {
+            fprintf(stderr, "usage: %s -x <sa_standin> [-s socket] [-t transport,...] [-n scale] [-- standin options]\n", argv[0]);
+            return 1;
+        } break;
+        }
+    }
+
+    if (scale < 1) scale = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t pid = -1;
+    if (standin && (pid = spawn_standin(standin, argv + optind, argc - optind)) == -1) {
+        fprintf(stderr, "sa_bench: could not start %s\n", standin);
+        return 1;
+    }
+
+    struct scenario scenarios[] = {
+        scenario_focus(scale),
+        scenario_space(scale),
+        scenario_purify(scale),
+        scenario_bulk(scale),
+    };
+
+    bool result = true;
+    for (int i = 0; i < (int)(sizeof(scenarios) / sizeof(*scenarios)) && result; ++i) {
+        for (int j = 0; j < TRANSPORT_COUNT && result; ++j) {
+            if (transport_mask & (1 << j)) result = run_scenario(j, &scenarios[i]);
+        }
+    }
+
+    if (pid != -1) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    return result ? 0 : 1;
+}
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "../src/osax/common.h"
+
+//
+// A stand-in for the scripting addition payload that runs without the Dock. It
+// speaks the same socket protocol as payload.m: the stream magic, length-prefixed
+// frames answered in order with the id of the request, the capability handshake,
+// batches and transactions, and the legacy text handshake. Instead of talking to
+// the window server it spends a configurable amount of time on every operation.
+//
+// Like the payload, one thread reads and splits frames from every connection and
+// a single worker applies them one at a time, in the order they arrived. A
+// connection that does not start with the stream magic is handled the way the
+// payload handled every connection before the stream protocol existed: one text
+// command, applied, and the connection is closed.
+//
+// usage: sa_standin -s <socket> [-f frame_us] [-w window_us] [-p space_us] [-j jitter_us] [-c capabilities]
+//
+
+#define STANDIN_CONNECTION_MAX 64
+#define STANDIN_BUFFER_SIZE (2 * (OSAX_FRAME_HEADER_SIZE + OSAX_FRAME_MAX))
+
+static struct {
+    uint32_t frame_us;
+    uint32_t window_us;
+    uint32_t space_us;
+    uint32_t jitter_us;
+    uint32_t capabilities;
+} config = { 20, 30, 2000, 0, OSAX_CAPABILITY_ALL };
+
+static struct {
+    uint64_t frames;
+    uint64_t window_calls;
+    uint64_t space_calls;
+} stats;
+
+struct job
+{
+    struct job *next;
+    int sockfd;
+    bool is_stream;
+    bool is_close;
+    uint32_t id;
+    uint32_t length;
+    uint8_t message[];
+};
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct job *queue_head;
+static struct job *queue_tail;
+
+struct connection
+{
+    int sockfd;
+    bool is_stream;
+    uint32_t length;
+    uint8_t buffer[STANDIN_BUFFER_SIZE];
+};
+
+static struct connection *connections[STANDIN_CONNECTION_MAX];
+static int connection_count;
+
+static uint64_t time_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+//
+// Spin rather than sleep; the default timer slack on Linux alone is larger than the
+// latencies we are trying to model.
+//
+
+static void spend(uint32_t us)
+{
+    if (!us) return;
+    if (config.jitter_us) us += rand() % (config.jitter_us + 1);
+
+    uint64_t end = time_now_us() + us;
+    while (time_now_us() < end);
+}
+
+static void window_call(void)
+{
+    ++stats.window_calls;
+    spend(config.window_us);
+}
+
+static void space_call(void)
+{
+    ++stats.space_calls;
+    spend(config.space_us);
+}
+
+static bool send_exact(int sockfd, const void *bytes, size_t length)
+{
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t len = send(sockfd, cursor, length, 0);
+        if (len <= 0) return false;
+        cursor += len;
+        length -= len;
+    }
+    return true;
+}
+
+static void handle_op(struct osax_op *op)
+{
+    if (osax_op_is_transactable(op->opcode)) {
+        space_call();
+    } else if (op->opcode != OSAX_OP_HANDSHAKE) {
+        window_call();
+    }
+}
+
+static void do_handshake(struct osax_op *op, struct osax_writer *rsp)
+{
+    osax_write_u8(rsp, OSAX_PROTOCOL_VERSION);
+    osax_write_u32(rsp, op->handshake.capabilities & config.capabilities);
+    osax_write_u32(rsp, OSAX_ATTRIB_ALL);
+    osax_write_bytes(rsp, OSAX_VERSION, strlen(OSAX_VERSION));
+}
+
+static void do_batch(struct osax_reader *reader)
+{
+    uint8_t opcode = osax_read_u8(reader);
+    int count = osax_read_u16(reader);
+    if (reader->error || !osax_op_is_batchable(opcode)) return;
+
+    struct osax_op op;
+    float alpha = -1.0f;
+    float duration = -1.0f;
+
+    for (int i = 0; i < count; ++i) {
+        if (!osax_decode_op_fields(reader, opcode, &op)) break;
+
+        //
+        // The payload applies consecutive fades to the same alpha and duration
+        // through a single window list call.
+        //
+
+        if (opcode == OSAX_OP_WINDOW_ALPHA_FADE && (config.capabilities & OSAX_CAPABILITY_ALPHA_LIST)) {
+            if (op.window_alpha.alpha == alpha && op.window_alpha.duration == duration) continue;
+            alpha = op.window_alpha.alpha;
+            duration = op.window_alpha.duration;
+        }
+
+        handle_op(&op);
+    }
+}
+
+static void do_transaction(struct osax_reader *reader)
+{
+    struct osax_op op_list[OSAX_TRANSACTION_OP_MAX];
+    int count = osax_decode_transaction(reader, op_list, OSAX_TRANSACTION_OP_MAX);
+
+    for (int i = 0; i < count; ++i) {
+        handle_op(&op_list[i]);
+    }
+}
+
+static void handle_message(const uint8_t *bytes, uint32_t length, struct osax_writer *rsp)
+{
+    struct osax_reader reader;
+    osax_reader_init(&reader, bytes, length);
+
+    uint8_t version = osax_read_u8(&reader);
+    uint8_t opcode = osax_read_u8(&reader);
+    if (reader.error || version != OSAX_PROTOCOL_VERSION) return;
+
+    spend(config.frame_us);
+
+    if (opcode == OSAX_OP_BATCH && (config.capabilities & OSAX_CAPABILITY_BATCH)) {
+        do_batch(&reader);
+        return;
+    }
+
+    if (opcode == OSAX_OP_TRANSACTION && (config.capabilities & OSAX_CAPABILITY_TRANSACTION)) {
+        do_transaction(&reader);
+        return;
+    }
+
+    struct osax_op op;
+    if (!osax_decode_op_fields(&reader, opcode, &op)) return;
+
+    if (opcode == OSAX_OP_HANDSHAKE) {
+        do_handshake(&op, rsp);
+    } else {
+        handle_op(&op);
+    }
+}
+
+static void handle_legacy_message(int sockfd, const uint8_t *bytes, uint32_t length)
+{
+    if (length >= 9 && memcmp(bytes, "handshake", 9) == 0) {
+        uint8_t rsp[64];
+        uint32_t attrib = OSAX_ATTRIB_ALL;
+        int version_length = strlen(OSAX_VERSION);
+        memcpy(rsp, OSAX_VERSION, version_length + 1);
+        memcpy(rsp + version_length + 1, &attrib, sizeof(attrib));
+        rsp[version_length + 1 + sizeof(attrib)] = '\n';
+        send_exact(sockfd, rsp, version_length + 2 + sizeof(attrib));
+        return;
+    }
+
+    spend(config.frame_us);
+    if (length >= 5 && memcmp(bytes, "space", 5) == 0) {
+        space_call();
+    } else {
+        window_call();
+    }
+}
+
+static void queue_push(struct job *job)
+{
+    job->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail) queue_tail->next = job;
+    else            queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static struct job *queue_pop(void)
+{
+    pthread_mutex_lock(&queue_lock);
+    while (!queue_head) pthread_cond_wait(&queue_cond, &queue_lock);
+
+    struct job *job = queue_head;
+    queue_head = job->next;
+    if (!queue_head) queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    return job;
+}
+
+static void enqueue(int sockfd, bool is_stream, bool is_close, uint32_t id, const uint8_t *message, uint32_t length)
+{
+    struct job *job = malloc(sizeof(struct job) + length);
+    job->sockfd = sockfd;
+    job->is_stream = is_stream;
+    job->is_close = is_close;
+    job->id = id;
+    job->length = length;
+    if (length) memcpy(job->message, message, length);
+    queue_push(job);
+}
+
+static void *worker(void *unused)
+{
+    (void) unused;
+
+    while (1) {
+        struct job *job = queue_pop();
+
+        if (job->is_close) {
+            shutdown(job->sockfd, SHUT_RDWR);
+            close(job->sockfd);
+        } else if (job->is_stream) {
+            uint8_t rsp_bytes[OSAX_FRAME_MAX];
+            struct osax_writer rsp;
+            osax_writer_init(&rsp, rsp_bytes, sizeof(rsp_bytes));
+            handle_message(job->message, job->length, &rsp);
+            ++stats.frames;
+
+            uint8_t reply[OSAX_FRAME_HEADER_SIZE];
+            osax_encode_frame_header(reply, rsp.length, job->id);
+            if (send_exact(job->sockfd, reply, sizeof(reply)) && rsp.length > 0) {
+                send_exact(job->sockfd, rsp_bytes, rsp.length);
+            }
+        } else {
+            handle_legacy_message(job->sockfd, job->message, job->length);
+            shutdown(job->sockfd, SHUT_RDWR);
+            close(job->sockfd);
+        }
+
+        free(job);
+    }
+
+    return NULL;
+}
+
+static void connection_remove(int index, bool close_socket)
+{
+    struct connection *connection = connections[index];
+    if (close_socket) enqueue(connection->sockfd, false, true, 0, NULL, 0);
+
+    free(connection);
+    connections[index] = connections[--connection_count];
+}
+
+static bool connection_read(struct connection *connection, bool *handed_off)
+{
+    size_t space = sizeof(connection->buffer) - connection->length;
+    if (space == 0) return false;
+
+    ssize_t len = recv(connection->sockfd, connection->buffer + connection->length, space, 0);
+    if (len <= 0) return false;
+    connection->length += len;
+
+    if (!connection->is_stream) {
+        if (connection->length < OSAX_STREAM_MAGIC_LENGTH) return true;
+
+        if (memcmp(connection->buffer, OSAX_STREAM_MAGIC, OSAX_STREAM_MAGIC_LENGTH) != 0) {
+            enqueue(connection->sockfd, false, false, 0, connection->buffer, connection->length);
+            *handed_off = true;
+            return false;
+        }
+
+        connection->is_stream = true;
+        connection->length -= OSAX_STREAM_MAGIC_LENGTH;
+        memmove(connection->buffer, connection->buffer + OSAX_STREAM_MAGIC_LENGTH, connection->length);
+    }
+
+    uint32_t offset = 0;
+    while (connection->length - offset >= OSAX_FRAME_HEADER_SIZE) {
+        struct osax_frame_header header = osax_decode_frame_header(connection->buffer + offset);
+        if (header.length > OSAX_FRAME_MAX) return false;
+        if (connection->length - offset - OSAX_FRAME_HEADER_SIZE < header.length) break;
+
+        enqueue(connection->sockfd, true, false, header.id, connection->buffer + offset + OSAX_FRAME_HEADER_SIZE, header.length);
+        offset += OSAX_FRAME_HEADER_SIZE + header.length;
+    }
+
+    connection->length -= offset;
+    memmove(connection->buffer, connection->buffer + offset, connection->length);
+
+    return true;
+}
+
+static void serve(int listen_fd)
+{
+    struct pollfd fds[STANDIN_CONNECTION_MAX + 1];
+
+    while (1) {
+        fds[0] = (struct pollfd) { listen_fd, POLLIN, 0 };
+        for (int i = 0; i < connection_count; ++i) {
+            fds[i+1] = (struct pollfd) { connections[i]->sockfd, POLLIN, 0 };
+        }
+
+        int count = connection_count;
+        if (poll(fds, count + 1, -1) <= 0) continue;
+
+        for (int i = count - 1; i >= 0; --i) {
+            if (!(fds[i+1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            bool handed_off = false;
+            if (!connection_read(connections[i], &handed_off)) {
+                connection_remove(i, !handed_off);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int sockfd = accept(listen_fd, NULL, 0);
+            if (sockfd == -1) continue;
+
+            if (connection_count == STANDIN_CONNECTION_MAX) {
+                close(sockfd);
+                continue;
+            }
+
+            struct connection *connection = malloc(sizeof(struct connection));
+            connection->sockfd = sockfd;
+            connection->is_stream = false;
+            connection->length = 0;
+            connections[connection_count++] = connection;
+        }
+    }
+}
+
+static void print_stats(int signal)
+{
+    (void) signal;
+    fprintf(stderr, "sa_standin: %llu frames, %llu window calls, %llu space calls\n",
+            (unsigned long long) stats.frames, (unsigned long long) stats.window_calls, (unsigned long long) stats.space_calls);
+    _exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:f:w:p:j:c:")) != -1) {
+        switch (option) {
+        case 's': socket_path = optarg; break;
+        case 'f': config.frame_us = strtoul(optarg, NULL, 0); break;
+        case 'w': config.window_us = strtoul(optarg, NULL, 0); break;
+        case 'p': config.space_us = strtoul(optarg, NULL, 0); break;
+        case 'j': config.jitter_us = strtoul(optarg, NULL, 0); break;
+        case 'c': config.capabilities = strtoul(optarg, NULL, 0) & OSAX_CAPABILITY_ALL; break;
+        default: {
+            fprintf(stderr, "usage: %s -s <socket> [-f frame_us] [-w window_us] [-p space_us] [-j jitter_us] [-c capabilities]\n", argv[0]);
+            return 1;
+        } break;
+        }
+    }
+
+    if (!socket_path) {
+        fprintf(stderr, "sa_standin: missing socket path (-s)\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, print_stats);
+    signal(SIGTERM, print_stats);
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    unlink(socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1 ||
+        bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+        chmod(socket_path, 0600) != 0 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        perror("sa_standin");
+        return 1;
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, worker, NULL);
+
+    fprintf(stderr, "sa_standin: listening on %s (frame %uus, window %uus, space %uus, jitter %uus, capabilities 0x%X)\n",
+            socket_path, config.frame_us, config.window_us, config.space_us, config.jitter_us, config.capabilities);
+    serve(listen_fd);
+
+    return 0;
+}
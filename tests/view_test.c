@@ -0,0 +1,380 @@
+#include "platform.h"
+#include "helpers.h"
+#include "../src/misc/macros.h"
+#include "../src/misc/sbuffer.h"
+
+//
+// Drives the layout code in view.c against a fake window server. Every frame
+// yabai writes costs three AX calls (resize, move, resize) and the application
+// answers with a moved and / or resized notification whenever the frame it ends
+// up at differs from the one it was at. Applications align fractional frames to
+// whole pixels by rounding each edge, rather than the origin and the size on
+// their own, so the width a window ends up with depends on where its origin
+// falls; the fake window server does the same.
+//
+
+enum border_placement
+{
+    BORDER_PLACEMENT_EXTERIOR = 0,
+    BORDER_PLACEMENT_INTERIOR = 1,
+    BORDER_PLACEMENT_INSET    = 2,
+};
+
+struct border
+{
+    int width;
+    bool insert_active;
+    int insert_dir;
+    bool enabled;
+};
+
+struct window
+{
+    uint32_t id;
+    struct border border;
+    CGSize min_size;
+    CGRect frame;
+};
+
+struct space_label
+{
+    uint64_t sid;
+    char *label;
+};
+
+struct space_membership { int unused; };
+
+struct space_manager
+{
+    struct space_membership membership;
+    uint64_t current_space_id;
+    int layout;
+    int top_padding;
+    int bottom_padding;
+    int left_padding;
+    int right_padding;
+    int window_gap;
+    float split_ratio;
+    int window_placement;
+    bool auto_balance;
+    bool pixel_snap;
+};
+
+struct window_manager
+{
+    uint32_t focused_window_id;
+    enum border_placement window_border_placement;
+};
+
+struct display_manager { int unused; };
+
+struct display_manager g_display_manager;
+struct space_manager g_space_manager;
+struct window_manager g_window_manager;
+
+#define WINDOW_COUNT 7
+static struct window windows[WINDOW_COUNT];
+static CGRect display_frame = { { 0, 25 }, { 2560, 1415 } };
+
+static int ax_writes;
+static int notifications;
+
+static struct window *window_manager_find_window(struct window_manager *wm, uint32_t window_id)
+{
+    if (window_id == 0 || window_id > WINDOW_COUNT) return NULL;
+    return &windows[window_id-1];
+}
+
+static bool window_manager_set_window_frame(struct window *window, float x, float y, float width, float height)
+{
+    CGRect frame = { { roundf(x), roundf(y) }, { roundf(x + width) - roundf(x), roundf(y + height) - roundf(y) } };
+
+    ax_writes += 3;
+    if (frame.origin.x   != window->frame.origin.x   || frame.origin.y    != window->frame.origin.y)    ++notifications;
+    if (frame.size.width != window->frame.size.width || frame.size.height != window->frame.size.height) ++notifications;
+
+    window->frame = frame;
+    return true;
+}
+
+static void window_manager_remove_managed_window(struct window_manager *wm, uint32_t window_id) {}
+static uint32_t space_display_id(uint64_t sid) { return 1; }
+static CGRect display_bounds_constrained(uint32_t did) { return display_frame; }
+static int display_arrangement(uint32_t did) { return 1; }
+static bool space_is_user(uint64_t sid) { return true; }
+static bool space_is_visible(uint64_t sid) { return true; }
+static bool space_is_fullscreen(uint64_t sid) { return false; }
+static int space_manager_mission_control_index(uint64_t sid) { return 1; }
+static struct space_label *space_manager_get_label_for_space(struct space_manager *sm, uint64_t sid) { return NULL; }
+static uint32_t *space_membership_window_list(struct space_membership *membership, uint64_t sid, int *count) { *count = 0; return NULL; }
+
+static bool rect_is_in_direction(CGRect r1, CGRect r2, int direction)
+{
+    CGPoint r1_max = { CGRectGetMaxX(r1), CGRectGetMaxY(r1) };
+    CGPoint r2_max = { CGRectGetMaxX(r2), CGRectGetMaxY(r2) };
+
+    switch (direction) {
+    case DIR_NORTH: if (r2.origin.y > r1_max.y) return false; break;
+    case DIR_WEST:  if (r2.origin.x > r1_max.x) return false; break;
+    case DIR_SOUTH: if (r2_max.y < r1.origin.y) return false; break;
+    case DIR_EAST:  if (r2_max.x < r1.origin.x) return false; break;
+    }
+
+    switch (direction) {
+    case DIR_NORTH:
+    case DIR_SOUTH:
+        return (r2.origin.x >= r1.origin.x && r2.origin.x <= r1_max.x) ||
+               (r2_max.x >= r1.origin.x && r2_max.x <= r1_max.x) ||
+               (r1.origin.x > r2.origin.x && r1.origin.x < r2_max.x);
+    case DIR_WEST:
+    case DIR_EAST:
+        return (r2.origin.y >= r1.origin.y && r2.origin.y <= r1_max.y) ||
+               (r2_max.y >= r1.origin.y && r2_max.y <= r1_max.y) ||
+               (r1.origin.y > r2.origin.y && r1_max.y < r2_max.y);
+    }
+
+    return false;
+}
+
+static uint32_t rect_distance(CGRect r1, CGRect r2, int direction)
+{
+    CGPoint r1_max = { CGRectGetMaxX(r1), CGRectGetMaxY(r1) };
+    CGPoint r2_max = { CGRectGetMaxX(r2), CGRectGetMaxY(r2) };
+
+    switch (direction) {
+    case DIR_NORTH: return r2_max.y > r1.origin.y ? r2_max.y - r1.origin.y : r1.origin.y - r2_max.y;
+    case DIR_WEST:  return r2_max.x > r1.origin.x ? r2_max.x - r1.origin.x : r1.origin.x - r2_max.x;
+    case DIR_SOUTH: return r2.origin.y < r1_max.y ? r1_max.y - r2.origin.y : r2.origin.y - r1_max.y;
+    case DIR_EAST:  return r2.origin.x < r1_max.x ? r1_max.x - r2.origin.x : r2.origin.x - r1_max.x;
+    }
+
+    return UINT32_MAX;
+}
+
+#include "../src/view.h"
+#include "../src/view.c"
+
+static struct view *create_view(bool pixel_snap)
+{
+    memset(&g_space_manager, 0, sizeof(g_space_manager));
+    memset(&g_window_manager, 0, sizeof(g_window_manager));
+    memset(windows, 0, sizeof(windows));
+
+    g_space_manager.layout = VIEW_BSP;
+    g_space_manager.top_padding = 9;
+    g_space_manager.bottom_padding = 9;
+    g_space_manager.left_padding = 9;
+    g_space_manager.right_padding = 9;
+    g_space_manager.window_gap = 7;
+    g_space_manager.split_ratio = 0.37f;
+    g_space_manager.window_placement = CHILD_SECOND;
+    g_space_manager.pixel_snap = pixel_snap;
+    g_window_manager.window_border_placement = BORDER_PLACEMENT_INSET;
+
+    struct view *view = view_create(1);
+    for (int i = 0; i < WINDOW_COUNT; ++i) {
+        windows[i].id = i + 1;
+        windows[i].border.enabled = true;
+        windows[i].border.width = 3;
+        g_window_manager.focused_window_id = windows[i].id;
+        view_add_window_node(view, &windows[i]);
+    }
+
+    view_update(view);
+    view_flush(view);
+    ax_writes = notifications = 0;
+
+    return view;
+}
+
+static void destroy_view(struct view *view)
+{
+    view_clear(view);
+    free(view->root);
+    free(view);
+}
+
+static bool view_is_pixel_aligned(struct view *view)
+{
+    for (struct window_node *node = window_node_find_first_leaf(view->root); node; node = window_node_find_next_leaf(node)) {
+        if (node->area.x != floorf(node->area.x) || node->area.y != floorf(node->area.y) ||
+            node->area.w != floorf(node->area.w) || node->area.h != floorf(node->area.h)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int view_snapshot(struct view *view, struct area *areas)
+{
+    int count = 0;
+    for (struct window_node *node = window_node_find_first_leaf(view->root); node; node = window_node_find_next_leaf(node)) {
+        areas[count++] = node->area;
+    }
+    return count;
+}
+
+//
+// The flushes that follow events which do not change the layout (focus changes,
+// application activation and so on), and rotate, mirror and balance commands.
+// rotating by 180 degrees moves every window without changing its size, which
+// a fractional layout still turns into a resize whenever the window's origin
+// lands on a different fraction of a pixel.
+//
+
+struct replay_result
+{
+    int steady_writes;
+    int steady_notifications;
+    int command_writes;
+    int command_notifications;
+};
+
+static struct replay_result replay(struct view *view)
+{
+    struct replay_result result = {};
+
+    ax_writes = notifications = 0;
+    for (int i = 0; i < 50; ++i) {
+        view_flush(view);
+    }
+    result.steady_writes = ax_writes;
+    result.steady_notifications = notifications;
+
+    ax_writes = notifications = 0;
+    for (int i = 0; i < 8; ++i) {
+        window_node_rotate(view->root, 90);
+        view_update(view);
+        view_flush(view);
+        view_flush(view);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        window_node_mirror(view->root, SPLIT_Y);
+        view_update(view);
+        view_flush(view);
+        view_flush(view);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        window_node_rotate(view->root, 180);
+        view_update(view);
+        view_flush(view);
+        view_flush(view);
+    }
+
+    window_node_equalize(view->root);
+    view_update(view);
+    view_flush(view);
+    view_flush(view);
+    result.command_writes = ax_writes;
+    result.command_notifications = notifications;
+
+    return result;
+}
+
+static void test_redundant_writes(void)
+{
+    struct view *view = create_view(false);
+    struct replay_result fractional = replay(view);
+    destroy_view(view);
+
+    view = create_view(true);
+    struct replay_result snapped = replay(view);
+    destroy_view(view);
+
+    printf("view_test: %-24s %10s %14s %12s %14s\n", "", "idle writes", "notifications", "cmd writes", "notifications");
+    printf("view_test: %-24s %10d %14d %12d %14d\n", "fractional layout", fractional.steady_writes, fractional.steady_notifications, fractional.command_writes, fractional.command_notifications);
+    printf("view_test: %-24s %10d %14d %12d %14d\n", "pixel snapped layout", snapped.steady_writes, snapped.steady_notifications, snapped.command_writes, snapped.command_notifications);
+
+    int eliminated = (fractional.steady_writes + fractional.command_writes) - (snapped.steady_writes + snapped.command_writes);
+    printf("view_test: pixel_snap eliminated %d of %d ax writes\n", eliminated, fractional.steady_writes + fractional.command_writes);
+
+    expect(snapped.steady_writes == 0);
+    expect(snapped.steady_notifications == 0);
+    expect(fractional.steady_writes == 50 * WINDOW_COUNT * 3);
+    expect(snapped.command_notifications < fractional.command_notifications);
+    expect(snapped.command_writes < fractional.command_writes);
+}
+
+static void test_no_drift(void)
+{
+    struct area before[WINDOW_COUNT];
+    struct area after[WINDOW_COUNT];
+
+    struct view *view = create_view(true);
+    expect(view_is_pixel_aligned(view));
+    int count = view_snapshot(view, before);
+
+    for (int i = 0; i < 100; ++i) {
+        window_node_rotate(view->root, 90);
+        window_node_mirror(view->root, SPLIT_X);
+        window_node_mirror(view->root, SPLIT_Y);
+        view_update(view);
+        expect(view_is_pixel_aligned(view));
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        window_node_mirror(view->root, SPLIT_X);
+        window_node_mirror(view->root, SPLIT_Y);
+        window_node_rotate(view->root, 270);
+        view_update(view);
+    }
+
+    expect(view_snapshot(view, after) == count);
+    expect(memcmp(before, after, sizeof(struct area) * count) == 0);
+
+    //
+    // Going back to the original layout is a real change for the windows, but once
+    // they are in place no further flush should touch them.
+    //
+
+    view_flush(view);
+    ax_writes = notifications = 0;
+    view_flush(view);
+    expect(ax_writes == 0);
+
+    destroy_view(view);
+}
+
+static void test_external_move(void)
+{
+    struct view *view = create_view(true);
+
+    //
+    // window_manager_invalidate_window_frame drops the cached frame of a window
+    // that was moved by someone else; only that window is written again.
+    //
+
+    struct window_node *node = view_find_window_node(view, windows[2].id);
+    node->applied_window_id = 0;
+    view_flush(view);
+    expect(ax_writes == 3);
+
+    //
+    // Swapping two windows keeps both nodes (and their areas) but the frames now
+    // belong to different windows, so both of them have to be written.
+    //
+
+    ax_writes = 0;
+    struct window_node *a = view_find_window_node(view, windows[0].id);
+    struct window_node *b = view_find_window_node(view, windows[1].id);
+    a->window_id = windows[1].id;
+    b->window_id = windows[0].id;
+    view_flush(view);
+    expect(ax_writes == 6);
+
+    destroy_view(view);
+}
+
+int main(int argc, char **argv)
+{
+    test_redundant_writes();
+    test_no_drift();
+    test_external_move();
+
+    if (test_failed("view_test")) return 1;
+
+    printf("view_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <Carbon/Carbon.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../src/misc/macros.h"
+
+//
+// Measures what it costs to classify a window of a running application the
+// way window_create and the WINDOW_CREATED handler used to (one AX request per
+// question, with role and subrole asked for again by every window_is_* check)
+// against the single AXUIElementCopyMultipleAttributeValues request used now.
+//
+// usage: window_create_bench <pid> [iterations]
+//
+// The terminal running the benchmark needs accessibility permissions.
+//
+
+#define DEFAULT_ITERATIONS 200
+
+static double time_now_us(void)
+{
+    return CFAbsoluteTimeGetCurrent() * 1000000.0;
+}
+
+static void copy_and_release(AXUIElementRef ref, CFStringRef attribute)
+{
+    CFTypeRef value = NULL;
+    AXUIElementCopyAttributeValue(ref, attribute, &value);
+    if (value) CFRelease(value);
+}
+
+static double classify_separately(AXUIElementRef ref)
+{
+    double start = time_now_us();
+
+    copy_and_release(ref, kAXMinimizedAttribute);
+    copy_and_release(ref, kAXFullscreenAttribute);
+    copy_and_release(ref, kAXRoleAttribute);
+    copy_and_release(ref, kAXSubroleAttribute);
+    copy_and_release(ref, kAXRoleAttribute);
+    copy_and_release(ref, kAXSubroleAttribute);
+    copy_and_release(ref, kAXRoleAttribute);
+    copy_and_release(ref, kAXSubroleAttribute);
+    copy_and_release(ref, kAXTitleAttribute);
+
+    return time_now_us() - start;
+}
+
+static double classify_batched(AXUIElementRef ref)
+{
+    CFStringRef attributes[] = {
+        kAXRoleAttribute,
+        kAXSubroleAttribute,
+        kAXMinimizedAttribute,
+        kAXFullscreenAttribute,
+        kAXTitleAttribute
+    };
+
+    double start = time_now_us();
+
+    CFArrayRef values = NULL;
+    CFArrayRef attribute_list = CFArrayCreate(NULL, (void *)attributes, array_count(attributes), &kCFTypeArrayCallBacks);
+    AXUIElementCopyMultipleAttributeValues(ref, attribute_list, 0, &values);
+    CFRelease(attribute_list);
+    if (values) CFRelease(values);
+
+    return time_now_us() - start;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int count)
+{
+    double total = 0;
+    for (int i = 0; i < count; ++i) total += samples[i];
+
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-12s mean %8.1fus  p50 %8.1fus  p99 %8.1fus\n", name, total / count, samples[count / 2], samples[(count * 99) / 100]);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <pid> [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    pid_t pid = atoi(argv[1]);
+    int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+    if (!AXIsProcessTrusted()) {
+        fprintf(stderr, "window_create_bench: accessibility permissions are required\n");
+        return 1;
+    }
+
+    AXUIElementRef application = AXUIElementCreateApplication(pid);
+    CFArrayRef window_list = NULL;
+    AXUIElementCopyAttributeValue(application, kAXWindowsAttribute, (CFTypeRef *) &window_list);
+    if (!window_list || !CFArrayGetCount(window_list)) {
+        fprintf(stderr, "window_create_bench: process %d has no windows\n", pid);
+        return 1;
+    }
+
+    int window_count = CFArrayGetCount(window_list);
+    int count = window_count * iterations;
+    double *separate = malloc(sizeof(double) * count);
+    double *batched = malloc(sizeof(double) * count);
+
+    for (int i = 0; i < iterations; ++i) {
+        for (int j = 0; j < window_count; ++j) {
+            AXUIElementRef ref = CFArrayGetValueAtIndex(window_list, j);
+            separate[i * window_count + j] = classify_separately(ref);
+            batched[i * window_count + j] = classify_batched(ref);
+        }
+    }
+
+    printf("window_create_bench: %d window(s) of process %d, %d iteration(s)\n", window_count, pid, iterations);
+    report("separate", separate, count);
+    report("batched", batched, count);
+
+    free(separate);
+    free(batched);
+    CFRelease(window_list);
+    CFRelease(application);
+
+    return 0;
+}